@@ -0,0 +1,146 @@
+/*
+arena.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+An arena hands out storage from a list of large blocks, each at least
+twice the size of the one before, by advancing a pointer.  Clearing
+an arena keeps the blocks, so once an arena has grown large enough
+for the biggest job it is used for, it never calls malloc() again.
+
+*/
+
+
+#include "arena.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+/* Every allocation is rounded up to a multiple of sizeof (align_t), */
+/* which is assumed to be suitably aligned for any object:           */
+
+typedef union align_t {
+  long l;
+  double d;
+  void *p;
+} align_t;
+
+#define MINBLOCK 256  /* The number of align_t in the first block. */
+
+typedef struct ablock {
+  struct ablock *next;  /* The next block, or NULL if none. */
+  align_t *mem;         /* Storage for this block.          */
+  size_t size;          /* Number of align_t in *mem.       */
+} ablock;
+
+struct arena {
+  ablock *first,    /* The first block.                           */
+         *current;  /* The block being allocated from.  Any after */
+                    /* it are empty.                              */
+  size_t used;      /* Number of align_t used in *current.        */
+};
+
+
+static ablock *newablock(size_t size)
+
+/* Returns a new block of size align_t, or NULL */
+/* if there is not enough memory.               */
+{
+  ablock *blk;
+
+  blk = malloc(sizeof (ablock));
+  if (!blk) return NULL;
+  blk->mem = malloc(size * sizeof (align_t));
+  if (!blk->mem) {
+    free(blk);
+    return NULL;
+  }
+  blk->next = NULL;
+  blk->size = size;
+
+  return blk;
+}
+
+
+arena *newarena(errmsg_t errmsg)
+{
+  arena *a;
+
+  a = malloc(sizeof (arena));
+  if (!a) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  a->first = a->current = newablock(MINBLOCK);
+  if (!a->first) {
+    strcpy(errmsg,outofmem);
+    free(a);
+    return NULL;
+  }
+  a->used = 0;
+
+  *errmsg = '\0';
+  return a;
+}
+
+
+void freearena(arena *a)
+{
+  ablock *blk, *next;
+
+  for (blk = a->first;  blk;  blk = next) {
+    next = blk->next;
+    free(blk->mem);
+    free(blk);
+  }
+  free(a);
+}
+
+
+void cleararena(arena *a)
+{
+  a->current = a->first;
+  a->used = 0;
+}
+
+
+void *arenaalloc(arena *a, size_t size, errmsg_t errmsg)
+{
+  ablock *blk = a->current, *new;
+  size_t n;
+
+  n = (size + sizeof (align_t) - 1) / sizeof (align_t);
+
+  while (blk->size - a->used < n) {
+    if (!blk->next || blk->next->size < n) {
+      new = newablock(2 * blk->size < n  ?  n  :  2 * blk->size);
+      if (!new) {
+        strcpy(errmsg,outofmem);
+        return NULL;
+      }
+      new->next = blk->next;
+      blk->next = new;
+    }
+    a->current = blk = blk->next;
+    a->used = 0;
+  }
+
+  a->used += n;
+
+  *errmsg = '\0';
+  return blk->mem + a->used - n;
+}
@@ -0,0 +1,55 @@
+/*
+arena.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "errmsg.h"
+
+#include <stddef.h>
+
+
+typedef struct arena arena;
+
+
+arena *newarena(errmsg_t errmsg);
+
+  /* newarena(errmsg) returns a pointer to a new empty arena, from */
+  /* which many small objects can be allocated cheaply and then    */
+  /* discarded all at once.  Returns NULL on failure.              */
+
+
+void freearena(arena *a);
+
+  /* freearena(a) frees the memory associated with *a, including */
+  /* every object allocated from it.  a may not be used after    */
+  /* this call.                                                  */
+
+
+void cleararena(arena *a);
+
+  /* cleararena(a) discards every object allocated from *a, */
+  /* but does not free any memory, so that *a can be reused */
+  /* without calling malloc() again.                        */
+
+
+void *arenaalloc(arena *a, size_t size, errmsg_t errmsg);
+
+  /* arenaalloc(a,size,errmsg) returns a pointer to size bytes of */
+  /* storage allocated from *a, suitably aligned for any object.  */
+  /* The storage remains valid until *a is cleared or freed.      */
+  /* size must not be 0.  Returns NULL on failure.                */
+
+
+#endif
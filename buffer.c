@@ -1,7 +1,7 @@
 /*
 buffer.c
-last touched in Par 1.53.0
-last meaningful change in Par 1.50
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
 Copyright 1993, 1996 Adam M. Costello
 
 This is ANSI C code (C89).
@@ -156,6 +156,63 @@ aierror:
 }
 
 
+void additems(buffer *buf, const void *items, int n, errmsg_t errmsg)
+{
+  block *blk, *new, *oldcurrent;
+  void *newitems;
+  int maxhere, oldnumhere, k;
+  size_t itemsize = buf->itemsize;
+  const char *src = items;
+
+  oldcurrent = blk = buf->current;
+  oldnumhere = blk->numhere;
+
+  while (n > 0) {
+    if (blk->numhere == blk->maxhere) {
+      new = blk->next;
+      if (!new) {
+        maxhere = 2 * blk->maxhere;
+        if (maxhere < n) maxhere = n;
+        new = malloc(sizeof (block));
+        newitems = malloc(maxhere * itemsize);
+        if (!new || !newitems) {
+          strcpy(errmsg,outofmem);
+          goto aiserror;
+        }
+        blk->next = new;
+        new->next = NULL;
+        new->maxhere = maxhere;
+        new->numprevious = blk->numprevious + blk->numhere;
+        new->numhere = 0;
+        new->items = newitems;
+      }
+      blk = buf->current = new;
+    }
+
+    k = blk->maxhere - blk->numhere;
+    if (k > n) k = n;
+    memcpy( ((char *) blk->items) + (blk->numhere * itemsize), src,
+            k * itemsize );
+    blk->numhere += k;
+    src += k * itemsize;
+    n -= k;
+  }
+
+  *errmsg = '\0';
+  return;
+
+aiserror:
+
+  if (new) free(new);
+  if (newitems) free(newitems);
+
+  for (blk = oldcurrent->next;  blk;  blk = blk->next)
+    blk->numhere = 0;
+  oldcurrent->numhere = oldnumhere;
+  buf->current = oldcurrent;
+}
+
+
 int numitems(buffer *buf)
 {
   block *blk = buf->current;
@@ -214,3 +271,25 @@ void *nextitem(buffer *buf)
 
   return r;
 }
+
+
+void *nextitems(buffer *buf, int *pn)
+{
+  void *r;
+
+  if (!buf->nextblk || buf->nextindex >= buf->nextblk->numhere) {
+    *pn = 0;
+    return NULL;
+  }
+
+  r = ((char *) buf->nextblk->items) + (buf->nextindex * buf->itemsize);
+  *pn = buf->nextblk->numhere - buf->nextindex;
+
+  buf->nextindex += *pn;
+  if (buf->nextindex >= buf->nextblk->maxhere) {
+    buf->nextblk = buf->nextblk->next;
+    buf->nextindex = 0;
+  }
+
+  return r;
+}
@@ -1,7 +1,7 @@
 /*
 buffer.h
-last touched in Par 1.53.0
-last meaningful change in Par 1.31
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
 Copyright 1993 Adam M. Costello
 
 This is ANSI C code (C89).
@@ -47,6 +47,14 @@ void additem(buffer *buf, const void *item, errmsg_t errmsg);
   /* for *buf.  If additem() fails, *buf will be unaffected. */
 
 
+void additems(buffer *buf, const void *items, int n, errmsg_t errmsg);
+
+  /* additems(buf,items,n,errmsg) copies the n objects in the array */
+  /* items to the end of *buf, as if by n calls to additem(), but   */
+  /* copying as many of them at a time as possible.  If additems()  */
+  /* fails, *buf will be unaffected.                                */
+
+
 int numitems(buffer *buf);
 
   /* numitems(buf) returns the number of items in *buf. */
@@ -72,6 +80,14 @@ void *nextitem(buffer *buf);
   /* is and returns NULL.                                              */
 
 
+void *nextitems(buffer *buf, int *pn);
+
+  /* nextitems(buf,pn) is like nextitem(buf), except that it returns */
+  /* a pointer to as many consecutive items as are stored together,  */
+  /* sets *pn to their number, and advances the pointer past all of  */
+  /* them.  If there is no item in the slot, it sets *pn to 0.       */
+
+
 void rewindbuffer(buffer *buf);
 
   /* rewindbuffer(buf) resets the pointer used by   */
@@ -0,0 +1,307 @@
+/*
+cache.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+The entries are kept in a hash table with a chain for each bucket,
+and in a list from the most to the least recently used, so that
+finding, storing, and forgetting each take constant time.  The table
+doubles whenever there are more entries than buckets.  The hash is
+FNV-1a, computed as the key is added, and only the low 32 bits of it
+are used, so it is the same whatever the size of an unsigned long.
+
+*/
+
+
+#include "cache.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#define MINBUCKETS 64
+
+typedef struct entry {
+  struct entry *next,     /* The next entry in the same bucket.        */
+               *newer,    /* The entries used just before and just     */
+               *older;    /* after this one, or NULL.                  */
+  unsigned long hash;     /* The hash of the key.                      */
+  size_t keylen, vallen;  /* The key and value follow the entry.       */
+} entry;
+
+struct cache {
+  size_t limit, used;     /* The most bytes to use, and those in use.  */
+  entry **buckets;        /* The hash table, with numbuckets buckets,  */
+  size_t numbuckets,      /* a power of 2.                             */
+         numentries;
+  entry *newest, *oldest; /* The ends of the list of entries.          */
+  char *key, *val;        /* The key being made, with room for keysize */
+  size_t keylen, keysize, /* characters, and the value being made for  */
+         vallen, valsize; /* it, with room for valsize.                */
+  unsigned long hash;     /* The hash of the key being made.           */
+};
+
+#define KEYOF(e) ((char *) ((e) + 1))
+#define VALOF(e) (KEYOF(e) + (e)->keylen)
+
+
+static int addchars(
+  char **pchars, size_t *plen, size_t *psize, const char *chars, size_t n
+)
+/* Appends the n characters starting at chars to the *plen held in  */
+/* *pchars, which has room for *psize, making more room by doubling */
+/* if need be, and adds n to *plen.  Returns 1, or 0 if there is    */
+/* not enough memory.                                               */
+{
+  char *p;
+  size_t size;
+
+  if (*plen + n > *psize) {
+    size =  2 * *psize > *plen + n  ?  2 * *psize  :  *plen + n;
+    p = realloc(*pchars, size);
+    if (!p) return 0;
+    *pchars = p;
+    *psize = size;
+  }
+  memcpy(*pchars + *plen, chars, n);
+  *plen += n;
+
+  return 1;
+}
+
+
+cache *newcache(size_t limit, errmsg_t errmsg)
+{
+  cache *c;
+
+  c = malloc(sizeof (cache));
+  if (!c) goto nomem;
+  c->buckets = calloc(MINBUCKETS, sizeof (entry *));
+  if (!c->buckets) {
+    free(c);
+    goto nomem;
+  }
+  c->limit = limit;
+  c->used = c->numentries = 0;
+  c->numbuckets = MINBUCKETS;
+  c->newest = c->oldest = NULL;
+  c->key = c->val = NULL;
+  c->keylen = c->keysize = c->vallen = c->valsize = 0;
+  cachekey(c);
+
+  *errmsg = '\0';
+  return c;
+
+nomem:
+
+  strcpy(errmsg,outofmem);
+  return NULL;
+}
+
+
+void freecache(cache *c)
+{
+  clearcache(c);
+  free(c->buckets);
+  if (c->key) free(c->key);
+  if (c->val) free(c->val);
+  free(c);
+}
+
+
+void clearcache(cache *c)
+{
+  entry *e, *older;
+
+  for (e = c->newest;  e;  e = older) {
+    older = e->older;
+    free(e);
+  }
+  memset(c->buckets, 0, c->numbuckets * sizeof (entry *));
+  c->newest = c->oldest = NULL;
+  c->used = c->numentries = 0;
+}
+
+
+void cachekey(cache *c)
+{
+  c->keylen = c->vallen = 0;
+  c->hash = 2166136261UL;
+}
+
+
+void cacheadd(cache *c, const char *chars, size_t n, errmsg_t errmsg)
+{
+  const unsigned char *p, *end;
+  unsigned long h = c->hash;
+
+  if (!addchars(&c->key, &c->keylen, &c->keysize, chars, n)) {
+    strcpy(errmsg,outofmem);
+    return;
+  }
+
+  for (p = (const unsigned char *) chars, end = p + n;  p < end;  ++p)
+    h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+  c->hash = h;
+
+  *errmsg = '\0';
+}
+
+
+static entry **findslot(cache *c)
+
+/* Returns a pointer to the link in the chain of the bucket for the */
+/* key being made that points to its entry, or that is NULL if it   */
+/* has none.                                                        */
+{
+  entry **pe, *e;
+
+  for (pe = c->buckets + (c->hash & (c->numbuckets - 1));
+       (e = *pe) != NULL;
+       pe = &e->next)
+    if (   e->hash == c->hash && e->keylen == c->keylen
+        && !memcmp(KEYOF(e), c->key, c->keylen))
+      break;
+
+  return pe;
+}
+
+
+static void detach(cache *c, entry *e)
+
+/* Removes *e from the list of entries of *c. */
+{
+  if (e->newer) e->newer->older = e->older;
+  else c->newest = e->older;
+  if (e->older) e->older->newer = e->newer;
+  else c->oldest = e->newer;
+}
+
+
+static void pushnewest(cache *c, entry *e)
+
+/* Puts *e at the front of the list of entries of *c. */
+{
+  e->newer = NULL;
+  e->older = c->newest;
+  if (c->newest) c->newest->newer = e;
+  else c->oldest = e;
+  c->newest = e;
+}
+
+
+const char *cachefind(cache *c, size_t *plen)
+{
+  entry *e;
+
+  e = *findslot(c);
+  if (!e) {
+    *plen = 0;
+    return NULL;
+  }
+
+  if (e != c->newest) {
+    detach(c,e);
+    pushnewest(c,e);
+  }
+
+  *plen = e->vallen;
+  return VALOF(e);
+}
+
+
+void cacheline(cache *c, const char *line, errmsg_t errmsg)
+{
+  if (!addchars(&c->val, &c->vallen, &c->valsize, line, strlen(line) + 1))
+    strcpy(errmsg,outofmem);
+  else
+    *errmsg = '\0';
+}
+
+
+static void forgetoldest(cache *c)
+
+/* Removes the least recently used entry from *c, which must */
+/* have one, and frees it.                                   */
+{
+  entry *e = c->oldest, **pe;
+
+  for (pe = c->buckets + (e->hash & (c->numbuckets - 1));
+       *pe != e;
+       pe = &(*pe)->next);
+  *pe = e->next;
+  detach(c,e);
+  c->used -= sizeof (entry) + e->keylen + e->vallen;
+  --c->numentries;
+  free(e);
+}
+
+
+static void growtable(cache *c)
+
+/* Doubles the number of buckets of *c, or does nothing if */
+/* there is not enough memory.                             */
+{
+  entry **buckets, *e, *next, **pe;
+  size_t i, n = 2 * c->numbuckets;
+
+  buckets = calloc(n, sizeof (entry *));
+  if (!buckets) return;
+
+  for (i = 0;  i < c->numbuckets;  ++i)
+    for (e = c->buckets[i];  e;  e = next) {
+      next = e->next;
+      pe = buckets + (e->hash & (n - 1));
+      e->next = *pe;
+      *pe = e;
+    }
+
+  free(c->buckets);
+  c->buckets = buckets;
+  c->numbuckets = n;
+}
+
+
+void cachestore(cache *c, errmsg_t errmsg)
+{
+  entry *e, **pe;
+  size_t size;
+
+  *errmsg = '\0';
+
+  size = sizeof (entry) + c->keylen + c->vallen;
+  if (size > c->limit) return;
+  while (c->used + size > c->limit) forgetoldest(c);
+  if (c->numentries >= c->numbuckets) growtable(c);
+
+  e = malloc(size);
+  if (!e) {
+    strcpy(errmsg,outofmem);
+    return;
+  }
+  e->hash = c->hash;
+  e->keylen = c->keylen;
+  e->vallen = c->vallen;
+  memcpy(KEYOF(e), c->key, c->keylen);
+  if (c->vallen) memcpy(VALOF(e), c->val, c->vallen);
+
+  pe = c->buckets + (e->hash & (c->numbuckets - 1));
+  e->next = *pe;
+  *pe = e;
+  pushnewest(c,e);
+  c->used += size;
+  ++c->numentries;
+}
@@ -0,0 +1,83 @@
+/*
+cache.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "errmsg.h"
+
+#include <stddef.h>
+
+
+typedef struct cache cache;
+
+
+cache *newcache(size_t limit, errmsg_t errmsg);
+
+  /* newcache(limit,errmsg) returns a pointer to a new empty cache,   */
+  /* which maps keys to values (both arrays of characters), using no  */
+  /* more than about limit bytes for them, and forgetting the least   */
+  /* recently used ones to make room for new ones.  Returns NULL on   */
+  /* failure.                                                         */
+
+
+void freecache(cache *c);
+
+  /* freecache(c) frees the memory associated with *c.  c may */
+  /* not be used after this call.                             */
+
+
+void clearcache(cache *c);
+
+  /* clearcache(c) forgets every key and value in *c. */
+
+
+void cachekey(cache *c);
+
+  /* cachekey(c) begins a new key for *c, which is empty until      */
+  /* characters are added to it with cacheadd(), and discards the   */
+  /* lines added to the value for the previous key by cacheline().  */
+
+
+void cacheadd(cache *c, const char *chars, size_t n, errmsg_t errmsg);
+
+  /* cacheadd(c,chars,n,errmsg) adds the n characters starting at */
+  /* chars to the end of the key begun by cachekey().             */
+
+
+const char *cachefind(cache *c, size_t *plen);
+
+  /* cachefind(c,plen) returns a pointer to the value of the key   */
+  /* made by cachekey() and cacheadd(), and sets *plen to its      */
+  /* length, or returns NULL if *c has none.  The value remains    */
+  /* valid until the next call to cachestore(), clearcache(), or   */
+  /* freecache() with c.                                           */
+
+
+void cacheline(cache *c, const char *line, errmsg_t errmsg);
+
+  /* cacheline(c,line,errmsg) adds the string line, with its '\0', */
+  /* to the end of the value being made for the key.               */
+
+
+void cachestore(cache *c, errmsg_t errmsg);
+
+  /* cachestore(c,errmsg) gives the key made by cachekey() and        */
+  /* cacheadd() the value made by cacheline(), which must not already */
+  /* have one, first forgetting the least recently found or stored    */
+  /* keys if need be.  A key and value too large for the limit are    */
+  /* not stored.                                                      */
+
+
+#endif
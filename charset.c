@@ -1,15 +1,23 @@
 /*
 charset.c
-last touched in Par 1.53.0
-last meaningful change in Par 1.53.0
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
 Copyright 1993, 2001, 2020 Adam M. Costello
 
 This is ANSI C code (C89).
 
-Because this is ANSI C code, we can't assume that char has only 8 bits.
-Therefore, we can't use bit vectors to represent sets without the risk
-of consuming large amounts of memory.  Therefore, this code is much more
-complicated than might be expected.
+A set is represented by a bit vector with one bit for every possible
+value of unsigned char, so that testing membership takes one indexed
+load, and union and difference are bitwise operations.  Because this
+is ANSI C code, we can't assume that char has only 8 bits, so the size
+of the vector is derived from UCHAR_MAX and CHAR_BIT.  That is 32
+bytes when char has 8 bits, and 8K bytes when it has 16, but it would
+be absurd on a system with a 32-bit char.
+
+Classes of characters, like "all upper case letters", are resolved
+using the ctype.h functions when the set is parsed, so the current
+locale must be set before any charset is parsed, and changing it
+afterward has no effect on existing sets.
 
 The issues regarding char and unsigned char are relevant to the
 use of the ctype.h functions, and the interpretation of the _xhh
@@ -20,10 +28,10 @@ sequence.  See the comments near the beginning of par.c.
 
 #include "charset.h"  /* Makes sure we're consistent with the prototypes. */
 
-#include "buffer.h"
 #include "errmsg.h"
 
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,27 +45,57 @@ sequence.  See the comments near the beginning of par.c.
 #endif
 
 
-typedef unsigned char csflag_t;
+#define CSBYTES (UCHAR_MAX / CHAR_BIT + 1)
 
 struct charset {
-  char *inlist;    /* Characters in inlist are in the set.                */
-  char *outlist;   /* Characters in outlist are not in the set.           */
-                   /* inlist and outlist must have no common characters.  */
-                   /* inlist and outlist may be NULL, which acts like "". */
-  csflag_t flags;  /* Characters in neither list are in the set if they   */
-                   /* belong to any of the classes indicated by flags.    */
+  unsigned char bits[CSBYTES];  /* Character c is in the set if bit      */
+                                /* uc % CHAR_BIT of bits[uc / CHAR_BIT]  */
+                                /* is set, where uc is c converted to    */
+                                /* unsigned char.                        */
 };
 
+typedef unsigned char csflag_t;
+
 /* The following may be bitwise-OR'd together */
-/* to set the flags field of a charset:       */
+/* to describe classes of characters:         */
 
 static const csflag_t
   CS_UCASE = 1,   /* Includes all upper case letters.   */
   CS_LCASE = 2,   /* Includes all lower case letters.   */
   CS_NCASE = 4,   /* Includes all neither case letters. */
   CS_DIGIT = 8,   /* Includes all decimal digits.       */
-  CS_SPACE = 16,  /* Includes all space characters.     */
-  CS_NUL   = 32;  /* Includes the NUL character.        */
+  CS_SPACE = 16;  /* Includes all space characters.     */
+
+
+static void csinsert(charset *cset, unsigned char uc)
+
+/* Adds uc to *cset. */
+{
+  cset->bits[uc / CHAR_BIT] |= 1U << uc % CHAR_BIT;
+}
+
+
+static int inclasses(unsigned char uc, csflag_t flags)
+
+/* Returns 1 if uc belongs to any of the */
+/* classes indicated by flags, 0 if not. */
+{
+  /* The logic for the CS_?CASE flags is a little convoluted,  */
+  /* but avoids calling islower() or isupper() more than once. */
+
+  if (flags & CS_NCASE) {
+    if ( isalpha(uc) &&
+         (flags & CS_LCASE || !islower(uc)) &&
+         (flags & CS_UCASE || !isupper(uc))    ) return 1;
+  }
+  else {
+    if ( (flags & CS_LCASE && islower(uc)) ||
+         (flags & CS_UCASE && isupper(uc))    ) return 1;
+  }
+
+  return (flags & CS_DIGIT && isdigit(uc)) ||
+         (flags & CS_SPACE && isspace(uc))    ;
+}
 
 
 static int appearsin(char c, const char *str)
@@ -94,9 +132,10 @@ static int hexdigtoint(char c)
 charset *parsecharset(const char *str, errmsg_t errmsg)
 {
   charset *cset = NULL;
-  buffer *cbuf = NULL;
   const char *p, * const singleescapes = "_sbqQx";
   int hex1, hex2;
+  unsigned int i;
+  csflag_t flags = 0;
   char ch;
 
   cset = malloc(sizeof (charset));
@@ -104,11 +143,7 @@ charset *parsecharset(const char *str, errmsg_t errmsg)
     strcpy(errmsg,outofmem);
     goto pcserror;
   }
-  cset->inlist = cset->outlist = NULL;
-  cset->flags = 0;
-
-  cbuf = newbuffer(sizeof (char), errmsg);
-  if (*errmsg) goto pcserror;
+  memset(cset->bits, 0, CSBYTES);
 
   for (p = str;  *p;  ++p)
     if (*p == '_') {
@@ -126,35 +161,24 @@ charset *parsecharset(const char *str, errmsg_t errmsg)
           *(unsigned char *)&ch = 16 * hex1 + hex2;
           p += 2;
         }
-        if (!ch)
-          cset->flags |= CS_NUL;
-        else {
-          additem(cbuf, &ch, errmsg);
-          if (*errmsg) goto pcserror;
-        }
+        csinsert(cset, *(unsigned char *)&ch);
       }
       else {
-        if      (*p == 'A') cset->flags |= CS_UCASE;
-        else if (*p == 'a') cset->flags |= CS_LCASE;
-        else if (*p == '@') cset->flags |= CS_NCASE;
-        else if (*p == '0') cset->flags |= CS_DIGIT;
-        else if (*p == 'S') cset->flags |= CS_SPACE;
+        if      (*p == 'A') flags |= CS_UCASE;
+        else if (*p == 'a') flags |= CS_LCASE;
+        else if (*p == '@') flags |= CS_NCASE;
+        else if (*p == '0') flags |= CS_DIGIT;
+        else if (*p == 'S') flags |= CS_SPACE;
         else goto pcsbadstr;
       }
     }
-    else {
-      additem(cbuf,p,errmsg);
-      if (*errmsg) goto pcserror;
-    }
-  ch = '\0';
-  additem(cbuf, &ch, errmsg);
-  if (*errmsg) goto pcserror;
-  cset->inlist = copyitems(cbuf,errmsg);
-  if (*errmsg) goto pcserror;
+    else csinsert(cset, *(unsigned char *)p);
 
-pcscleanup:
+  if (flags)
+    for (i = 0;  i <= UCHAR_MAX;  ++i)
+      if (inclasses(i,flags)) csinsert(cset,i);
 
-  if (cbuf) freebuffer(cbuf);
+  *errmsg = '\0';
   return cset;
 
 pcsbadstr:
@@ -164,43 +188,21 @@ pcsbadstr:
 pcserror:
 
   if (cset) freecharset(cset);
-  cset = NULL;
-  goto pcscleanup;
+  return NULL;
 }
 
 
 void freecharset(charset *cset)
 {
-  if (cset->inlist) free(cset->inlist);
-  if (cset->outlist) free(cset->outlist);
   free(cset);
 }
 
 
 int csmember(char c, const charset *cset)
 {
-  unsigned char uc;
-
-  if (appearsin(c, cset->inlist )) return 1;
-  if (appearsin(c, cset->outlist)) return 0;
-  uc = *(unsigned char *)&c;
-
-  /* The logic for the CS_?CASE flags is a little convoluted,  */
-  /* but avoids calling islower() or isupper() more than once. */
-
-  if (cset->flags & CS_NCASE) {
-    if ( isalpha(uc) &&
-         (cset->flags & CS_LCASE || !islower(uc)) &&
-         (cset->flags & CS_UCASE || !isupper(uc))    ) return 1;
-  }
-  else {
-    if ( (cset->flags & CS_LCASE && islower(uc)) ||
-         (cset->flags & CS_UCASE && isupper(uc))    ) return 1;
-  }
+  unsigned char uc = *(unsigned char *)&c;
 
-  return (cset->flags & CS_DIGIT && isdigit(uc)) ||
-         (cset->flags & CS_SPACE && isspace(uc)) ||
-         (cset->flags & CS_NUL   && !c         )    ;
+  return cset->bits[uc / CHAR_BIT] >> uc % CHAR_BIT & 1;
 }
 
 
@@ -211,64 +213,20 @@ static charset *csud(
 /* difference cset1 - cset2 if u is 0.  Returns NULL on failure. */
 {
   charset *csu;
-  buffer *inbuf = NULL, *outbuf = NULL;
-  char *lists[4], **list, *p, nullchar = '\0';
+  int i;
 
   csu = malloc(sizeof (charset));
   if (!csu) {
     strcpy(errmsg,outofmem);
-    goto csuderror;
+    return NULL;
   }
-  inbuf = newbuffer(sizeof (char), errmsg);
-  if (*errmsg) goto csuderror;
-  outbuf = newbuffer(sizeof (char), errmsg);
-  if (*errmsg) goto csuderror;
-  csu->inlist = csu->outlist = NULL;
-  csu->flags =  u  ?  cset1->flags |  cset2->flags
-                   :  cset1->flags & ~cset2->flags;
-
-  lists[0] = cset1->inlist;
-  lists[1] = cset1->outlist;
-  lists[2] = cset2->inlist;
-  lists[3] = cset2->outlist;
-
-  for (list = lists;  list < lists + 4;  ++list)
-    if (*list) {
-      for (p = *list;  *p;  ++p)
-        if (u  ?  csmember(*p, cset1) ||  csmember(*p, cset2)
-               :  csmember(*p, cset1) && !csmember(*p, cset2)) {
-          if (!csmember(*p, csu)) {
-            additem(inbuf,p,errmsg);
-            if (*errmsg) goto csuderror;
-          }
-        }
-        else
-          if (csmember(*p, csu)) {
-            additem(outbuf,p,errmsg);
-            if (*errmsg) goto csuderror;
-          }
-    }
 
-  additem(inbuf, &nullchar, errmsg);
-  if (*errmsg) goto csuderror;
-  additem(outbuf, &nullchar, errmsg);
-  if (*errmsg) goto csuderror;
-  csu->inlist = copyitems(inbuf,errmsg);
-  if (*errmsg) goto csuderror;
-  csu->outlist = copyitems(outbuf,errmsg);
-  if (*errmsg) goto csuderror;
+  for (i = 0;  i < CSBYTES;  ++i)
+    csu->bits[i] =  u  ?  cset1->bits[i] |  cset2->bits[i]
+                       :  cset1->bits[i] & ~cset2->bits[i];
 
-csudcleanup:
-
-  if (inbuf) freebuffer(inbuf);
-  if (outbuf) freebuffer(outbuf);
+  *errmsg = '\0';
   return csu;
-
-csuderror:
-
-  if (csu) freecharset(csu);
-  csu = NULL;
-  goto csudcleanup;
 }
 
 
@@ -286,31 +244,35 @@ charset *csdiff(const charset *cset1, const charset *cset2, errmsg_t errmsg)
 
 void csadd(charset *cset1, const charset *cset2, errmsg_t errmsg)
 {
-  charset *csu;
+  int i;
 
-  csu = csunion(cset1,cset2,errmsg);
-  if (*errmsg) return;
-  csswap(csu,cset1);
-  freecharset(csu);
+  *errmsg = '\0';
+  for (i = 0;  i < CSBYTES;  ++i) cset1->bits[i] |= cset2->bits[i];
 }
 
 
 void csremove(charset *cset1, const charset *cset2, errmsg_t errmsg)
 {
-  charset *csu;
+  int i;
 
-  csu = csdiff(cset1,cset2,errmsg);
-  if (*errmsg) return;
-  csswap(csu,cset1);
-  freecharset(csu);
+  *errmsg = '\0';
+  for (i = 0;  i < CSBYTES;  ++i) cset1->bits[i] &= ~cset2->bits[i];
 }
 
 
 charset *cscopy(const charset *cset, errmsg_t errmsg)
 {
-  charset emptycharset = { NULL, NULL, 0 };
+  charset *csc;
+
+  csc = malloc(sizeof (charset));
+  if (!csc) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  *csc = *cset;
 
-  return csunion(cset, &emptycharset, errmsg);
+  *errmsg = '\0';
+  return csc;
 }
 
 
@@ -0,0 +1,513 @@
+/*
+diskcache.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89), except that if PAR_POSIX is defined it also
+uses POSIX files, mmap(), and record locks, and if PAR_THREADS is
+defined, POSIX threads.
+
+The cache is kept in NUMSHARDS files, called shard00 through shard15,
+the one for each key being chosen by its hash, so that writers of
+different keys seldom wait for each other.  Each file has a fixed
+size, and is mapped into memory for reading.  It begins with a
+header, followed by a table of slots, each holding the hash of a key,
+where its record is, and on which lap of the data area it was written.
+The rest of the file is the data area, in which records (a header, the
+key, and the value) are written one after another, going back to the
+beginning when the end is reached, over the oldest ones.  A key's slot
+is one of the PROBES slots following the one its hash picks, so the
+oldest records are also forgotten when those are all taken.
+
+A writer locks the whole file, and a mutex shared with the other
+threads of the same process, and writes the record, then its slot,
+then the header.  A reader takes only the mutex, so another process
+may be overwriting a record while it is read.  The reader therefore
+copies the record before using it, and uses it only if the key matches
+and the checksum of the whole record (the FNV-1a hash of its header,
+key, and value) matches the one stored in it.  The same check catches
+records left half written by a process that died, and records damaged
+any other way, so a bad entry is never more than a miss.
+
+All the numbers in the files are 4 bytes, most significant first, so
+they mean the same whatever the size and byte order of an unsigned
+long.
+
+*/
+
+
+#include "diskcache.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+#ifdef PAR_THREADS
+#include <pthread.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#ifdef PAR_POSIX
+
+#define NUMSHARDS 16
+#define MINSHARD 65536  /* The smallest size of a file.                */
+#define MINSLOTS 64     /* The fewest slots in a file.                 */
+#define PROBES 8        /* The slots a key may be in.                  */
+#define FNVBASIS 2166136261UL
+
+/* The layout of the files (all sizes and offsets in bytes): */
+
+#define HEADSIZE 32     /* The header:                                 */
+#define H_SIZE 8        /*   after the 8-byte magic, the file size,    */
+#define H_NUMSLOTS 12   /*   the number of slots,                      */
+#define H_DATAEND 16    /*   where the next record goes,               */
+#define H_LAP 20        /*   and the lap it is on.                     */
+#define SLOTSIZE 12     /* A slot: the hash, the lap, and the offset   */
+                        /* of the record, which is 0 if it is unused.  */
+#define RECSIZE 16      /* The header of a record: the hash, the key   */
+                        /* length, the value length, and the checksum. */
+
+static const char magic[8] = { 'p', 'a', 'r', 'c', 'a', 'c', 'h', '1' };
+
+typedef struct shard {
+  int fd;                  /* The file, or -1.                         */
+  const unsigned char *map;/* The file mapped into memory, or NULL.    */
+  unsigned long size,      /* The size of the file.                    */
+                numslots;  /* The number of slots, a power of 2.       */
+#ifdef PAR_THREADS
+  pthread_mutex_t lock;    /* Taken by every thread using the shard.   */
+#endif
+} shard;
+
+struct diskcache {
+  shard shards[NUMSHARDS];
+};
+
+#define DATASTART(sh) (HEADSIZE + SLOTSIZE * (sh)->numslots)
+
+#ifdef PAR_THREADS
+#define lockthreads(sh) pthread_mutex_lock(&(sh)->lock)
+#define unlockthreads(sh) pthread_mutex_unlock(&(sh)->lock)
+#else
+#define lockthreads(sh)
+#define unlockthreads(sh)
+#endif
+
+
+static unsigned long getword(const unsigned char *p)
+
+/* Returns the number stored at p. */
+{
+  return   (unsigned long) p[0] << 24 | (unsigned long) p[1] << 16
+         | (unsigned long) p[2] << 8  | (unsigned long) p[3];
+}
+
+
+static void putword(unsigned char *p, unsigned long w)
+
+/* Stores the number w at p. */
+{
+  p[0] = w >> 24 & 0xff, p[1] = w >> 16 & 0xff;
+  p[2] = w >> 8 & 0xff,  p[3] = w & 0xff;
+}
+
+
+static unsigned long fnv(unsigned long h, const void *chars, size_t n)
+
+/* Returns the FNV-1a hash of the n characters at chars, continuing */
+/* from the hash h of those before them (FNVBASIS if none).         */
+{
+  const unsigned char *p = chars, *end = p + n;
+
+  for ( ;  p < end;  ++p) h = ((h ^ *p) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+
+static unsigned long slotsfor(unsigned long size)
+
+/* Returns the number of slots in a file of size bytes. */
+{
+  unsigned long n;
+
+  for (n = MINSLOTS;  n * 2 <= size / 256;  n *= 2);
+  return n;
+}
+
+
+static int lockfile(int fd, int type)
+
+/* Sets a lock of the given type (F_WRLCK or F_UNLCK) on the whole of */
+/* file fd, waiting for any other process's lock to go.  Returns 1,   */
+/* or 0 on failure.                                                   */
+{
+  struct flock fl;
+
+  fl.l_type = type;
+  fl.l_whence = SEEK_SET;
+  fl.l_start = 0;
+  fl.l_len = 0;
+  while (fcntl(fd, F_SETLKW, &fl) < 0)
+    if (errno != EINTR) return 0;
+
+  return 1;
+}
+
+
+static int writeat(int fd, const void *chars, size_t n, unsigned long off)
+
+/* Writes the n characters at chars at offset off in file fd. */
+/* Returns 1, or 0 on failure.                                */
+{
+  const char *p = chars;
+  ssize_t r;
+
+  while (n > 0) {
+    r = pwrite(fd, p, n, off);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return 0;
+    p += r, n -= r, off += r;
+  }
+
+  return 1;
+}
+
+
+static int readheader(const shard *sh, unsigned char *head)
+
+/* Reads the header of *sh into head, which has room for HEADSIZE */
+/* characters.  Returns 1 if it is valid, or 0 if not.            */
+{
+  unsigned long end;
+
+  if (pread(sh->fd, head, HEADSIZE, 0) != HEADSIZE) return 0;
+  if (   memcmp(head, magic, sizeof magic)
+      || getword(head + H_SIZE) != sh->size
+      || getword(head + H_NUMSLOTS) != sh->numslots) return 0;
+  end = getword(head + H_DATAEND);
+
+  return end >= DATASTART(sh) && end <= sh->size;
+}
+
+
+static int initshard(const shard *sh)
+
+/* Writes an empty header and slot table to *sh, which must be */
+/* locked.  Returns 1, or 0 on failure.                        */
+{
+  unsigned char *start;
+  int ok;
+
+  start = calloc(DATASTART(sh), 1);
+  if (!start) return 0;
+  memcpy(start, magic, sizeof magic);
+  putword(start + H_SIZE, sh->size);
+  putword(start + H_NUMSLOTS, sh->numslots);
+  putword(start + H_DATAEND, DATASTART(sh));
+  ok = writeat(sh->fd, start, DATASTART(sh), 0);
+  free(start);
+
+  return ok;
+}
+
+
+static void openshard(
+  shard *sh, const char *path, unsigned long size, errmsg_t errmsg
+)
+/* Opens the file path for *sh, first making it size bytes if it is */
+/* too small, and making it empty if its header is not valid.       */
+{
+  struct stat st;
+  unsigned char head[HEADSIZE];
+  void *map;
+  int locked = 0;
+
+  sh->fd = open(path, O_RDWR | O_CREAT, 0666);
+  if (sh->fd < 0) goto oscantopen;
+  if (!lockfile(sh->fd, F_WRLCK)) goto oscantopen;
+  locked = 1;
+
+  if (fstat(sh->fd, &st) < 0) goto oscantopen;
+  if (st.st_size < MINSHARD) {
+    if (ftruncate(sh->fd, size) < 0) goto oscantopen;
+    st.st_size = size;
+  }
+  sh->size = st.st_size;
+  if (   (off_t) sh->size != st.st_size || sh->size > 0xffffffffUL
+      || (unsigned long) (size_t) sh->size != sh->size) goto oscantopen;
+  sh->numslots = slotsfor(sh->size);
+
+  if (!readheader(sh,head) && !initshard(sh)) goto oscantopen;
+
+  map = mmap(NULL, sh->size, PROT_READ, MAP_SHARED, sh->fd, 0);
+  if (map == MAP_FAILED) goto oscantopen;
+  sh->map = map;
+
+  lockfile(sh->fd, F_UNLCK);
+  *errmsg = '\0';
+  return;
+
+oscantopen:
+
+  if (locked) lockfile(sh->fd, F_UNLCK);
+  sprintf(errmsg, "Cannot open cache file %.*s\n", errmsg_size - 25, path);
+}
+
+#endif
+
+
+diskcache *opendiskcache(const char *dir, int mb, errmsg_t errmsg)
+{
+#ifdef PAR_POSIX
+  diskcache *dc;
+  char *path;
+  int i;
+
+  dc = malloc(sizeof (diskcache));
+  path = malloc(strlen(dir) + 9);
+  if (!dc || !path) {
+    strcpy(errmsg,outofmem);
+    if (dc) free(dc);
+    if (path) free(path);
+    return NULL;
+  }
+  for (i = 0;  i < NUMSHARDS;  ++i) {
+    dc->shards[i].fd = -1;
+    dc->shards[i].map = NULL;
+#ifdef PAR_THREADS
+    pthread_mutex_init(&dc->shards[i].lock, NULL);
+#endif
+  }
+
+  if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+    sprintf(errmsg, "Cannot make directory %.*s\n", errmsg_size - 24, dir);
+    goto odcleanup;
+  }
+
+  for (i = 0;  i < NUMSHARDS;  ++i) {
+    sprintf(path, "%s/shard%02d", dir, i);
+    openshard(dc->shards + i, path, mb * 65536UL, errmsg);
+    if (*errmsg) goto odcleanup;
+  }
+
+  free(path);
+  return dc;
+
+odcleanup:
+
+  free(path);
+  closediskcache(dc);
+  return NULL;
+#else
+  (void) mb;
+  sprintf(errmsg, "Cannot use cache directory %.*s without PAR_POSIX.\n",
+          errmsg_size - 48, dir);
+  return NULL;
+#endif
+}
+
+
+void closediskcache(diskcache *dc)
+{
+#ifdef PAR_POSIX
+  shard *sh;
+
+  for (sh = dc->shards;  sh < dc->shards + NUMSHARDS;  ++sh) {
+    if (sh->map) munmap((void *) sh->map, sh->size);
+    if (sh->fd >= 0) close(sh->fd);
+#ifdef PAR_THREADS
+    pthread_mutex_destroy(&sh->lock);
+#endif
+  }
+  free(dc);
+#else
+  (void) dc;
+#endif
+}
+
+
+const char *diskfind(
+  diskcache *dc, const char *key, size_t keylen, char **pbuf,
+  size_t *psize, size_t *plen, errmsg_t errmsg
+)
+{
+#ifdef PAR_POSIX
+  unsigned long h, i, off, vallen, room;
+  shard *sh;
+  const unsigned char *slot;
+  unsigned char head[RECSIZE];
+  const char *val = NULL;
+  char *p;
+
+  *errmsg = '\0';
+
+  h = fnv(FNVBASIS, key, keylen);
+  sh = dc->shards + h % NUMSHARDS;
+
+  lockthreads(sh);
+
+  for (i = 0;  i < PROBES;  ++i) {
+    slot = sh->map + HEADSIZE
+           + SLOTSIZE * ((h / NUMSHARDS + i) & (sh->numslots - 1));
+    off = getword(slot + 8);
+    if (!off) break;
+    if (   getword(slot) != h || off < DATASTART(sh)
+        || off > sh->size - RECSIZE) continue;
+
+    memcpy(head, sh->map + off, RECSIZE);
+    vallen = getword(head + 8);
+    room = sh->size - off - RECSIZE;
+    if (   getword(head) != h || getword(head + 4) != keylen
+        || keylen > room || vallen > room - keylen) continue;
+
+    if (keylen + vallen > *psize) {
+      p = realloc(*pbuf, keylen + vallen);
+      if (!p) {
+        strcpy(errmsg,outofmem);
+        break;
+      }
+      *pbuf = p;
+      *psize = keylen + vallen;
+    }
+    memcpy(*pbuf, sh->map + off + RECSIZE, keylen + vallen);
+    if (   !memcmp(*pbuf, key, keylen)
+        && fnv(fnv(FNVBASIS, head, 12), *pbuf, keylen + vallen)
+             == getword(head + 12)) {
+      val = *pbuf + keylen;
+      *plen = vallen;
+      break;
+    }
+  }
+
+  unlockthreads(sh);
+  return val;
+#else
+  (void) dc;
+  (void) key;
+  (void) keylen;
+  (void) pbuf;
+  (void) psize;
+  (void) plen;
+  *errmsg = '\0';
+  return NULL;
+#endif
+}
+
+
+void diskstore(
+  diskcache *dc, const char *key, size_t keylen, const char *val,
+  size_t vallen
+)
+{
+#ifdef PAR_POSIX
+  unsigned long h, i, k, best, age, oldest, start, end, lap, off, slap,
+                reclen;
+  shard *sh;
+  const unsigned char *s;
+  unsigned char head[HEADSIZE], rec[RECSIZE], slot[SLOTSIZE];
+  int locked = 0;
+
+  h = fnv(FNVBASIS, key, keylen);
+  sh = dc->shards + h % NUMSHARDS;
+  start = DATASTART(sh);
+
+  /* A record may take up no more than a quarter of the data area, */
+  /* so that one value cannot push out everything else:            */
+
+  reclen = (sh->size - start) / 4;
+  if (keylen > reclen || vallen > reclen - keylen
+                      || RECSIZE > reclen - keylen - vallen) return;
+  reclen = RECSIZE + keylen + vallen;
+
+  lockthreads(sh);
+  if (!lockfile(sh->fd, F_WRLCK)) goto dsunlock;
+  locked = 1;
+
+  if (!readheader(sh,head)) {
+    if (!initshard(sh)) goto dsunlock;
+    putword(head + H_DATAEND, start);
+    putword(head + H_LAP, 0);
+  }
+  end = getword(head + H_DATAEND);
+  lap = getword(head + H_LAP);
+  if (reclen > sh->size - end) {
+    end = start;
+    lap = (lap + 1) & 0xffffffffUL;
+  }
+
+  /* Use the slot already holding the hash, or else an unused one,  */
+  /* or else the one whose record is oldest (or will be overwritten */
+  /* by this one):                                                  */
+
+  best = h / NUMSHARDS & (sh->numslots - 1);
+  oldest = 0;
+  for (i = 0;  i < PROBES;  ++i) {
+    k = (h / NUMSHARDS + i) & (sh->numslots - 1);
+    s = sh->map + HEADSIZE + SLOTSIZE * k;
+    off = getword(s + 8);
+    if (!off || getword(s) == h) {
+      best = k;
+      break;
+    }
+    slap = getword(s + 4);
+    if (slap == lap && off < end)
+      age = end - off;
+    else if (slap == ((lap - 1) & 0xffffffffUL) && off >= end + reclen)
+      age = end - start + sh->size - off;
+    else
+      age = 0xffffffffUL;
+    if (age > oldest) {
+      best = k;
+      oldest = age;
+    }
+  }
+
+  putword(rec, h);
+  putword(rec + 4, keylen);
+  putword(rec + 8, vallen);
+  putword(rec + 12, fnv(fnv(fnv(FNVBASIS, rec, 12), key, keylen),
+                        val, vallen));
+  putword(slot, h);
+  putword(slot + 4, lap);
+  putword(slot + 8, end);
+  putword(head + H_DATAEND, end + reclen);
+  putword(head + H_LAP, lap);
+
+  if (   writeat(sh->fd, rec, RECSIZE, end)
+      && writeat(sh->fd, key, keylen, end + RECSIZE)
+      && writeat(sh->fd, val, vallen, end + RECSIZE + keylen)
+      && writeat(sh->fd, slot, SLOTSIZE, HEADSIZE + SLOTSIZE * best))
+    writeat(sh->fd, head + H_DATAEND, 8, H_DATAEND);
+
+dsunlock:
+
+  if (locked) lockfile(sh->fd, F_UNLCK);
+  unlockthreads(sh);
+#else
+  (void) dc;
+  (void) key;
+  (void) keylen;
+  (void) val;
+  (void) vallen;
+#endif
+}
@@ -0,0 +1,69 @@
+/*
+diskcache.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include "errmsg.h"
+
+#include <stddef.h>
+
+
+typedef struct diskcache diskcache;
+
+
+diskcache *opendiskcache(const char *dir, int mb, errmsg_t errmsg);
+
+  /* opendiskcache(dir,mb,errmsg) returns a pointer to a new diskcache */
+  /* for the files in the directory dir, which is made if it does not  */
+  /* exist, along with any of the files it needs that do not exist,    */
+  /* in which case they are made to hold about mb megabytes in all.    */
+  /* Files that already exist keep their size.  mb must be between 1   */
+  /* and 9999.  Other processes may use the same directory at the same */
+  /* time.  Returns NULL on failure, which always happens if par was   */
+  /* compiled without PAR_POSIX.                                       */
+
+
+void closediskcache(diskcache *dc);
+
+  /* closediskcache(dc) frees the memory associated with *dc, leaving */
+  /* its files as they are.  dc may not be used after this call.      */
+
+
+const char *diskfind(
+  diskcache *dc, const char *key, size_t keylen, char **pbuf,
+  size_t *psize, size_t *plen, errmsg_t errmsg
+);
+  /* diskfind(dc,key,keylen,pbuf,psize,plen,errmsg) looks in *dc for   */
+  /* the value stored for the keylen characters at key.  If there is   */
+  /* one, and it is intact, it is copied into *pbuf, which has room    */
+  /* for *psize characters (*pbuf may be NULL if *psize is 0) and is   */
+  /* enlarged with realloc() if need be, and a pointer to it there is  */
+  /* returned, with its length in *plen.  Otherwise, or on failure,    */
+  /* returns NULL.  dc may be used by several threads at once.         */
+
+
+void diskstore(
+  diskcache *dc, const char *key, size_t keylen, const char *val,
+  size_t vallen
+);
+  /* diskstore(dc,key,keylen,val,vallen) stores the vallen characters */
+  /* at val in *dc as the value for the keylen characters at key,     */
+  /* first forgetting the oldest values if need be to make room.      */
+  /* Values too large for the room there are not stored, and neither  */
+  /* is anything if the files cannot be locked.  dc may be used by    */
+  /* several threads at once.                                         */
+
+
+#endif
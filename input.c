@@ -0,0 +1,354 @@
+/*
+input.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Reading one character at a time with getchar() costs a function call
+(and, on many systems, a lock) per character.  An input instead reads
+large blocks with fread() and lets the caller scan them directly, so
+that runs of ordinary characters can be found with memchr() and
+copied in one step.
+
+When compiled with PAR_POSIX defined, blocks are read with read(),
+which returns whatever is available rather than waiting for a whole
+block, so that interactive use does not stall, and a regular file
+named by openinput() is mapped into memory with mmap() instead.  The
+mapping is private and writable, so callers may terminate lines in
+place and keep pointers into it rather than copying each line.  Each
+page written to that way becomes a private copy, so callers give back
+the pages they have finished with (see inrelease()), and the memory
+used stays proportional to what is in flight rather than to the size
+of the file.
+
+An input can be repositioned, and made to seem to end early, so that
+par can reformat one region of a large file and copy the rest.  A
+mapped or in-memory input is repositioned by moving an index, and a
+stream by seeking its file and discarding the block.
+
+*/
+
+
+#include "input.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#define BLOCKSIZE 65536
+
+struct input {
+  FILE *stream;  /* The stream being read, or NULL if mapped. */
+  char *block;   /* Storage for one block of characters, or   */
+                 /* the whole file if mapped.                 */
+  size_t next,   /* Index of the first unconsumed char.       */
+         end;    /* Number of characters in *block.           */
+  unsigned long
+    before,      /* Number consumed before *block was filled. */
+    limit,       /* The count at which the input seems to end */
+                 /* (see inlimit()).                          */
+    size,        /* The size of the file, and the time it was */
+    mtime,       /* last modified, when it was opened.        */
+    released,    /* The characters of a mapping before this   */
+                 /* have been given back (see inrelease()).   */
+    pagesize;    /* The size of a page of a mapping.          */
+  int eof,       /* Set once the stream has been exhausted.   */
+      owned,     /* Set if stream was opened by openinput().  */
+      mapped,    /* Set if *block is a memory mapping.        */
+      borrowed,  /* Set if *block belongs to the caller of    */
+                 /* newmeminput().                            */
+      known;     /* Set if size and mtime are known.          */
+};
+
+
+input *newinput(FILE *stream, errmsg_t errmsg)
+{
+  input *in;
+  char *block;
+
+  in = malloc(sizeof (input));
+  block = malloc(BLOCKSIZE);
+  if (!in || !block) {
+    strcpy(errmsg,outofmem);
+    if (in) free(in);
+    if (block) free(block);
+    return NULL;
+  }
+
+  in->stream = stream;
+  in->block = block;
+  in->next = in->end = 0;
+  in->before = in->released = in->pagesize = 0;
+  in->limit = (unsigned long) -1;
+  in->eof = in->owned = in->mapped = in->borrowed = in->known = 0;
+
+  *errmsg = '\0';
+  return in;
+}
+
+
+input *newmeminput(const char *chars, size_t n, errmsg_t errmsg)
+{
+  input *in;
+
+  in = malloc(sizeof (input));
+  if (!in) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+
+  in->stream = NULL;
+  in->block = (char *) chars;
+  in->next = 0;
+  in->end = n;
+  in->before = in->released = in->pagesize = 0;
+  in->limit = (unsigned long) -1;
+  in->eof = in->borrowed = 1;
+  in->owned = in->mapped = in->known = 0;
+
+  *errmsg = '\0';
+  return in;
+
+  /* The characters are never modified, because only mapped   */
+  /* inputs let the caller modify what inspan() returns.      */
+}
+
+
+void resetmeminput(input *in, const char *chars, size_t n)
+{
+  in->before += in->next;
+  in->block = (char *) chars;
+  in->next = 0;
+  in->end = n;
+}
+
+
+input *openinput(const char *path, errmsg_t errmsg)
+{
+  input *in;
+  FILE *stream;
+#ifdef PAR_POSIX
+  int fd, known;
+  struct stat st;
+  void *map;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) goto oicantopen;
+  known = fstat(fd,&st) == 0 && S_ISREG(st.st_mode);
+  if (known && st.st_size > 0 && (off_t) (size_t) st.st_size == st.st_size) {
+    map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+      close(fd);
+      in = malloc(sizeof (input));
+      if (!in) {
+        strcpy(errmsg,outofmem);
+        munmap(map, st.st_size);
+        return NULL;
+      }
+#ifdef MADV_SEQUENTIAL
+      madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif
+      in->stream = NULL;
+      in->block = map;
+      in->next = 0;
+      in->end = st.st_size;
+      in->before = in->released = 0;
+      in->pagesize = sysconf(_SC_PAGESIZE);
+      in->limit = (unsigned long) -1;
+      in->size = st.st_size;
+      in->mtime = st.st_mtime;
+      in->eof = in->mapped = in->known = 1;
+      in->owned = in->borrowed = 0;
+      *errmsg = '\0';
+      return in;
+    }
+  }
+  stream = fdopen(fd, "r");
+  if (!stream) {
+    close(fd);
+    goto oicantopen;
+  }
+#else
+  stream = fopen(path, "r");
+  if (!stream) goto oicantopen;
+#endif
+
+  in = newinput(stream,errmsg);
+  if (*errmsg) {
+    fclose(stream);
+    return NULL;
+  }
+  in->owned = 1;
+#ifdef PAR_POSIX
+  if (known) {
+    in->size = st.st_size;
+    in->mtime = st.st_mtime;
+    in->known = 1;
+  }
+#endif
+  return in;
+
+oicantopen:
+
+  sprintf(errmsg, "Cannot open %.*s\n", errmsg_size - 14, path);
+  return NULL;
+}
+
+
+void freeinput(input *in)
+{
+#ifdef PAR_POSIX
+  if (in->mapped) munmap(in->block, in->end);
+  else
+#endif
+  if (!in->borrowed) free(in->block);
+  if (in->owned) fclose(in->stream);
+  free(in);
+}
+
+
+const char *inspan(input *in, size_t *plen)
+{
+  unsigned long left;
+#ifdef PAR_POSIX
+  ssize_t r;
+#endif
+
+  left =  in->limit > in->before + in->next
+            ?  in->limit - (in->before + in->next)  :  0;
+
+  if (in->next >= in->end && !in->eof && left) {
+    in->before += in->next;
+    in->next = 0;
+#ifdef PAR_POSIX
+    do r = read(fileno(in->stream), in->block, BLOCKSIZE);
+    while (r < 0 && errno == EINTR);
+    in->end =  r > 0  ?  r  :  0;
+    if (r <= 0) in->eof = 1;
+#else
+    in->end = fread(in->block, 1, BLOCKSIZE, in->stream);
+    if (in->end < BLOCKSIZE) in->eof = 1;
+#endif
+  }
+
+  *plen = in->end - in->next;
+  if (*plen > left) *plen = left;
+  return in->block + in->next;
+}
+
+
+void inskip(input *in, size_t n)
+{
+  in->next += n;
+}
+
+
+unsigned long incount(const input *in)
+{
+  return in->before + in->next;
+}
+
+
+int inready(const input *in)
+{
+  return in->next < in->end || in->eof || in->before + in->next >= in->limit;
+}
+
+
+int inretains(const input *in)
+{
+  return in->mapped;
+}
+
+
+void inrelease(input *in, unsigned long count)
+{
+  unsigned long from = in->released;
+
+  if (!in->mapped || count <= from) return;
+#if defined(PAR_POSIX) && defined(MADV_DONTNEED)
+  count -= count % in->pagesize;
+  if (count > from) {
+    madvise(in->block + from, count - from, MADV_DONTNEED);
+    in->released = count;
+  }
+#endif
+}
+
+
+int inholds(const input *in, const char *p)
+{
+  return in->mapped && p >= in->block && p < in->block + in->end;
+
+  /* Comparing pointers into different objects is not strictly */
+  /* portable, but only mapped inputs ever get this far.       */
+}
+
+
+int inpeek(input *in)
+{
+  const char *p;
+  size_t n;
+
+  p = inspan(in,&n);
+  return  n  ?  *(const unsigned char *)p  :  EOF;
+}
+
+
+int inseek(input *in, unsigned long count)
+{
+  if (!in->stream) {
+    if (count < in->before || count - in->before > in->end) return 0;
+    in->next = count - in->before;
+    return 1;
+  }
+
+#ifdef PAR_POSIX
+  if (lseek(fileno(in->stream), (off_t) count, SEEK_SET) != (off_t) count)
+    return 0;
+#else
+  if (count > LONG_MAX || fseek(in->stream, (long) count, SEEK_SET) != 0)
+    return 0;
+#endif
+  in->before = count;
+  in->next = in->end = 0;
+  in->eof = 0;
+  return 1;
+}
+
+
+void inlimit(input *in, unsigned long count)
+{
+  in->limit = count;
+}
+
+
+int inidentify(const input *in, unsigned long *psize, unsigned long *ptime)
+{
+  if (!in->known) return 0;
+  *psize = in->size;
+  *ptime = in->mtime;
+  return 1;
+}
@@ -0,0 +1,158 @@
+/*
+input.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+
+typedef struct input input;
+
+
+input *newinput(FILE *stream, errmsg_t errmsg);
+
+  /* newinput(stream,errmsg) returns a pointer to a new input which */
+  /* reads characters from *stream in large blocks.  Characters     */
+  /* must not be read from *stream by any other means while the     */
+  /* input is in use.  Returns NULL on failure.                     */
+
+
+input *newmeminput(const char *chars, size_t n, errmsg_t errmsg);
+
+  /* newmeminput(chars,n,errmsg) returns a pointer to a new input    */
+  /* which reads the n characters starting at chars, which must      */
+  /* remain valid, and are not copied or modified, until the input   */
+  /* is freed.  Returns NULL on failure.                             */
+
+
+void resetmeminput(input *in, const char *chars, size_t n);
+
+  /* resetmeminput(in,chars,n) makes the input *in, which must have  */
+  /* been returned by newmeminput(), read the n characters starting  */
+  /* at chars from the beginning, as if newly made for them, so that */
+  /* one input can serve for many pieces of text.                    */
+
+
+input *openinput(const char *path, errmsg_t errmsg);
+
+  /* openinput(path,errmsg) returns a pointer to a new input which */
+  /* reads the file named by path.  If PAR_POSIX is defined and    */
+  /* the file is a non-empty regular file, it is mapped into       */
+  /* memory and presented as a single span.  Returns NULL on       */
+  /* failure.                                                      */
+
+
+void freeinput(input *in);
+
+  /* freeinput(in) frees the memory associated with *in.  Any  */
+  /* characters still buffered are lost.  in may not be used   */
+  /* after this call.  A stream passed to newinput() is not    */
+  /* closed, but one opened by openinput() is, and characters  */
+  /* passed to newmeminput() are not freed.                    */
+
+
+const char *inspan(input *in, size_t *plen);
+
+  /* inspan(in,plen) returns a pointer to the characters which   */
+  /* have been read from the underlying stream but not yet       */
+  /* consumed, and sets *plen to their number, reading another   */
+  /* block first if none are pending.  *plen is set to 0 at end  */
+  /* of input.  The characters remain valid until the next call  */
+  /* to inspan(), inpeek(), or inskip() with the same input.     */
+
+
+void inskip(input *in, size_t n);
+
+  /* inskip(in,n) consumes the first n characters returned */
+  /* by the most recent call to inspan().  n must not      */
+  /* exceed the length reported by that call.              */
+
+
+int inpeek(input *in);
+
+  /* inpeek(in) returns the next unconsumed character, as an */
+  /* unsigned char converted to an int, without consuming    */
+  /* it, or EOF if there are no more characters.             */
+
+
+unsigned long incount(const input *in);
+
+  /* incount(in) returns the number of characters consumed from *in */
+  /* so far, including any consumed before resetmeminput().         */
+
+
+int inready(const input *in);
+
+  /* inready(in) returns 1 if the next call to inspan() will not   */
+  /* have to wait for more characters to be read, either because   */
+  /* some are pending or because the end of input has been seen,   */
+  /* or 0 if it might.                                             */
+
+
+int inretains(const input *in);
+
+  /* inretains(in) returns 1 if the characters returned by inspan()  */
+  /* remain valid, and may be modified by the caller, until *in is   */
+  /* freed or they are given back by inrelease(), or 0 if they are   */
+  /* valid only as described for inspan().                           */
+
+
+void inrelease(input *in, unsigned long count);
+
+  /* inrelease(in,count) tells *in that the caller is finished with */
+  /* the characters before the one that was next when incount(in)   */
+  /* was count, so that if inretains(in) is 1, the memory holding   */
+  /* them may be given back, along with any changes made to them.   */
+  /* Neither they nor pointers into them may be used afterward.     */
+
+
+int inholds(const input *in, const char *p);
+
+  /* inholds(in,p) returns 1 if p points into characters that  */
+  /* inretains() has promised to keep, or 0 otherwise.  Such   */
+  /* characters belong to *in and must not be freed.           */
+
+
+int inseek(input *in, unsigned long count);
+
+  /* inseek(in,count) makes the next character of *in the one that was  */
+  /* (or will be) next when incount(in) is count, discarding anything   */
+  /* pending, and returns 1, or returns 0, leaving *in as it was, if    */
+  /* that cannot be done.  An input made by newmeminput() can be moved  */
+  /* anywhere within its characters, and a mapped one anywhere within   */
+  /* its file.  Other inputs are moved by seeking their stream, which   */
+  /* must have begun at the beginning of a file that can be sought.     */
+
+
+void inlimit(input *in, unsigned long count);
+
+  /* inlimit(in,count) makes *in seem to end when incount(in) reaches */
+  /* count, until inlimit() is called again.  A count of              */
+  /* (unsigned long) -1 (the initial limit) means no limit.           */
+
+
+int inidentify(const input *in, unsigned long *psize, unsigned long *ptime);
+
+  /* inidentify(in,psize,ptime) sets *psize and *ptime to the size of */
+  /* the file read by *in and the time in seconds it was last         */
+  /* modified, as they were when it was opened, and returns 1, if     */
+  /* *in was made by openinput() for a regular file and PAR_POSIX is  */
+  /* defined, or returns 0 otherwise.                                 */
+
+
+#endif
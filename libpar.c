@@ -0,0 +1,2842 @@
+/*
+libpar.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 1993, 1996, 2001, 2020 Adam M. Costello
+
+This is ANSI C code (C89).
+
+This is everything par does between reading its command line and
+exiting, kept apart from main() so that other programs can do the same
+through the functions declared in libpar.h.  Nothing here is static
+or global except constants, and the ctype.h functions are called only
+while options are being set, so separate parctxs can be used by
+separate threads at once, even while the locale is being changed.
+
+The issues regarding char and unsigned char are relevant to the use of
+the ctype.h functions.  See the comments near the beginning of par.c.
+
+*/
+
+
+#include "libpar.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "arena.h"
+#include "buffer.h"
+#include "cache.h"
+#include "charset.h"
+#include "diskcache.h"
+#include "errmsg.h"
+#include "input.h"
+#include "memscan.h"
+#include "output.h"
+#include "pool.h"
+#include "reformat.h"
+#include "stats.h"
+#include "utf8.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+/* Structure for recording properties of lines within segments: */
+
+typedef unsigned char lflag_t;
+
+typedef struct lineprop {
+  short p, s;     /* Length of the prefix and suffix of a bodiless */
+                  /* line, or the fallback prelen and suflen       */
+                  /* of the IP containing a non-bodiless line.     */
+  lflag_t flags;  /* Boolean properties (see below).               */
+  char rc;        /* The repeated character of a bodiless line.    */
+} lineprop;
+
+/* Flags for marking boolean properties: */
+
+static const lflag_t L_BODILESS = 1,  /* Bodiless line.             */
+                     L_INSERTED = 2,  /* Inserted by quote.         */
+                     L_FIRST    = 4,  /* First line of a paragraph. */
+                     L_SUPERF   = 8;  /* Superfluous line.          */
+
+#define isbodiless(prop) ( (prop)->flags & 1)
+#define isinserted(prop) (((prop)->flags & 2) != 0)
+#define    isfirst(prop) (((prop)->flags & 4) != 0)
+#define   issuperf(prop) (((prop)->flags & 8) != 0)
+#define   isvacant(prop) (isbodiless(prop) && (prop)->rc == ' ')
+
+
+/* Structure for holding the options that affect reformatting */
+/* (the parameters are described in par.doc):                 */
+
+typedef struct paropts {
+  charset *bodychars, *protectchars, *quotechars, *whitechars,
+          *terminalchars,
+          *alnumchars, *lowerchars;  /* The alphanumeric and lower   */
+                                     /* case characters, found once. */
+  int hang, prefix, repeat, suffix, Tab, width, body, cap, div, expel, fit,
+      guess, invis, just, last, quote, Report, touch, utf8, reference;
+  parstats *stats;  /* Where the work is counted, or NULL.      */
+  cache *cache;     /* Where paragraphs are remembered, or NULL. */
+  diskcache *dcache;    /* Where segments are saved, or NULL, */
+  const char *optkey;   /* under keys beginning with the      */
+  size_t optkeylen;     /* optkeylen characters at optkey.    */
+  breakmemo *memo;  /* Passed to reformatto(), or NULL. */
+} paropts;
+
+/* The most characters in the part of a key for a diskcache made from */
+/* the options (see makeoptkey()):                                    */
+
+#define CSBYTES ((UCHAR_MAX + 8) / 8)
+#define OPTKEYSIZE (8 + 20 * 12 + 7 * CSBYTES)
+
+/* Begins phase in *st, if st is not NULL: */
+
+#define PHASE(st,phase) ((st) ? statphase((st),(phase)) : (void) 0)
+
+
+struct parctx {
+  paropts po;      /* The options, with touch < 0 meaning the default. */
+  int jobs;        /* The number of threads to use.                    */
+  arena *scratch;  /* Reused for every paragraph when jobs is 1.       */
+  output *text;    /* Collects the output of parformat().             */
+  char *result;    /* The result of parformat(), with room for size    */
+  size_t size;     /* characters, or NULL if size is 0.                */
+  input *recin;    /* Reads each record for parrecords(), or NULL.     */
+  char *record;    /* A record copied by parrecords(), with room for   */
+  size_t recsize;  /* recsize characters, or NULL if recsize is 0.     */
+  parstats *stats; /* The work counted by setparstats(), or NULL.      */
+  cache *cache;    /* Remembers paragraphs for the --cache option,     */
+  int cachekb;     /* which gave cachekb, or NULL if cachekb is 0.     */
+  diskcache *dcache;  /* Set by setpardiskcache(), or NULL.            */
+  char optkey[OPTKEYSIZE];  /* Made by getopts() for dcache, with      */
+  size_t optkeylen;         /* optkeylen characters.                   */
+};
+
+
+static int digtoint(char c)
+
+/* Returns the value represented by the digit c, or -1 if c is not a digit. */
+{
+  const char *p, * const digits = "0123456789";
+
+  if (!c) return -1;
+  p = strchr(digits,c);
+  return  p  ?  p - digits  :  -1;
+
+  /* We can't simply return c - '0' because this is ANSI C code,  */
+  /* so it has to work for any character set, not just ones which */
+  /* put the digits together in order.  Also, an array that could */
+  /* be referenced as digtoint[c] might be bad because there's no */
+  /* upper limit on CHAR_MAX.                                     */
+}
+
+
+static int strtoudec(const char *s, int *pn)
+
+/* Converts the longest prefix of string s consisting of decimal   */
+/* digits to an integer, which is stored in *pn.  Normally returns */
+/* 1.  If *s is not a digit, then *pn is not changed, but 1 is     */
+/* still returned.  If the integer represented is greater than     */
+/* 9999, then *pn is not changed and 0 is returned.                */
+{
+  int n = 0, d;
+
+  d = digtoint(*s);
+  if (d < 0) return 1;
+
+  do {
+    if (n >= 1000) return 0;
+    n = 10 * n + d;
+    d = digtoint(*++s);
+  } while (d >= 0);
+
+  *pn = n;
+
+  return 1;
+}
+
+
+static charset **namedchars(paropts *po, char which)
+
+/* Returns a pointer to the member of *po holding the body,   */
+/* protective, quote, white, or terminal characters according */
+/* to whether which is 'B', 'P', 'Q', 'W', or 'Z', or NULL if */
+/* it is none of them.                                        */
+{
+  return  which == 'B'  ?  &po->bodychars     :
+          which == 'P'  ?  &po->protectchars  :
+          which == 'Q'  ?  &po->quotechars    :
+          which == 'W'  ?  &po->whitechars    :
+          which == 'Z'  ?  &po->terminalchars :
+          NULL;
+}
+
+
+parctx *newparctx(errmsg_t errmsg)
+{
+  parctx *ctx;
+  paropts *po;
+
+  ctx = calloc(1, sizeof (parctx));
+  if (!ctx) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  po = &ctx->po;
+
+  po->bodychars = parsecharset("", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->protectchars = parsecharset("", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->quotechars = parsecharset("> ", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->whitechars = parsecharset(" \f\n\r\t\v", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->terminalchars = parsecharset(".?!:", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->alnumchars = parsecharset("_A_a_@_0", errmsg);
+  if (*errmsg) goto npcleanup;
+  po->lowerchars = parsecharset("_a", errmsg);
+  if (*errmsg) goto npcleanup;
+
+  po->prefix = po->suffix = po->touch = -1;
+  po->Tab = 1;
+  po->width = 72;
+  ctx->jobs = 1;
+
+  ctx->scratch = newarena(errmsg);
+  if (*errmsg) goto npcleanup;
+  ctx->text = newmemoutput(errmsg);
+  if (*errmsg) goto npcleanup;
+
+  return ctx;
+
+npcleanup:
+
+  freeparctx(ctx);
+  return NULL;
+}
+
+
+parctx *copyparctx(const parctx *ctx, errmsg_t errmsg)
+{
+  parctx *copy;
+  const paropts *po = &ctx->po;
+  paropts *cpo;
+
+  copy = calloc(1, sizeof (parctx));
+  if (!copy) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  cpo = &copy->po;
+
+  *cpo = *po;
+  cpo->bodychars = cpo->protectchars = cpo->quotechars = cpo->whitechars
+    = cpo->terminalchars = cpo->alnumchars = cpo->lowerchars = NULL;
+
+  cpo->bodychars = cscopy(po->bodychars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->protectchars = cscopy(po->protectchars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->quotechars = cscopy(po->quotechars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->whitechars = cscopy(po->whitechars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->terminalchars = cscopy(po->terminalchars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->alnumchars = cscopy(po->alnumchars, errmsg);
+  if (*errmsg) goto cpcleanup;
+  cpo->lowerchars = cscopy(po->lowerchars, errmsg);
+  if (*errmsg) goto cpcleanup;
+
+  copy->jobs = ctx->jobs;
+  if (ctx->cache) {
+    copy->cache = newcache((size_t) ctx->cachekb * 1024, errmsg);
+    if (*errmsg) goto cpcleanup;
+    copy->cachekb = ctx->cachekb;
+  }
+
+  copy->scratch = newarena(errmsg);
+  if (*errmsg) goto cpcleanup;
+  copy->text = newmemoutput(errmsg);
+  if (*errmsg) goto cpcleanup;
+
+  return copy;
+
+cpcleanup:
+
+  freeparctx(copy);
+  return NULL;
+}
+
+
+void freeparctx(parctx *ctx)
+{
+  paropts *po = &ctx->po;
+
+  if (po->bodychars) freecharset(po->bodychars);
+  if (po->protectchars) freecharset(po->protectchars);
+  if (po->quotechars) freecharset(po->quotechars);
+  if (po->whitechars) freecharset(po->whitechars);
+  if (po->terminalchars) freecharset(po->terminalchars);
+  if (po->alnumchars) freecharset(po->alnumchars);
+  if (po->lowerchars) freecharset(po->lowerchars);
+  if (ctx->scratch) freearena(ctx->scratch);
+  if (ctx->text) freeoutput(ctx->text);
+  if (ctx->result) free(ctx->result);
+  if (ctx->recin) freeinput(ctx->recin);
+  if (ctx->record) free(ctx->record);
+  if (ctx->stats) free(ctx->stats);
+  if (ctx->cache) freecache(ctx->cache);
+  if (ctx->dcache) closediskcache(ctx->dcache);
+  free(ctx);
+}
+
+
+void parsetchars(parctx *ctx, char which, const char *set, errmsg_t errmsg)
+{
+  charset **pchars, *chars;
+
+  pchars = namedchars(&ctx->po, which);
+  if (!pchars) {
+    strcpy(errmsg, "Bad name for a set of characters.\n");
+    return;
+  }
+
+  chars = parsecharset(set,errmsg);
+  if (*errmsg) return;
+  csswap(*pchars,chars);
+  freecharset(chars);
+  if (ctx->cache) clearcache(ctx->cache);
+}
+
+
+int paroption(
+  parctx *ctx, const char * const *args, int *phelp, int *pversion,
+  int *pErr, errmsg_t errmsg
+)
+{
+  const char *arg = *args;
+  paropts *po = &ctx->po;
+  charset **pchars, *change;
+  char oc;
+  int n;
+
+  *errmsg = '\0';
+
+  if (!strcmp(arg, "--reference")) {
+    po->reference = 1;
+    return 1;
+  }
+
+  if (!strcmp(arg, "--jobs")) {
+    if (!args[1] || digtoint(*args[1]) < 0
+                 || !strtoudec(args[1], &n) || n < 1) goto badarg;
+    ctx->jobs = n;
+    return 2;
+  }
+
+  if (!strcmp(arg, "--cache")) {
+    if (!args[1] || digtoint(*args[1]) < 0
+                 || !strtoudec(args[1], &n)) goto badarg;
+    if (ctx->cache) freecache(ctx->cache);
+    ctx->cache = NULL;
+    ctx->cachekb = 0;
+    if (n > 0) {
+      ctx->cache = newcache((size_t) n * 1024, errmsg);
+      if (*errmsg) return 2;
+      ctx->cachekb = n;
+    }
+    return 2;
+  }
+
+  if (*arg == '-') ++arg;
+
+  if (!strcmp(arg, "help")) {
+    *phelp = 1;
+    return 1;
+  }
+
+  if (!strcmp(arg, "version")) {
+    *pversion = 1;
+    return 1;
+  }
+
+  pchars = namedchars(po,*arg);
+  if (pchars) {
+    ++arg;
+    if (*arg != '='  &&  *arg != '+'  &&  *arg != '-') goto badarg;
+    change = parsecharset(arg + 1, errmsg);
+    if (change) {
+      if      (*arg == '=')   csswap(*pchars,change);
+      else if (*arg == '+')   csadd(*pchars,change,errmsg);
+      else  /* *arg == '-' */ csremove(*pchars,change,errmsg);
+      freecharset(change);
+    }
+    if (ctx->cache) clearcache(ctx->cache);
+    return 1;
+  }
+
+  if (isdigit(*(unsigned char *)arg)) {
+    if (!strtoudec(arg, &n)) goto badarg;
+    if (n <= 8) po->prefix = n;
+    else po->width = n;
+  }
+
+  for (;;) {
+    while (isdigit(*(unsigned char *)arg)) ++arg;
+    oc = *arg;
+    if (!oc) break;
+    n = -1;
+    if (!strtoudec(++arg, &n)) goto badarg;
+    if (   oc == 'h' || oc == 'p' || oc == 'r'
+        || oc == 's' || oc == 'T' || oc == 'w') {
+      if      (oc == 'h')   po->hang   =  n >= 0 ? n :  1;
+      else if (oc == 'p')   po->prefix =  n;
+      else if (oc == 'r')   po->repeat =  n >= 0 ? n :  3;
+      else if (oc == 's')   po->suffix =  n;
+      else if (oc == 'T')   po->Tab    =  n >= 0 ? n :  8;
+      else  /* oc == 'w' */ po->width  =  n >= 0 ? n : 79;
+    }
+    else {
+      if (n < 0) n = 1;
+      if (n > 1) goto badarg;
+      if      (oc == 'b') po->body   = n;
+      else if (oc == 'c') po->cap    = n;
+      else if (oc == 'd') po->div    = n;
+      else if (oc == 'E') *pErr      = n;
+      else if (oc == 'e') po->expel  = n;
+      else if (oc == 'f') po->fit    = n;
+      else if (oc == 'g') po->guess  = n;
+      else if (oc == 'i') po->invis  = n;
+      else if (oc == 'j') po->just   = n;
+      else if (oc == 'l') po->last   = n;
+      else if (oc == 'q') po->quote  = n;
+      else if (oc == 'R') po->Report = n;
+      else if (oc == 't') po->touch  = n;
+      else if (oc == 'u') po->utf8   = n;
+      else goto badarg;
+    }
+  }
+
+  return 1;
+
+badarg:
+
+  sprintf(errmsg, "Bad argument: %.*s\n", errmsg_size - 16, *args);
+  *phelp = 1;
+  return 1;
+}
+
+
+int parjobs(const parctx *ctx)
+{
+  return ctx->jobs;
+}
+
+
+void setparjobs(parctx *ctx, int jobs)
+{
+  ctx->jobs = jobs;
+}
+
+
+void setparstats(parctx *ctx, int on, errmsg_t errmsg)
+{
+  *errmsg = '\0';
+
+  if (!on) {
+    if (ctx->stats) free(ctx->stats);
+    ctx->stats = NULL;
+    return;
+  }
+
+  if (!ctx->stats) {
+    ctx->stats = malloc(sizeof (parstats));
+    if (!ctx->stats) {
+      strcpy(errmsg,outofmem);
+      return;
+    }
+  }
+  clearstats(ctx->stats);
+}
+
+
+void setpardiskcache(parctx *ctx, const char *dir, int mb, errmsg_t errmsg)
+{
+  diskcache *dc = NULL;
+
+  *errmsg = '\0';
+
+  if (dir) {
+    dc = opendiskcache(dir, mb, errmsg);
+    if (*errmsg) return;
+  }
+  if (ctx->dcache) closediskcache(ctx->dcache);
+  ctx->dcache = dc;
+}
+
+
+void putparstats(const parctx *ctx, output *out, errmsg_t errmsg)
+{
+  *errmsg = '\0';
+  if (ctx->stats) putstats(ctx->stats, out, errmsg);
+}
+
+
+void parcheck(const parctx *ctx, errmsg_t errmsg)
+{
+  if (ctx->po.Tab == 0) {
+    strcpy(errmsg, "<Tab> must not be 0.\n");
+    return;
+  }
+
+  *errmsg = '\0';
+}
+
+
+static char **readlines(
+  input *in, lineprop **pprops, const charset *protectchars,
+  const charset *quotechars, const charset *whitechars,
+  int Tab, int invis, int quote, int utf8, errmsg_t errmsg
+)
+/* Reads lines from *in until EOF, or until a line beginning with a     */
+/* protective character is encountered (in which case the protective    */
+/* character is left unconsumed), or until a blank line is encountered  */
+/* (in which case the newline is left unconsumed).  Returns a           */
+/* NULL-terminated array of pointers to individual lines, stripped of   */
+/* their newline characters.  Every NUL character is stripped, and      */
+/* every white character is changed to a space unless it is a newline.  */
+/* Tabs are expanded counting columns as for utf8width() if utf8 is 1.  */
+/* If quote is 1, vacant lines will be supplied as described for the q  */
+/* option in par.doc.  *pprops is set to an array of lineprop           */
+/* structures, one for each line, each of whose flags field is either 0 */
+/* or L_INSERTED (the other fields are 0).  If there are no lines,      */
+/* *pprops is set to NULL.  Lines needing no changes may point into     */
+/* characters retained by *in (see inretains()).  The returned array    */
+/* may be freed with freelines(lines,in).  *pprops may be freed with    */
+/* free() if it's not NULL.  On failure, returns NULL and sets *pprops  */
+/* to NULL.                                                             */
+{
+  buffer *cbuf = NULL, *lbuf = NULL, *lpbuf = NULL;
+  int empty, blank, firstline, qsonly, oldqsonly = 0, vlnlen, i, retain,
+      spacewhite, direct, col = 0;
+  char ch, *ln = NULL, nullchar = '\0', *nullline = NULL, *qpend,
+       *oldln = NULL, *oldqpend = NULL, *p, *op, *vln = NULL, **lines = NULL;
+  const char *span, *nl, *end, *q, *r;
+  size_t n;
+  lineprop vprop = { 0, 0, 0, '\0' }, iprop = { 0, 0, 0, '\0' };
+
+  /* oldqsonly, oldln, and oldquend don't really need to be initialized.   */
+  /* They are initialized only to appease compilers that try to be helpful */
+  /* by issuing warnings about unitialized automatic variables.            */
+
+  iprop.flags = L_INSERTED;
+  *errmsg = '\0';
+
+  *pprops = NULL;
+
+  cbuf = newbuffer(sizeof (char), errmsg);
+  if (*errmsg) goto rlcleanup;
+  lbuf = newbuffer(sizeof (char *), errmsg);
+  if (*errmsg) goto rlcleanup;
+  lpbuf = newbuffer(sizeof (lineprop), errmsg);
+  if (*errmsg) goto rlcleanup;
+
+  retain = inretains(in);
+  spacewhite = csmember(' ', whitechars);
+
+  for (empty = blank = firstline = 1;  ;  ) {
+    span = inspan(in,&n);
+    if (!n) break;
+    nl = memchr(span, '\n', n);
+    end =  nl  ?  nl  :  span + n;
+
+    direct = 0;
+    if (empty && span < end) {
+      if (csmember(*span, protectchars)) break;
+      empty = 0;
+      direct = retain && nl;
+    }
+
+    /* Copy each run of ordinary characters (including spaces, which   */
+    /* need no rewriting) in one step, and handle NULs, tabs, and the  */
+    /* other white characters singly.  If the input retains its        */
+    /* characters and the whole line is one such run, it needn't be    */
+    /* copied at all:                                                  */
+
+    for (q = span;  q < end;  q = r + 1) {
+      for (r = q;  r < end;  ++r)
+        if (*r != ' ') {
+          if (!*r || *r == '\t' || csmember(*r, whitechars)) break;
+          blank = 0;
+        }
+        else if (!spacewhite) blank = 0;
+      if (r == end && q == span && direct) break;
+      direct = 0;
+      if (r > q) {
+        additems(cbuf, q, r - q, errmsg);
+        if (*errmsg) goto rlcleanup;
+        col +=  utf8  ?  utf8width(q, r - q)  :  r - q;
+      }
+      if (r == end) break;
+      if (!*r) continue;
+      ch = ' ';
+      if (*r == '\t') {
+        for (i = Tab - col % Tab;  i > 0;  --i) {
+          additem(cbuf, &ch, errmsg);
+          if (*errmsg) goto rlcleanup;
+          ++col;
+        }
+        continue;
+      }
+      additem(cbuf, &ch, errmsg);
+      if (*errmsg) goto rlcleanup;
+      ++col;
+    }
+
+    inskip(in, end - span);
+    if (!nl) continue;
+    if (blank) break;
+    inskip(in,1);
+
+    if (direct) {
+      ln = (char *) span;
+      ln[end - span] = '\0';
+    }
+    else {
+      additem(cbuf, &nullchar, errmsg);
+      if (*errmsg) goto rlcleanup;
+      ln = copyitems(cbuf,errmsg);
+      if (*errmsg) goto rlcleanup;
+    }
+    if (quote) {
+      for (qpend = ln;  *qpend && csmember(*qpend, quotechars);  ++qpend);
+      for (p = qpend;  *p == ' ' || csmember(*p, quotechars);  ++p);
+      qsonly =  *p == '\0';
+      while (qpend > ln && qpend[-1] == ' ') --qpend;
+      if (!firstline) {
+        i = qpend - ln;
+        if (i > oldqpend - oldln) i = oldqpend - oldln;
+        i = memmismatch(ln, oldln, i);
+        p = ln + i, op = oldln + i;
+        if (!(p == qpend && op == oldqpend)) {
+          if (!invis && (oldqsonly || qsonly)) {
+            if (oldqsonly) {
+              *op = '\0';
+              oldqpend = op;
+            }
+            if (qsonly) {
+              *p = '\0';
+              qpend = p;
+            }
+          }
+          else {
+            vlnlen = p - ln;
+            vln = malloc((vlnlen + 1) * sizeof (char));
+            if (!vln) {
+              strcpy(errmsg,outofmem);
+              goto rlcleanup;
+            }
+            strncpy(vln,ln,vlnlen);
+            vln[vlnlen] = '\0';
+            additem(lbuf, &vln, errmsg);
+            if (*errmsg) goto rlcleanup;
+            additem(lpbuf, &iprop, errmsg);
+            if (*errmsg) goto rlcleanup;
+            vln = NULL;
+          }
+        }
+      }
+      oldln = ln;
+      oldqpend = qpend;
+      oldqsonly = qsonly;
+    }
+    additem(lbuf, &ln, errmsg);
+    if (*errmsg) goto rlcleanup;
+    ln = NULL;
+    additem(lpbuf, &vprop, errmsg);
+    if (*errmsg) goto rlcleanup;
+    clearbuffer(cbuf);
+    col = 0;
+    empty = blank = 1;
+    firstline = 0;
+  }
+
+  if (!blank) {
+    additem(cbuf, &nullchar, errmsg);
+    if (*errmsg) goto rlcleanup;
+    ln = copyitems(cbuf,errmsg);
+    if (*errmsg) goto rlcleanup;
+    additem(lbuf, &ln, errmsg);
+    if (*errmsg) goto rlcleanup;
+    ln = NULL;
+    additem(lpbuf, &vprop, errmsg);
+    if (*errmsg) goto rlcleanup;
+  }
+
+  additem(lbuf, &nullline, errmsg);
+  if (*errmsg) goto rlcleanup;
+  *pprops = copyitems(lpbuf,errmsg);
+  if (*errmsg) goto rlcleanup;
+  lines = copyitems(lbuf,errmsg);
+
+rlcleanup:
+
+  if (cbuf) freebuffer(cbuf);
+  if (lpbuf) freebuffer(lpbuf);
+  if (lbuf) {
+    if (!lines)
+      for (;;) {
+        lines = nextitem(lbuf);
+        if (!lines) break;
+        if (!inholds(in,*lines)) free(*lines);
+      }
+    freebuffer(lbuf);
+  }
+  if (ln && !inholds(in,ln)) free(ln);
+  if (vln) free(vln);
+
+  return lines;
+}
+
+
+/* Facts about the lines of a segment, found once, from which the   */
+/* comprelen and comsuflen of any group of consecutive lines can be */
+/* found without comparing the lines again:                         */
+
+typedef struct segindex {
+  const char * const *lines;  /* The lines of the segment.             */
+  int *len,                   /* len[k] is the length of lines[k],     */
+      *lcp,                   /* lcp[k] is the length of the longest   */
+      *lcs,                   /* common prefix of lines[k] and         */
+                              /* lines[k + 1], and lcs[k] that of      */
+                              /* their longest common suffix.          */
+      *stack;                 /* Room for delimit() to keep 4 ints for */
+                              /* each line.                            */
+  int utf8;                   /* If 1, affixes must not end or begin   */
+                              /* in the middle of a UTF-8 sequence.    */
+} segindex;
+
+/* Returns 1 if the char c continues a UTF-8 sequence, else 0: */
+
+#define iscontinuation(c) ((*(const unsigned char *) &(c) & 0xC0) == 0x80)
+
+
+static int *makesegindex(
+  segindex *ix, const char * const *lines, int numlines, int utf8,
+  errmsg_t errmsg
+)
+/* Fills in *ix for the numlines lines in lines, and returns a pointer */
+/* to the memory allocated for it, which the caller must free, or NULL */
+/* on failure.  utf8 is copied into ix->utf8.                          */
+{
+  int *mem, k, n;
+
+  mem = malloc((7 * numlines + 1) * sizeof (int));
+  if (!mem) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  ix->lines = lines;
+  ix->utf8 = utf8;
+  ix->len = mem;
+  ix->lcp = ix->len + numlines;
+  ix->lcs = ix->lcp + numlines;
+  ix->stack = ix->lcs + numlines;
+
+  for (k = 0;  k < numlines;  ++k) ix->len[k] = strlen(lines[k]);
+  for (k = 0;  k + 1 < numlines;  ++k) {
+    n =  ix->len[k] < ix->len[k + 1]  ?  ix->len[k]  :  ix->len[k + 1];
+    ix->lcp[k] = memmismatch(lines[k], lines[k + 1], n);
+    ix->lcs[k] = memrmismatch(lines[k] + ix->len[k],
+                              lines[k + 1] + ix->len[k + 1], n);
+  }
+
+  *errmsg = '\0';
+  return mem;
+}
+
+
+static void compresuflen(
+  const segindex *ix, int first, int numlines, const charset *bodychars,
+  int body, int pre, int suf, int *ppre, int *psuf
+)
+/* Writes into *ppre and *psuf the comprelen and comsuflen of the  */
+/* numlines lines beginning with ix->lines[first].  Assumes that   */
+/* they have already been determined to be at least pre and suf.   */
+/* numlines must not be 0.  The common prefix of several lines is  */
+/* as long as the shortest common prefix of two consecutive ones,  */
+/* and likewise for suffixes, so only the first line is examined.  */
+{
+  const char *start, *end, *knownstart, *p1, *knownend;
+  int k, last = first + numlines - 1, n;
+
+  start = ix->lines[first];
+  end = knownstart = start + pre;
+  if (body)
+    end = start + ix->len[first];
+  else
+    while (*end && !csmember(*end, bodychars)) ++end;
+  for (k = first;  k < last;  ++k)
+    if (ix->lcp[k] < end - start) end = start + ix->lcp[k];
+  if (body)
+    for (p1 = end;  p1 > knownstart;  )
+      if (*--p1 != ' ') {
+        if (csmember(*p1, bodychars))
+          end = p1;
+        else
+          break;
+      }
+  if (ix->utf8)
+    while (end > knownstart && iscontinuation(*end)) --end;
+  *ppre = end - start;
+
+  knownstart = ix->lines[first] + *ppre;
+  end = ix->lines[first] + ix->len[first];
+  knownend = end - suf;
+  if (body)
+    start = knownstart;
+  else
+    for (start = knownend;
+         start > knownstart && !csmember(start[-1], bodychars);
+         --start);
+  n = knownend - start;
+  for (k = first;  k < last;  ++k) {
+    if (ix->lcs[k] - suf < n) n = ix->lcs[k] - suf;
+    if (ix->len[k + 1] - *ppre - suf < n) n = ix->len[k + 1] - *ppre - suf;
+  }
+  if (n < 0) n = 0;
+  start = knownend - n;
+  if (body) {
+    for (p1 = start;
+         start < knownend && (*start == ' ' || csmember(*start, bodychars));
+         ++start);
+    if (start > p1 && start[-1] == ' ') --start;
+  }
+  else
+    while (end - start >= 2 && *start == ' ' && start[1] == ' ') ++start;
+  if (ix->utf8)
+    while (start < knownend && iscontinuation(*start)) ++start;
+  *psuf = end - start;
+}
+
+
+static void delimit(
+  const segindex *ix, int numlines, const charset *bodychars, int repeat,
+  int body, int div, lineprop *props
+)
+/* Sets fields in each lineprop in the parallel array props as      */
+/* appropriate for the numlines lines of the segment indexed by     */
+/* *ix, except for the L_SUPERF flag, which is never set.  A group  */
+/* of lines that contains bodiless lines is divided at them, and    */
+/* each run of other lines is then delimited in the same way, using */
+/* what was found about the whole group.  The runs still to be      */
+/* delimited are kept on ix->stack rather than in recursive calls,  */
+/* and since they never overlap, there are never more of them than  */
+/* there are lines.                                                 */
+{
+  const char *line, *end, *p;
+  char rc;
+  lineprop *prop;
+  int *stack = ix->stack, top, first, stop, pre, suf, k, anybodiless,
+      status;
+
+  if (!numlines) return;
+
+  stack[0] = 0, stack[1] = numlines, stack[2] = stack[3] = 0;
+  top = 4;
+
+  while (top) {
+    top -= 4;
+    first = stack[top], stop = stack[top + 1];
+    pre = stack[top + 2], suf = stack[top + 3];
+
+    if (stop == first + 1) {
+      props[first].flags |= L_FIRST;
+      props[first].p = pre, props[first].s = suf;
+      continue;
+    }
+
+    compresuflen(ix, first, stop - first, bodychars, body, pre, suf,
+                 &pre, &suf);
+
+    anybodiless = 0;
+    for (k = first;  k < stop;  ++k) {
+      prop = props + k;
+      line = ix->lines[k];
+      prop->flags |= L_BODILESS;
+      prop->p = pre, prop->s = suf;
+      end = line + ix->len[k] - suf;
+      p = line + pre;
+      rc =  p < end  ?  *p  :  ' ';
+      if (rc != ' ' && (isinserted(prop) || !repeat || end - p < repeat))
+        prop->flags &= ~L_BODILESS;
+      else if (p < end && memspan(p, rc, end - p) < (size_t) (end - p))
+        prop->flags &= ~L_BODILESS;
+      if (isbodiless(prop)) {
+        anybodiless = 1;
+        prop->rc = rc;
+      }
+    }
+
+    if (anybodiless) {
+      for (k = first;  k < stop;  ) {
+        if (isbodiless(props + k)) {
+          ++k;
+          continue;
+        }
+        stack[top] = k;
+        for (++k;  k < stop && !isbodiless(props + k);  ++k);
+        stack[top + 1] = k;
+        stack[top + 2] = pre, stack[top + 3] = suf;
+        top += 4;
+      }
+      continue;
+    }
+
+    if (!div) {
+      props[first].flags |= L_FIRST;
+      continue;
+    }
+
+    status = (ix->lines[first][pre] == ' ');
+    for (k = first;  k < stop;  ++k)
+      if ((ix->lines[k][pre] == ' ') == status)
+        props[k].flags |= L_FIRST;
+  }
+}
+
+
+static void marksuperf(
+  const char * const * lines, const char * const * endline, lineprop *props
+)
+/* lines points to the first line of a segment, and endline to one  */
+/* line beyond the last line in the segment.  Sets L_SUPERF bits in */
+/* the flags fields of the props array whenever the corresponding   */
+/* line is superfluous.  L_BODILESS bits must already be set.       */
+{
+  const char * const *line, *p;
+  lineprop *prop, *mprop, dummy;
+  int inbody, num, mnum;
+
+  for (line = lines, prop = props;  line < endline;  ++line, ++prop)
+    if (isvacant(prop))
+      prop->flags |= L_SUPERF;
+
+  inbody = mnum = 0;
+  mprop = &dummy;
+  for (line = lines, prop = props;  line < endline;  ++line, ++prop)
+    if (isvacant(prop)) {
+      for (num = 0, p = *line;  *p;  ++p)
+        if (*p != ' ') ++num;
+      if (inbody || num < mnum)
+        mnum = num, mprop = prop;
+      inbody = 0;
+    } else {
+      if (!inbody) mprop->flags &= ~L_SUPERF;
+      inbody = 1;
+    }
+} 
+
+
+static void setaffixes(
+  const segindex *ix, int first, int numin, const lineprop *props,
+  const charset *bodychars, const charset *quotechars, int hang, int body,
+  int quote, int *pafp, int *pfs, int *pprefix, int *psuffix
+)
+/* The numin lines beginning with ix->lines[first] are an IP.  numin */
+/* must not be 0.  props points to the lineprop structure of the     */
+/* first of them.  *pafp and *pfs are set to the augmented fallback  */
+/* prelen and fallback suflen of the IP.  If either of *pprefix,     */
+/* *psuffix is less than 0, it is set to a default value as          */
+/* specified in "par.doc".                                           */
+{
+  int pre, suf;
+  const char *p, *line = ix->lines[first];
+
+  if ((*pprefix < 0 || *psuffix < 0)  &&  numin > hang + 1)
+    compresuflen(ix, first + hang, numin - hang, bodychars, body, 0, 0,
+                 &pre, &suf);
+
+  p = line + props->p;
+  if (numin == 1 && quote)
+    while (*p && csmember (*p, quotechars))
+      ++p;
+  *pafp = p - line;
+  *pfs = props->s;
+
+  if (*pprefix < 0)
+    *pprefix  =  numin > hang + 1  ?  pre  :  *pafp;
+
+  if (*psuffix < 0)
+    *psuffix  =  numin > hang + 1  ?  suf  :  *pfs;
+}
+
+
+static void freelines(char **lines, const input *in)
+/* Frees the elements of lines, except those held by *in (if in  */
+/* is not NULL), and lines itself.  lines is a NULL-terminated   */
+/* array of strings.                                             */
+{
+  char **line;
+
+  for (line = lines;  *line;  ++line)
+    if (!in || !inholds(in,*line)) free(*line);
+
+  free(lines);
+}
+
+
+typedef struct segreader {
+  input *in;             /* The input being read.                      */
+  const paropts *po;     /* The options.                               */
+  int sawnonblank,       /* State carried from one segment to the next */
+      oweblank;          /* for the e option.                          */
+} segreader;
+
+
+static const char *waitspan(
+  input *in, output *out, parstats *st, size_t *plen, errmsg_t errmsg
+)
+/* Does the same as inspan(in,plen), but first flushes *out if  */
+/* inspan() might have to wait for more input, so that what has */
+/* been written is not held up meanwhile, counting the time in  */
+/* *st (if st is not NULL) as output.  Returns NULL (and sets   */
+/* *plen to 0) on failure.                                      */
+{
+  *errmsg = '\0';
+  if (!inready(in)) {
+    PHASE(st,PS_OUTPUT);
+    flushoutput(out,errmsg);
+    PHASE(st,PS_INPUT);
+    if (*errmsg) {
+      *plen = 0;
+      return NULL;
+    }
+  }
+
+  return inspan(in,plen);
+}
+
+
+static char **readsegment(
+  segreader *sr, output *out, lineprop **pprops, errmsg_t errmsg
+)
+/* Reads the next segment from sr->in, as readlines() would, and      */
+/* returns its lines, setting *pprops.  Any blank lines and protected */
+/* lines before the segment are first written to *out, followed by    */
+/* the blank line (if any) that the e option says must precede the    */
+/* segment.  *out is flushed whenever the input has to be waited for. */
+/* Returns NULL at EOF (without setting *errmsg) or on failure, and   */
+/* sets *pprops to NULL.                                              */
+{
+  input *in = sr->in;
+  const paropts *po = sr->po;
+  char **inlines = NULL, **endline, ch;
+  const char *span, *nl;
+  size_t n, k;
+
+  *errmsg = '\0';
+  *pprops = NULL;
+
+  for (;;) {
+    for (;;) {
+      span = waitspan(in, out, po->stats, &n, errmsg);
+      if (*errmsg) goto rscleanup;
+      if (!n) break;
+      ch = *span;
+      if (po->expel && ch == '\n') {
+        inskip(in,1);
+        sr->oweblank = sr->sawnonblank;
+        continue;
+      }
+      if (csmember(ch, po->protectchars)) {
+        sr->sawnonblank = 1;
+        if (sr->oweblank) {
+          outchars(out, "\n", 1, errmsg);
+          if (*errmsg) goto rscleanup;
+          sr->oweblank = 0;
+        }
+        while (ch != '\n') {
+          nl = memchr(span, '\n', n);
+          k =  nl  ?  (size_t) (nl - span)  :  n;
+          outchars(out, span, k, errmsg);
+          if (*errmsg) goto rscleanup;
+          inskip(in,k);
+          span = waitspan(in, out, po->stats, &n, errmsg);
+          if (*errmsg) goto rscleanup;
+          if (!n) break;
+          ch = *span;
+        }
+      }
+      if (ch != '\n') break;  /* subsumes the case that n == 0 */
+      outchars(out, "\n", 1, errmsg);
+      if (*errmsg) goto rscleanup;
+      inskip(in,1);
+    }
+
+    if (!n) goto rscleanup;
+
+    inlines =
+      readlines(in, pprops, po->protectchars, po->quotechars, po->whitechars,
+                po->Tab, po->invis, po->quote, po->utf8, errmsg);
+    if (*errmsg) goto rscleanup;
+
+    for (endline = inlines;  *endline;  ++endline);
+    if (endline > inlines) break;
+    free(inlines);
+    inlines = NULL;
+  }
+
+  sr->sawnonblank = 1;
+  if (sr->oweblank) {
+    outchars(out, "\n", 1, errmsg);
+    if (*errmsg) goto rscleanup;
+    sr->oweblank = 0;
+  }
+
+  return inlines;
+
+rscleanup:
+
+  if (inlines) freelines(inlines,in);
+  if (*pprops) {
+    free(*pprops);
+    *pprops = NULL;
+  }
+
+  return NULL;
+}
+
+
+typedef struct lineout {
+  output *out;      /* Where reformatted lines are written.       */
+  parstats *stats;  /* Where the time is counted, or NULL.        */
+  cache *cache;     /* Where the lines are also remembered, or    */
+                    /* NULL.                                      */
+} lineout;
+
+
+static void putoutline(void *arg, const char *line, errmsg_t errmsg)
+
+/* Writes line and a newline to lo->out, where lo is the lineout   */
+/* *arg.  If lo->stats is not NULL and the line might have to be   */
+/* written to a stream, the time is counted as output rather than  */
+/* reformatting, which is otherwise the phase when this is called. */
+/* If lo->cache is not NULL, line is added to the value being made */
+/* there (see cacheline()).                                        */
+{
+  lineout *lo = arg;
+
+  if (lo->stats && outfull(lo->out, strlen(line) + 1)) {
+    statphase(lo->stats, PS_OUTPUT);
+    outline(lo->out, line, errmsg);
+    statphase(lo->stats, PS_REFORMAT);
+  }
+  else outline(lo->out, line, errmsg);
+
+  if (lo->cache && !*errmsg) cacheline(lo->cache, line, errmsg);
+}
+
+
+static const char *findip(
+  cache *c, const segindex *ix, int first, int numlines, const int *params,
+  int numparams, size_t *plen, errmsg_t errmsg
+)
+/* Makes the key in *c for the IP of numlines lines beginning with  */
+/* ix->lines[first], reformatted according to the numparams ints in */
+/* params, and returns what cachefind(c,plen) returns for it.  On   */
+/* failure, returns NULL.                                           */
+{
+  int k;
+
+  cachekey(c);
+  cacheadd(c, (const char *) params, numparams * sizeof (int), errmsg);
+  for (k = first;  k < first + numlines && !*errmsg;  ++k) {
+    cacheadd(c, ix->lines[k], ix->len[k], errmsg);
+    if (!*errmsg) cacheadd(c, "\n", 1, errmsg);
+  }
+  if (*errmsg) return NULL;
+
+  return cachefind(c,plen);
+}
+
+
+static void formatsegment(
+  char **inlines, lineprop *props, const paropts *po, output *out,
+  arena *scratch, errmsg_t errmsg
+)
+/* Reformats the segment whose lines and properties are inlines and */
+/* props, as returned by readsegment(), according to the options in */
+/* *po, and writes the result to *out, using *scratch for each      */
+/* paragraph (see reformatto()).  The lines in inlines may be       */
+/* modified.  If po->stats is not NULL, the work is counted there.  */
+{
+  int prefix, suffix, i, afp, fs;
+  char **endline, **firstline, *end, **nextline;
+  lineprop *firstprop, *nextprop;
+  segindex ix;
+  int *ixmem;
+  parstats *st = po->stats;
+  lineout lo;
+  int params[15];
+  const char *val, *valend;
+  size_t n;
+
+  *errmsg = '\0';
+  lo.out = out, lo.stats = st, lo.cache = NULL;
+  if (st) {
+    statphase(st, PS_DELIMIT);
+    ++st->segments;
+  }
+
+  for (endline = inlines;  *endline;  ++endline);
+
+  ixmem = makesegindex(&ix, (const char * const *) inlines,
+                       endline - inlines, po->utf8, errmsg);
+  if (!ixmem) return;
+
+  delimit(&ix, endline - inlines, po->bodychars, po->repeat, po->body,
+          po->div, props);
+
+  if (po->expel)
+    marksuperf((const char * const *) inlines,
+               (const char * const *) endline, props);
+
+  firstline = inlines, firstprop = props;
+  do {
+    if (isbodiless(firstprop)) {
+      if (st) {
+        statphase(st, PS_OUTPUT);
+        ++st->bodiless;
+      }
+      if (   !(po->invis && isinserted(firstprop))
+          && !(po->expel && issuperf(firstprop))) {
+        end = *firstline + ix.len[firstline - inlines];
+        if (!po->repeat || (firstprop->rc == ' ' && !firstprop->s)) {
+          while (end > *firstline && end[-1] == ' ') --end;
+          *end = '\0';
+          outline(out, *firstline, errmsg);
+          if (*errmsg) goto fscleanup;
+        }
+        else {
+          i = po->width - firstprop->p - firstprop->s;
+          if (po->utf8)
+            i = po->width - utf8width(*firstline, firstprop->p)
+                          - utf8width(end - firstprop->s, firstprop->s);
+          if (i < 0) {
+            sprintf(errmsg,impossibility,5);
+            goto fscleanup;
+          }
+          outchars(out, *firstline, firstprop->p, errmsg);
+          if (*errmsg) goto fscleanup;
+          outrepeat(out, firstprop->rc, i, errmsg);
+          if (*errmsg) goto fscleanup;
+          outline(out, end - firstprop->s, errmsg);
+          if (*errmsg) goto fscleanup;
+        }
+      }
+      ++firstline, ++firstprop;
+      continue;
+    }
+
+    for (nextline = firstline + 1, nextprop = firstprop + 1;
+         nextline < endline && !isbodiless(nextprop) && !isfirst(nextprop);
+         ++nextline, ++nextprop);
+
+    if (st) {
+      statphase(st, PS_DELIMIT);
+      ++st->ips;
+    }
+    prefix = po->prefix, suffix = po->suffix;
+    setaffixes(&ix, firstline - inlines, nextline - firstline, firstprop,
+               po->bodychars, po->quotechars, po->hang, po->body, po->quote,
+               &afp, &fs, &prefix, &suffix);
+    if (po->width <= prefix + suffix) {
+      sprintf(errmsg,
+              "<width> (%d) <= <prefix> (%d) + <suffix> (%d)\n",
+              po->width, prefix, suffix);
+      goto fscleanup;
+    }
+
+    PHASE(st,PS_REFORMAT);
+
+    if (po->cache) {
+      params[0] = afp, params[1] = fs, params[2] = po->hang;
+      params[3] = prefix, params[4] = suffix, params[5] = po->width;
+      params[6] = po->cap, params[7] = po->fit, params[8] = po->guess;
+      params[9] = po->just, params[10] = po->last, params[11] = po->Report;
+      params[12] = po->touch, params[13] = po->utf8;
+      params[14] = po->reference;
+      val = findip(po->cache, &ix, firstline - inlines, nextline - firstline,
+                   params, 15, &n, errmsg);
+      if (*errmsg) goto fscleanup;
+      if (val) {
+        if (st) ++st->cachehits;
+        for (valend = val + n;  val < valend;  val += strlen(val) + 1) {
+          putoutline(&lo, val, errmsg);
+          if (*errmsg) goto fscleanup;
+        }
+        firstline = nextline, firstprop = nextprop;
+        continue;
+      }
+      if (st) ++st->cachemisses;
+      lo.cache = po->cache;
+    }
+
+    reformatto((const char * const *) firstline,
+               (const char * const *) nextline,
+               afp, fs, po->hang, prefix, suffix, po->width, po->cap,
+               po->fit, po->guess, po->just, po->last, po->Report,
+               po->touch, po->utf8, po->reference, po->terminalchars,
+               po->alnumchars, po->lowerchars, putoutline, &lo, scratch,
+               po->memo, st, errmsg);
+    if (*errmsg) goto fscleanup;
+
+    if (lo.cache) {
+      cachestore(lo.cache, errmsg);
+      if (*errmsg) goto fscleanup;
+      lo.cache = NULL;
+    }
+
+    firstline = nextline, firstprop = nextprop;
+  } while (firstline < endline);
+
+fscleanup:
+
+  free(ixmem);
+}
+
+
+static void formatsaved(
+  char **inlines, lineprop *props, const paropts *po, output *out,
+  arena *scratch, errmsg_t errmsg
+)
+/* Does the same as formatsegment(inlines,props,po,out,scratch,errmsg), */
+/* except that if po->dcache is not NULL, the result is looked for      */
+/* there first, under a key made of po->optkey followed by the lines    */
+/* and whether each was inserted, and saved there if it is not found.   */
+{
+  char *key = NULL, *p, **line, *buf = NULL;
+  const char *found;
+  size_t keylen, n, bufsize = 0;
+  output *held = NULL;
+  parstats *st = po->stats;
+  errmsg_t heldmsg;
+
+  if (!po->dcache) {
+    formatsegment(inlines, props, po, out, scratch, errmsg);
+    return;
+  }
+
+  PHASE(st,PS_DELIMIT);
+  keylen = po->optkeylen;
+  for (line = inlines;  *line;  ++line) keylen += strlen(*line) + 2;
+  key = malloc(keylen);
+  if (!key) {
+    strcpy(errmsg,outofmem);
+    return;
+  }
+  memcpy(key, po->optkey, po->optkeylen);
+  p = key + po->optkeylen;
+  for (line = inlines;  *line;  ++line) {
+    *p++ =  isinserted(props + (line - inlines))  ?  'i'  :  ' ';
+    n = strlen(*line);
+    memcpy(p, *line, n);
+    p += n;
+    *p++ = '\n';
+  }
+
+  found = diskfind(po->dcache, key, keylen, &buf, &bufsize, &n, errmsg);
+  if (*errmsg) goto fvcleanup;
+  if (found) {
+    if (st) {
+      ++st->segments;
+      ++st->diskhits;
+      statphase(st, PS_OUTPUT);
+    }
+    outchars(out, found, n, errmsg);
+    goto fvcleanup;
+  }
+  if (st) ++st->diskmisses;
+
+  held = newmemoutput(errmsg);
+  if (*errmsg) goto fvcleanup;
+  formatsegment(inlines, props, po, held, scratch, errmsg);
+  if (*errmsg) {
+    /* Whatever was reformatted before the failure is written anyway, */
+    /* just as it would be without the cache, but is not saved:       */
+    outoutput(out, held, heldmsg);
+    goto fvcleanup;
+  }
+
+  PHASE(st,PS_OUTPUT);
+  n = outlength(held);
+  if (n > bufsize) {
+    p = realloc(buf,n);
+    if (!p) {
+      strcpy(errmsg,outofmem);
+      goto fvcleanup;
+    }
+    buf = p;
+  }
+  copyoutputto(held,buf);
+  diskstore(po->dcache, key, keylen, buf, n);
+  outoutput(out, held, errmsg);
+
+fvcleanup:
+
+  free(key);
+  if (buf) free(buf);
+  if (held) freeoutput(held);
+}
+
+
+static void formatsegments(
+  segreader *sr, output *out, arena *scratch, errmsg_t errmsg
+)
+/* Reads sr->in until EOF, beginning in the state recorded in *sr, and */
+/* writes the reformatted text to *out, according to the options in    */
+/* *sr->po, using *scratch for each paragraph, or a temporary arena    */
+/* if scratch is NULL.  Each segment's input is released once it has   */
+/* been reformatted.                                                   */
+{
+  const paropts *po = sr->po;
+  char **inlines = NULL;
+  lineprop *props = NULL;
+  arena *ownscratch = NULL;
+
+  if (!scratch) {
+    scratch = ownscratch = newarena(errmsg);
+    if (*errmsg) return;
+  }
+
+  for (;;) {
+    PHASE(po->stats,PS_INPUT);
+    inlines = readsegment(sr, out, &props, errmsg);
+    if (!inlines) break;
+    formatsaved(inlines, props, po, out, scratch, errmsg);
+    if (*errmsg) break;
+    freelines(inlines, sr->in);
+    inlines = NULL;
+    free(props);
+    props = NULL;
+    inrelease(sr->in, incount(sr->in));
+  }
+
+  if (ownscratch) freearena(ownscratch);
+  if (inlines) freelines(inlines, sr->in);
+  if (props) free(props);
+}
+
+
+static void formatinput(
+  input *in, output *out, const paropts *po, arena *scratch, errmsg_t errmsg
+)
+/* Reads *in until EOF, writing the reformatted text to *out,     */
+/* according to the options in *po, using *scratch for each       */
+/* paragraph, or a temporary arena if scratch is NULL.            */
+{
+  segreader sr;
+
+  sr.in = in, sr.po = po;
+  sr.sawnonblank = sr.oweblank = 0;
+  formatsegments(&sr, out, scratch, errmsg);
+}
+
+
+/* Segments are handed to the threads of formatstream() in batches, */
+/* so that a thread need not be woken for every short paragraph.  A */
+/* batch is closed once it holds at least BATCHLINES lines.         */
+
+#define BATCHLINES 1024
+
+typedef struct part {
+  char *literal;              /* The text read before the segment,    */
+  int litlen;                 /* or NULL, and its length.             */
+  char **inlines;             /* The lines of the segment, or NULL.   */
+  lineprop *props;            /* Their properties.                    */
+} part;
+
+typedef struct batch {
+  buffer *parts;              /* The parts of the batch, in order.    */
+  output *text;               /* Scratch for readsegment(), then the  */
+                              /* reformatted text.                    */
+  arena *scratch;             /* Scratch for formatsegment().         */
+  parstats stats;             /* The work of reading and reformatting */
+                              /* the batch, if it is being counted.   */
+  unsigned long end;          /* The input count after the batch.     */
+  char errmsg[errmsg_size];   /* Any error reading or reformatting.   */
+} batch;
+
+typedef struct streamjob {
+  const paropts *po;          /* The options.                         */
+  segreader *sr;              /* Used only by producebatch().         */
+  batch *batches;             /* A ring of window batches.            */
+  int window,
+      done;                   /* Set once producebatch() has hit EOF  */
+                              /* or an error.                         */
+} streamjob;
+
+
+static void freeparts(buffer *parts, const input *in)
+
+/* Frees whatever the parts in *parts point to, and removes them. */
+{
+  part *pt;
+
+  rewindbuffer(parts);
+  while ((pt = nextitem(parts)) != NULL) {
+    if (pt->literal) free(pt->literal);
+    if (pt->inlines) freelines(pt->inlines,in);
+    if (pt->props) free(pt->props);
+  }
+  clearbuffer(parts);
+}
+
+
+static int producebatch(void *arg, int task)
+
+/* Reads batch number task of the streamjob *arg into its slot in */
+/* the ring.  Returns 0 if there was nothing more to read.        */
+{
+  streamjob *sj = arg;
+  batch *b = sj->batches + task % sj->window;
+  segreader *sr = sj->sr;
+  paropts po;
+  part pt;
+  char **line;
+  int numlines = 0;
+  errmsg_t errmsg;
+
+  if (sj->done) return 0;
+  *b->errmsg = '\0';
+
+  /* The segreader is used by one thread at a time, but is given */
+  /* the stats of the batch it is reading for:                   */
+
+  if (sr->po->stats) {
+    po = *sr->po;
+    po.stats = &b->stats;
+    sr->po = &po;
+    clearstats(&b->stats);
+    statphase(&b->stats, PS_INPUT);
+  }
+
+  do {
+    clearoutput(b->text);
+    pt.inlines = readsegment(sr, b->text, &pt.props, b->errmsg);
+    pt.litlen = outlength(b->text);
+    pt.literal = copyoutput(b->text,errmsg);
+    if (!*errmsg && (pt.literal || pt.inlines))
+      additem(b->parts, &pt, errmsg);
+    if (*errmsg) {
+      strcpy(b->errmsg,errmsg);
+      if (pt.literal) free(pt.literal);
+      if (pt.inlines) freelines(pt.inlines, sj->sr->in);
+      if (pt.props) free(pt.props);
+    }
+    if (!pt.inlines || *b->errmsg) {
+      sj->done = 1;
+      break;
+    }
+    for (line = pt.inlines;  *line;  ++line) ++numlines;
+  } while (numlines < BATCHLINES);
+  b->end = incount(sr->in);
+
+  if (sr->po == &po) {
+    statphase(&b->stats, PS_NONE);
+    sr->po = sj->po;
+  }
+
+  return numitems(b->parts) || *b->errmsg;
+}
+
+
+static void runbatch(void *arg, int task)
+
+/* Reformats batch number task of the streamjob *arg, leaving the */
+/* result in its text output.                                     */
+{
+  streamjob *sj = arg;
+  batch *b = sj->batches + task % sj->window;
+  paropts po = *sj->po;
+  part *pt;
+  errmsg_t errmsg = { '\0' };
+
+  if (po.stats) po.stats = &b->stats;
+  po.cache = NULL;
+  clearoutput(b->text);
+  rewindbuffer(b->parts);
+  while ((pt = nextitem(b->parts)) != NULL) {
+    if (pt->literal) outchars(b->text, pt->literal, pt->litlen, errmsg);
+    if (!*errmsg && pt->inlines)
+      formatsaved(pt->inlines, pt->props, &po, b->text,
+                  b->scratch, errmsg);
+    if (*errmsg) {
+      strcpy(b->errmsg,errmsg);
+      break;
+    }
+  }
+  freeparts(b->parts, sj->sr->in);
+  PHASE(po.stats,PS_NONE);
+}
+
+
+static void formatstream(
+  input *in, output *out, const paropts *po, int jobs, errmsg_t errmsg
+)
+/* Does the same as formatinput(in,out,po,NULL,errmsg), but in a    */
+/* pipeline: one thread reads segments, jobs threads reformat them, */
+/* and the calling thread writes the results in order, flushing     */
+/* *out after each batch.  At most a few batches per thread are     */
+/* held in memory at once.                                          */
+{
+  segreader sr;
+  streamjob sj;
+  batch *b;
+  pool *p = NULL;
+  int i, task;
+
+  sr.in = in, sr.po = po;
+  sr.sawnonblank = sr.oweblank = 0;
+
+  sj.po = po;
+  sj.sr = &sr;
+  sj.window = 4 * jobs;
+  sj.done = 0;
+  sj.batches = calloc(sj.window, sizeof (batch));
+  if (!sj.batches) {
+    strcpy(errmsg,outofmem);
+    return;
+  }
+  for (i = 0;  i < sj.window;  ++i) {
+    b = sj.batches + i;
+    b->parts = newbuffer(sizeof (part), errmsg);
+    if (*errmsg) goto pscleanup;
+    b->text = newmemoutput(errmsg);
+    if (*errmsg) goto pscleanup;
+    b->scratch = newarena(errmsg);
+    if (*errmsg) goto pscleanup;
+  }
+
+  p = startstream(sj.window, jobs, producebatch, runbatch, &sj, errmsg);
+  if (*errmsg) goto pscleanup;
+
+  /* If the work is being counted, the time spent waiting for each  */
+  /* batch is not, and the work done for it is added in once it is  */
+  /* written, when no other thread uses it.  The input it was read  */
+  /* from is released then too, since every later batch lies after  */
+  /* it:                                                            */
+
+  for (task = 0;  waittask(p,task);  ++task) {
+    b = sj.batches + task % sj.window;
+    if (po->stats) {
+      addstats(po->stats, &b->stats);
+      statphase(po->stats, PS_OUTPUT);
+    }
+    outoutput(out, b->text, errmsg);
+    if (!*errmsg) flushoutput(out,errmsg);
+    PHASE(po->stats,PS_NONE);
+    if (!*errmsg && *b->errmsg) strcpy(errmsg, b->errmsg);
+    if (*errmsg) break;
+    inrelease(in, b->end);
+    releasetask(p,task);
+  }
+
+pscleanup:
+
+  if (p) endpool(p);
+  for (i = 0;  i < sj.window;  ++i) {
+    b = sj.batches + i;
+    if (b->parts) {
+      freeparts(b->parts,in);
+      freebuffer(b->parts);
+    }
+    if (b->text) freeoutput(b->text);
+    if (b->scratch) freearena(b->scratch);
+  }
+  free(sj.batches);
+}
+
+
+typedef struct filejob {
+  const paropts *po;              /* The options for every file.    */
+  const char * const *files;      /* The names of the files.        */
+  output **outs;                  /* outs[i] holds the output for   */
+                                  /* file i until it is written.    */
+  char (*errmsgs)[errmsg_size];   /* errmsgs[i] is for file i.      */
+  parstats *stats;                /* stats[i] counts the work for   */
+                                  /* file i, or stats is NULL.      */
+} filejob;
+
+
+static void runfilejob(void *arg, int i)
+
+/* Reformats file i of the filejob *arg into a memory output. */
+{
+  filejob *fj = arg;
+  paropts po = *fj->po;
+  input *in;
+  char *errmsg = fj->errmsgs[i];
+
+  if (fj->stats) {
+    po.stats = fj->stats + i;
+    clearstats(po.stats);
+  }
+  po.cache = NULL;
+  fj->outs[i] = newmemoutput(errmsg);
+  if (*errmsg) return;
+  if (strcmp(fj->files[i], "-"))
+    in = openinput(fj->files[i], errmsg);
+  else
+    in = newinput(stdin,errmsg);
+  if (*errmsg) return;
+  formatinput(in, fj->outs[i], &po, NULL, errmsg);
+  if (fj->stats) {
+    statphase(po.stats, PS_NONE);
+    po.stats->bytesin += incount(in);
+  }
+  freeinput(in);
+}
+
+
+static void formatfiles(
+  const char * const *files, int numfiles, int jobs, const paropts *po,
+  output *out, errmsg_t errmsg
+)
+/* Reformats the numfiles files named in files, each one separately, */
+/* using jobs threads, and writes the results to *out in order, just */
+/* as if they had been reformatted one at a time.  *out is flushed   */
+/* after each file.                                                  */
+{
+  filejob fj;
+  pool *p = NULL;
+  int i;
+
+  fj.po = po;
+  fj.files = files;
+  fj.outs = calloc(numfiles, sizeof (output *));
+  fj.errmsgs = calloc(numfiles, errmsg_size);
+  fj.stats =  po->stats  ?  calloc(numfiles, sizeof (parstats))  :  NULL;
+  if (!fj.outs || !fj.errmsgs || (po->stats && !fj.stats)) {
+    strcpy(errmsg,outofmem);
+    goto pfcleanup;
+  }
+
+  p = startpool(numfiles, jobs, runfilejob, &fj, errmsg);
+  if (*errmsg) goto pfcleanup;
+
+  for (i = 0;  i < numfiles;  ++i) {
+    waittask(p,i);
+    if (po->stats) {
+      addstats(po->stats, fj.stats + i);
+      statphase(po->stats, PS_OUTPUT);
+    }
+    if (fj.outs[i]) {
+      outoutput(out, fj.outs[i], errmsg);
+      freeoutput(fj.outs[i]);
+      fj.outs[i] = NULL;
+      if (!*errmsg) flushoutput(out,errmsg);
+    }
+    PHASE(po->stats,PS_NONE);
+    if (!*errmsg && *fj.errmsgs[i]) strcpy(errmsg, fj.errmsgs[i]);
+    if (*errmsg) break;
+  }
+
+pfcleanup:
+
+  if (p) endpool(p);
+  if (fj.outs) {
+    for (i = 0;  i < numfiles;  ++i)
+      if (fj.outs[i]) freeoutput(fj.outs[i]);
+    free(fj.outs);
+  }
+  if (fj.errmsgs) free(fj.errmsgs);
+  if (fj.stats) free(fj.stats);
+}
+
+
+
+
+static char *putcharset(char *p, const charset *cset)
+
+/* Writes the members of *cset into the CSBYTES characters at p, */
+/* one bit for each character, and returns p + CSBYTES.          */
+{
+  int c;
+
+  memset(p, 0, CSBYTES);
+  for (c = 0;  c <= UCHAR_MAX;  ++c)
+    if (csmember((char) c, cset)) p[c / 8] |= 1 << c % 8;
+
+  return p + CSBYTES;
+}
+
+
+static size_t makeoptkey(const paropts *po, char *key)
+
+/* Writes into key, which must have room for OPTKEYSIZE characters, */
+/* the beginning of every key for a diskcache under the options in  */
+/* *po, and returns its length.  It holds the values of all the     */
+/* parameters, and the members of all the sets of characters, so    */
+/* that segments reformatted differently never share a key.         */
+{
+  const charset *sets[7];
+  char *p = key;
+  int i;
+
+  sets[0] = po->bodychars, sets[1] = po->protectchars;
+  sets[2] = po->quotechars, sets[3] = po->whitechars;
+  sets[4] = po->terminalchars, sets[5] = po->alnumchars;
+  sets[6] = po->lowerchars;
+
+  strcpy(p, "par1.54");
+  p += strlen(p);
+  sprintf(p, " %d %d %d %d %d %d %d %d %d %d",
+          po->hang, po->prefix, po->repeat, po->suffix, po->Tab,
+          po->width, po->body, po->cap, po->div, po->expel);
+  p += strlen(p);
+  sprintf(p, " %d %d %d %d %d %d %d %d %d %d\n",
+          po->fit, po->guess, po->invis, po->just, po->last, po->quote,
+          po->Report, po->touch, po->utf8, po->reference);
+  p += strlen(p);
+
+  for (i = 0;  i < 7;  ++i) p = putcharset(p, sets[i]);
+
+  return p - key;
+}
+
+
+static void getopts(parctx *ctx, paropts *po, errmsg_t errmsg)
+
+/* Checks the options of *ctx as parcheck() does, and copies */
+/* them into *po, with the default for touch filled in, and  */
+/* with the stats and caches of *ctx (if any).               */
+{
+  parcheck(ctx,errmsg);
+  if (*errmsg) return;
+
+  *po = ctx->po;
+  if (po->touch < 0) po->touch = po->fit || po->last;
+  po->stats = ctx->stats;
+  po->cache = ctx->cache;
+  po->dcache = ctx->dcache;
+  po->memo = NULL;
+  if (ctx->dcache) {
+    ctx->optkeylen = makeoptkey(po, ctx->optkey);
+    po->optkey = ctx->optkey;
+    po->optkeylen = ctx->optkeylen;
+  }
+}
+
+
+static void endstats(
+  parstats *st, const input *in, unsigned long inbefore, output *out,
+  unsigned long outbefore, errmsg_t errmsg
+)
+/* Finishes counting the work of a call that read *in (unless in is  */
+/* NULL) and wrote *out, whose counts were inbefore and outbefore    */
+/* when it began: flushes *out, unless *errmsg is set, counting the  */
+/* time as output, and adds the characters read and written to *st.  */
+{
+  if (!*errmsg) {
+    statphase(st, PS_OUTPUT);
+    flushoutput(out,errmsg);
+  }
+  statphase(st, PS_NONE);
+  if (in) st->bytesin += incount(in) - inbefore;
+  st->bytesout += outcount(out) - outbefore;
+}
+
+
+void parinput(parctx *ctx, input *in, output *out, errmsg_t errmsg)
+{
+  paropts po;
+  unsigned long inbefore, outbefore;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return;
+  inbefore = incount(in), outbefore = outcount(out);
+
+  if (ctx->jobs > 1)
+    formatstream(in, out, &po, ctx->jobs, errmsg);
+  else
+    formatinput(in, out, &po, ctx->scratch, errmsg);
+
+  if (po.stats) endstats(po.stats, in, inbefore, out, outbefore, errmsg);
+}
+
+
+char *parformat(
+  parctx *ctx, const char *text, size_t len, size_t *plen, errmsg_t errmsg
+)
+{
+  input *in;
+  size_t n;
+
+  *plen = 0;
+
+  in = newmeminput(text, len, errmsg);
+  if (*errmsg) return NULL;
+  clearoutput(ctx->text);
+  parinput(ctx, in, ctx->text, errmsg);
+  freeinput(in);
+  if (*errmsg) return NULL;
+
+  /* The result is kept for the next call, and replaced */
+  /* only when it is too small, doubling its size:      */
+
+  n = outlength(ctx->text);
+  if (n >= ctx->size) {
+    if (ctx->result) free(ctx->result);
+    ctx->size =  2 * ctx->size > n  ?  2 * ctx->size  :  n + 1;
+    ctx->result = malloc(ctx->size);
+    if (!ctx->result) {
+      ctx->size = 0;
+      strcpy(errmsg,outofmem);
+      return NULL;
+    }
+  }
+  copyoutputto(ctx->text, ctx->result);
+  ctx->result[n] = '\0';
+  clearoutput(ctx->text);
+
+  *plen = n;
+  return ctx->result;
+}
+
+
+void parfiles(
+  parctx *ctx, const char * const *files, int numfiles, output *out,
+  errmsg_t errmsg
+)
+{
+  paropts po;
+  input *in;
+  int i;
+  unsigned long outbefore;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return;
+
+  if (ctx->jobs > 1 && numfiles > 1) {
+    outbefore = outcount(out);
+    formatfiles(files, numfiles, ctx->jobs, &po, out, errmsg);
+    if (po.stats) endstats(po.stats, NULL, 0, out, outbefore, errmsg);
+    return;
+  }
+
+  for (i = 0;  i < numfiles;  ++i) {
+    if (strcmp(files[i], "-"))
+      in = openinput(files[i], errmsg);
+    else
+      in = newinput(stdin,errmsg);
+    if (*errmsg) return;
+    parinput(ctx, in, out, errmsg);
+    freeinput(in);
+    if (*errmsg) return;
+  }
+}
+
+
+static int addrecord(parctx *ctx, size_t *plen, const char *chars, size_t n)
+
+/* Appends the n characters starting at chars to the *plen held in */
+/* ctx->record, growing it if need be, and adds n to *plen.        */
+/* Returns 1, or 0 if there is not enough memory.                  */
+{
+  char *record;
+  size_t size;
+
+  if (*plen + n > ctx->recsize) {
+    size =  2 * ctx->recsize > *plen + n  ?  2 * ctx->recsize  :  *plen + n;
+    record = malloc(size);
+    if (!record) return 0;
+    if (ctx->record) {
+      memcpy(record, ctx->record, *plen);
+      free(ctx->record);
+    }
+    ctx->record = record;
+    ctx->recsize = size;
+  }
+  memcpy(ctx->record + *plen, chars, n);
+  *plen += n;
+
+  return 1;
+}
+
+
+static int readrecord(
+  parctx *ctx, input *in, char framing, const char **pchars,
+  size_t *plen, size_t *pskip, errmsg_t errmsg
+)
+/* Reads the next record from *in, framed as described for         */
+/* parrecords(), setting *pchars to point to its characters and    */
+/* *plen to their number.  If the record lies within one span of   */
+/* *in, the characters are left there, and *pskip is set to the    */
+/* number that the caller must consume with inskip() once it is    */
+/* done with them.  Otherwise they are copied to ctx->record, and  */
+/* *pskip is set to 0.  Returns 1, or 0 at the end of the input or */
+/* on failure.                                                     */
+{
+  const char *span, *nul;
+  size_t n, len = 0, got = 0, want;
+  int d, digits = 0;
+
+  *errmsg = '\0';
+  *pchars = NULL;
+  *plen = *pskip = 0;
+
+  span = inspan(in,&n);
+  if (!n) return 0;
+
+  if (framing == 'n') {
+    nul = memchr(span, '\0', n);
+    if (nul) {
+      *pchars = span;
+      *plen = nul - span;
+      *pskip = *plen + 1;
+      return 1;
+    }
+    do {
+      nul = memchr(span, '\0', n);
+      want =  nul  ?  (size_t) (nul - span)  :  n;
+      if (!addrecord(ctx, &got, span, want)) goto nomem;
+      inskip(in,  nul  ?  want + 1  :  want);
+      if (nul) break;
+      span = inspan(in,&n);
+    } while (n);
+    *pchars = ctx->record;
+    *plen = got;
+    return 1;
+  }
+
+  /* Otherwise the record is preceded by its length and a newline: */
+
+  while (n && *span != '\n') {
+    d = digtoint(*span);
+    if (d < 0 || ++digits > 9) break;
+    len = 10 * len + d;
+    inskip(in,1);
+    span = inspan(in,&n);
+  }
+  if (!n || *span != '\n' || !digits) {
+    strcpy(errmsg, "Bad record length.\n");
+    return 0;
+  }
+  inskip(in,1);
+  span = inspan(in,&n);
+
+  if (n >= len) {
+    *pchars = span;
+    *plen = *pskip = len;
+    return 1;
+  }
+  while (got < len) {
+    if (!n) {
+      strcpy(errmsg, "Input ends within a record.\n");
+      return 0;
+    }
+    want =  n < len - got  ?  n  :  len - got;
+    if (!addrecord(ctx, &got, span, want)) goto nomem;
+    inskip(in,want);
+    if (got < len) span = inspan(in,&n);
+  }
+  *pchars = ctx->record;
+  *plen = len;
+  return 1;
+
+nomem:
+
+  strcpy(errmsg,outofmem);
+  return 0;
+}
+
+
+void parrecords(
+  parctx *ctx, input *in, output *out, char framing, errmsg_t errmsg
+)
+{
+  paropts po;
+  const char *chars;
+  size_t len, skip;
+  char head[16];
+  unsigned long inbefore, outbefore;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return;
+  inbefore = incount(in), outbefore = outcount(out);
+
+  if (!ctx->recin) {
+    ctx->recin = newmeminput(NULL, 0, errmsg);
+    if (*errmsg) return;
+  }
+
+  /* Each record is read through the same input and reformatted */
+  /* with the same arena, so nothing is allocated per record    */
+  /* unless one is too long for the storage kept so far.  The   */
+  /* output is flushed before waiting for the next record, so   */
+  /* that a client can send one and wait for the answer:        */
+
+  for (;;) {
+    if (!inready(in)) {
+      PHASE(po.stats,PS_OUTPUT);
+      flushoutput(out,errmsg);
+      if (*errmsg) break;
+    }
+    PHASE(po.stats,PS_INPUT);
+    if (!readrecord(ctx, in, framing, &chars, &len, &skip, errmsg)) break;
+    resetmeminput(ctx->recin, chars, len);
+
+    if (framing == 'n') {
+      formatinput(ctx->recin, out, &po, ctx->scratch, errmsg);
+      if (*errmsg) break;
+      outchars(out, "", 1, errmsg);
+    }
+    else {
+      formatinput(ctx->recin, ctx->text, &po, ctx->scratch, errmsg);
+      if (*errmsg) {
+        clearoutput(ctx->text);
+        break;
+      }
+      PHASE(po.stats,PS_OUTPUT);
+      sprintf(head, "%lu\n", (unsigned long) outlength(ctx->text));
+      outchars(out, head, strlen(head), errmsg);
+      if (*errmsg) break;
+      outoutput(out, ctx->text, errmsg);
+    }
+    if (*errmsg) break;
+
+    if (skip) inskip(in,skip);
+    inrelease(in, incount(in));
+  }
+
+  if (po.stats) endstats(po.stats, in, inbefore, out, outbefore, errmsg);
+}
+
+
+/* A pardoc keeps its text and output as a series of chunks, each of */
+/* which is what one call to readsegment() reads, and what it and    */
+/* formatsaved() write: any blank and protected lines, and then one  */
+/* segment, except that the last chunk has no segment.  What a chunk */
+/* reads depends only on the state of the segreader when it begins,  */
+/* its own text, and the character just after it (which decides      */
+/* where the segment ends), so an edit need reread only from the     */
+/* first chunk that reads as far as the edit, and only until a chunk */
+/* ends at an old boundary past the edit, in the same state as       */
+/* before.  Everything after that is kept as it was.                 */
+
+/* The size in kilobytes of the cache of paragraphs of a pardoc whose */
+/* options do not give one:                                           */
+
+#define DOCCACHEKB 1024
+
+typedef struct chunk {
+  size_t inlen, outlen;   /* The lengths of its text and its output. */
+  int sawnonblank,        /* The state of the segreader when it      */
+      oweblank;           /* began.                                  */
+} chunk;
+
+struct pardoc {
+  parctx *ctx;            /* A copy of the options, with a cache.      */
+  paropts po;             /* As set by getopts() for ctx, with memo.   */
+  breakmemo *memo;        /* Remembers the last paragraph reformatted. */
+  input *in;              /* Reads the text for each edit.             */
+  output *held;           /* Collects the output of each edit.         */
+  char *text, *out,       /* The text and its output, terminated by    */
+       *saved, *repl;     /* '\0', the text removed by an edit, and    */
+  size_t textlen,         /* the output of an edit, with room for      */
+         textsize,        /* textsize, outsize, savedsize, and         */
+         outlen,          /* replsize characters.                      */
+         outsize,
+         savedsize,
+         replsize;
+  chunk *chunks,          /* The chunks of the text, and those made by */
+        *fresh;           /* an edit, with room for chunksize and      */
+  size_t numchunks,       /* freshsize chunks.                         */
+         chunksize,
+         numfresh,
+         freshsize;
+};
+
+
+static void *enlarge(
+  void *items, size_t *psize, size_t n, size_t itemsize, errmsg_t errmsg
+)
+/* Returns items, an array allocated by malloc() with room for      */
+/* *psize items of itemsize bytes each (items may be NULL if *psize */
+/* is 0), if that is room for n, or else a larger copy of it, made  */
+/* by doubling with realloc(), updating *psize.  On failure, sets   */
+/* *errmsg and returns NULL, leaving items as it was.               */
+{
+  void *p;
+  size_t size;
+
+  *errmsg = '\0';
+  if (n <= *psize) return items;
+
+  size =  2 * *psize > n  ?  2 * *psize  :  n;
+  p = realloc(items, size * itemsize);
+  if (!p) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  *psize = size;
+
+  return p;
+}
+
+
+pardoc *newpardoc(
+  const parctx *ctx, const char *text, size_t len, errmsg_t errmsg
+)
+{
+  pardoc *doc;
+  size_t start, end, n;
+
+  doc = calloc(1, sizeof (pardoc));
+  if (!doc) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+
+  doc->ctx = copyparctx(ctx,errmsg);
+  if (*errmsg) goto ndcleanup;
+  if (!doc->ctx->cache) {
+    doc->ctx->cache = newcache((size_t) DOCCACHEKB * 1024, errmsg);
+    if (*errmsg) goto ndcleanup;
+    doc->ctx->cachekb = DOCCACHEKB;
+  }
+  getopts(doc->ctx, &doc->po, errmsg);
+  if (*errmsg) goto ndcleanup;
+  doc->memo = newbreakmemo(errmsg);
+  if (*errmsg) goto ndcleanup;
+  doc->po.memo = doc->memo;
+
+  doc->in = newmeminput(NULL, 0, errmsg);
+  if (*errmsg) goto ndcleanup;
+  doc->held = newmemoutput(errmsg);
+  if (*errmsg) goto ndcleanup;
+
+  /* An empty text is one empty chunk, and */
+  /* the text is inserted into it:         */
+
+  doc->out = enlarge(NULL, &doc->outsize, 1, 1, errmsg);
+  if (*errmsg) goto ndcleanup;
+  *doc->out = '\0';
+  doc->chunks = enlarge(NULL, &doc->chunksize, 1, sizeof (chunk), errmsg);
+  if (*errmsg) goto ndcleanup;
+  memset(doc->chunks, 0, sizeof (chunk));
+  doc->numchunks = 1;
+
+  pardocedit(doc, 0, 0, text, len, &start, &end, &n, errmsg);
+  if (*errmsg) goto ndcleanup;
+
+  return doc;
+
+ndcleanup:
+
+  freepardoc(doc);
+  return NULL;
+}
+
+
+void freepardoc(pardoc *doc)
+{
+  if (doc->ctx) freeparctx(doc->ctx);
+  if (doc->memo) freebreakmemo(doc->memo);
+  if (doc->in) freeinput(doc->in);
+  if (doc->held) freeoutput(doc->held);
+  if (doc->text) free(doc->text);
+  if (doc->out) free(doc->out);
+  if (doc->saved) free(doc->saved);
+  if (doc->repl) free(doc->repl);
+  if (doc->chunks) free(doc->chunks);
+  if (doc->fresh) free(doc->fresh);
+  free(doc);
+}
+
+
+const char *pardocoutput(const pardoc *doc, size_t *plen)
+{
+  *plen = doc->outlen;
+  return doc->out;
+}
+
+
+static int rereadchunk(pardoc *doc, segreader *sr, errmsg_t errmsg)
+
+/* Reads and reformats the next chunk of doc->text from sr->in,  */
+/* writing the output to doc->held.  Returns 1 if the chunk has  */
+/* a segment, or 0 if it is the last one or on failure.          */
+{
+  char **inlines;
+  lineprop *props;
+
+  inlines = readsegment(sr, doc->held, &props, errmsg);
+  if (!inlines) return 0;
+
+  formatsaved(inlines, props, &doc->po, doc->held, doc->ctx->scratch,
+              errmsg);
+  freelines(inlines, sr->in);
+  free(props);
+
+  return !*errmsg;
+}
+
+
+const char *pardocedit(
+  pardoc *doc, size_t start, size_t end, const char *text, size_t len,
+  size_t *pstart, size_t *pend, size_t *plen, errmsg_t errmsg
+)
+{
+  segreader sr;
+  chunk *old, *fr;
+  char *p, *q;
+  size_t i, j, cut = end - start, inpos, outpos, pos, oldend, oldout,
+         newout, n, pre, suf;
+  unsigned long before;
+  int more;
+
+  *errmsg = '\0';
+  *pstart = *pend = *plen = 0;
+
+  if (start > end || end > doc->textlen) {
+    strcpy(errmsg, "Bad range for an edit.\n");
+    return NULL;
+  }
+
+  /* Chunk i is the first that reads as far as start, and  */
+  /* begins at inpos in the text and outpos in the output: */
+
+  old = doc->chunks;
+  for (i = inpos = outpos = 0;
+       i + 1 < doc->numchunks && inpos + old[i].inlen < start;
+       ++i) {
+    inpos += old[i].inlen;
+    outpos += old[i].outlen;
+  }
+
+  /* The removed text is saved, so that it can be put */
+  /* back if the edit fails:                          */
+
+  p = enlarge(doc->saved, &doc->savedsize, cut + 1, 1, errmsg);
+  if (*errmsg) return NULL;
+  doc->saved = p;
+  p = enlarge(doc->text, &doc->textsize, doc->textlen - cut + len + 1, 1,
+              errmsg);
+  if (*errmsg) return NULL;
+  doc->text = p;
+  memcpy(doc->saved, doc->text + start, cut);
+  memmove(doc->text + start + len, doc->text + end, doc->textlen - end);
+  memcpy(doc->text + start, text, len);
+  doc->textlen += len - cut;
+  doc->text[doc->textlen] = '\0';
+
+  /* Reread chunks until one ends where old chunk j did, with */
+  /* old chunk j + 1 (which begins in the same state) kept:   */
+
+  resetmeminput(doc->in, doc->text + inpos, doc->textlen - inpos);
+  before = incount(doc->in);
+  clearoutput(doc->held);
+  sr.in = doc->in, sr.po = &doc->po;
+  sr.sawnonblank = old[i].sawnonblank;
+  sr.oweblank = old[i].oweblank;
+  doc->numfresh = 0;
+  j = i;
+  oldend = inpos + old[i].inlen;
+  pos = inpos;
+
+  for (;;) {
+    fr = enlarge(doc->fresh, &doc->freshsize, doc->numfresh + 1,
+                 sizeof (chunk), errmsg);
+    if (*errmsg) goto pecleanup;
+    doc->fresh = fr;
+    fr += doc->numfresh++;
+    fr->sawnonblank = sr.sawnonblank;
+    fr->oweblank = sr.oweblank;
+    n = outlength(doc->held);
+
+    more = rereadchunk(doc, &sr, errmsg);
+    if (*errmsg) goto pecleanup;
+
+    fr->inlen = inpos + (incount(doc->in) - before) - pos;
+    fr->outlen = outlength(doc->held) - n;
+    pos += fr->inlen;
+    if (!more) {
+      j = doc->numchunks;
+      break;
+    }
+
+    /* An old boundary at oldend is now at oldend - cut + len, */
+    /* if it is not before end:                                */
+
+    while (j + 1 < doc->numchunks && oldend + len < pos + cut)
+      oldend += old[++j].inlen;
+    if (   j + 1 < doc->numchunks && oldend >= end
+        && oldend + len == pos + cut
+        && old[j + 1].sawnonblank == sr.sawnonblank
+        && old[j + 1].oweblank == sr.oweblank) {
+      ++j;
+      break;
+    }
+  }
+
+  /* Old chunks i through j - 1 are replaced, and only the */
+  /* part of their output that differs is reported:        */
+
+  for (oldout = 0, n = i;  n < j;  ++n) oldout += old[n].outlen;
+  newout = outlength(doc->held);
+  p = enlarge(doc->repl, &doc->replsize, newout + 1, 1, errmsg);
+  if (*errmsg) goto pecleanup;
+  doc->repl = p;
+  copyoutputto(doc->held, doc->repl);
+  clearoutput(doc->held);
+
+  n =  oldout < newout  ?  oldout  :  newout;
+  p = doc->out + outpos, q = doc->repl;
+  for (pre = 0;  pre < n && p[pre] == q[pre];  ++pre);
+  for (suf = 0;
+       suf < n - pre && p[oldout - 1 - suf] == q[newout - 1 - suf];
+       ++suf);
+
+  p = enlarge(doc->out, &doc->outsize, doc->outlen - oldout + newout + 1, 1,
+              errmsg);
+  if (*errmsg) goto pecleanup;
+  doc->out = p;
+  old = enlarge(doc->chunks, &doc->chunksize,
+                doc->numchunks - (j - i) + doc->numfresh, sizeof (chunk),
+                errmsg);
+  if (*errmsg) goto pecleanup;
+  doc->chunks = old;
+
+  p = doc->out + outpos;
+  memmove(p + newout, p + oldout, doc->outlen - outpos - oldout);
+  memcpy(p, doc->repl, newout);
+  doc->outlen += newout - oldout;
+  doc->out[doc->outlen] = '\0';
+  memmove(old + i + doc->numfresh, old + j,
+          (doc->numchunks - j) * sizeof (chunk));
+  memcpy(old + i, doc->fresh, doc->numfresh * sizeof (chunk));
+  doc->numchunks += doc->numfresh - (j - i);
+
+  *pstart = outpos + pre;
+  *pend = outpos + oldout - suf;
+  *plen = newout - pre - suf;
+  return doc->out + outpos + pre;
+
+pecleanup:
+
+  clearoutput(doc->held);
+  memmove(doc->text + start + cut, doc->text + start + len,
+          doc->textlen - start - len);
+  memcpy(doc->text + start, doc->saved, cut);
+  doc->textlen += cut - len;
+  doc->text[doc->textlen] = '\0';
+
+  return NULL;
+}
+
+
+/* A segment can begin at the beginning of any line that is blank or  */
+/* protected, or that follows such a line, and reformatting from such */
+/* a place depends on nothing before it except the state of the       */
+/* segreader there, so a parindex records some of these places, one   */
+/* at least INDEXSTRIDE characters after another, each with its state */
+/* and the number of lines before it.  Only places where no vacant    */
+/* line is owed for <expel> are recorded, so that the blank lines     */
+/* that the vacant line replaces are never copied as well.  Finding   */
+/* the places requires looking only at the beginning of each line     */
+/* (and all of a blank one), which is far less work than              */
+/* reformatting.                                                      */
+
+#define INDEXSTRIDE 1048576
+
+/* The characters in the part of a key for a parindex made from */
+/* the options (see indexkey()):                                */
+
+#define INDEXKEYSIZE (2 * CSBYTES + 1)
+
+typedef struct syncpoint {
+  unsigned long offset,   /* The numbers of characters and of lines  */
+                line;     /* before a place where a segment can      */
+  int sawnonblank,        /* begin, and the state of the segreader   */
+      oweblank;           /* there.                                  */
+} syncpoint;
+
+struct parindex {
+  int known;              /* Set if size and mtime identify the file */
+  unsigned long size,     /* indexed (see inidentify()).             */
+                mtime;
+  char key[INDEXKEYSIZE]; /* Made by indexkey() for the options.     */
+  syncpoint *points;      /* The places recorded, in order, with     */
+  size_t numpoints,       /* room for pointsize of them.             */
+         pointsize;
+};
+
+
+static void indexkey(const paropts *po, char *key)
+
+/* Writes into key, which must have room for INDEXKEYSIZE characters, */
+/* the protective and white characters of *po and its expel           */
+/* parameter, which are all the options that a parindex depends on.   */
+{
+  key = putcharset(key, po->protectchars);
+  key = putcharset(key, po->whitechars);
+  *key = po->expel;
+}
+
+
+static int scanline(input *in, const paropts *po, syncpoint *at)
+
+/* Consumes the next line of *in, through its newline if it has one,  */
+/* where *at describes the beginning of the line, and updates *at to  */
+/* describe its end, changing the state just as readsegment() would.  */
+/* Returns 0 if there is no next line, 2 if it is blank or protected  */
+/* (as readlines() and readsegment() decide), or 1 otherwise.         */
+{
+  const char *span, *nl, *end, *p;
+  size_t n, k;
+  int blank = 1, protect, spacewhite;
+
+  span = inspan(in,&n);
+  if (!n) return 0;
+
+  spacewhite = csmember(' ', po->whitechars);
+  protect = *span != '\n' && csmember(*span, po->protectchars);
+  for (;;) {
+    nl = memchr(span, '\n', n);
+    end =  nl  ?  nl  :  span + n;
+    for (p = span;  blank && p < end;  ++p)
+      if (  *p == ' '  ?  !spacewhite
+          : *p && *p != '\t' && !csmember(*p, po->whitechars))
+        blank = 0;
+    k = end - span + (nl != NULL);
+    inskip(in,k);
+    at->offset += k;
+    if (nl) break;
+    span = inspan(in,&n);
+    if (!n) break;
+  }
+  ++at->line;
+
+  if (blank && !protect) {
+    if (po->expel) {
+      at->oweblank = at->sawnonblank;
+      return 2;
+    }
+    if (!csmember('\n', po->protectchars)) return 2;
+  }
+  at->sawnonblank = 1;
+  at->oweblank = 0;
+
+  return  blank || protect  ?  2  :  1;
+}
+
+
+static int addpoint(parindex *ix, const syncpoint *sp, errmsg_t errmsg)
+
+/* Appends *sp to the places recorded in *ix.  Returns 1 on */
+/* success, or 0 on failure.                                */
+{
+  syncpoint *points;
+
+  points = enlarge(ix->points, &ix->pointsize, ix->numpoints + 1,
+                   sizeof (syncpoint), errmsg);
+  if (*errmsg) return 0;
+  ix->points = points;
+  ix->points[ix->numpoints++] = *sp;
+
+  return 1;
+}
+
+
+parindex *newparindex(parctx *ctx, input *in, errmsg_t errmsg)
+{
+  paropts po;
+  parindex *ix;
+  syncpoint at, here;
+  unsigned long next = INDEXSTRIDE;
+  int kind, gap = 1;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return NULL;
+
+  ix = calloc(1, sizeof (parindex));
+  if (!ix) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  ix->known = inidentify(in, &ix->size, &ix->mtime);
+  indexkey(&po, ix->key);
+
+  at.offset = at.line = 0;
+  at.sawnonblank = at.oweblank = 0;
+  if (!addpoint(ix, &at, errmsg)) goto nicleanup;
+
+  PHASE(po.stats,PS_INPUT);
+  for (;;) {
+    here = at;
+    kind = scanline(in, &po, &at);
+    if (!kind) break;
+    if ((gap || kind == 2) && !here.oweblank && here.offset >= next) {
+      if (!addpoint(ix, &here, errmsg)) goto nicleanup;
+      next = here.offset + INDEXSTRIDE;
+    }
+    gap = kind == 2;
+  }
+  PHASE(po.stats,PS_NONE);
+
+  return ix;
+
+nicleanup:
+
+  PHASE(po.stats,PS_NONE);
+  freeparindex(ix);
+  return NULL;
+}
+
+
+void freeparindex(parindex *ix)
+{
+  if (ix->points) free(ix->points);
+  free(ix);
+}
+
+
+void writeparindex(const parindex *ix, output *out, errmsg_t errmsg)
+{
+  char line[80];
+  const syncpoint *sp;
+  int i;
+
+  sprintf(line, "par index 1\n%d %lu %lu\n", ix->known, ix->size, ix->mtime);
+  outchars(out, line, strlen(line), errmsg);
+  if (*errmsg) return;
+  for (i = 0;  i < INDEXKEYSIZE;  ++i) {
+    sprintf(line, "%02x", *(const unsigned char *) &ix->key[i]);
+    outchars(out, line, 2, errmsg);
+    if (*errmsg) return;
+  }
+  outchars(out, "\n", 1, errmsg);
+  if (*errmsg) return;
+
+  for (sp = ix->points;  sp < ix->points + ix->numpoints;  ++sp) {
+    sprintf(line, "%lu %lu %d\n", sp->offset, sp->line, sp->sawnonblank);
+    outchars(out, line, strlen(line), errmsg);
+    if (*errmsg) return;
+  }
+}
+
+
+parindex *readparindex(
+  parctx *ctx, input *in, const input *text, errmsg_t errmsg
+)
+{
+  paropts po;
+  buffer *cbuf = NULL;
+  parindex *ix = NULL;
+  syncpoint sp, *last;
+  const char *span;
+  char *chars = NULL, *p, nullchar = '\0', key[INDEXKEYSIZE];
+  size_t n;
+  unsigned long size, mtime;
+  unsigned int c;
+  int i, k;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return NULL;
+
+  cbuf = newbuffer(sizeof (char), errmsg);
+  if (*errmsg) goto ricleanup;
+  for (;;) {
+    span = inspan(in,&n);
+    if (!n) break;
+    additems(cbuf, span, n, errmsg);
+    if (*errmsg) goto ricleanup;
+    inskip(in,n);
+  }
+  additem(cbuf, &nullchar, errmsg);
+  if (*errmsg) goto ricleanup;
+  chars = copyitems(cbuf,errmsg);
+  if (*errmsg) goto ricleanup;
+
+  ix = calloc(1, sizeof (parindex));
+  if (!ix) {
+    strcpy(errmsg,outofmem);
+    goto ricleanup;
+  }
+
+  /* An empty file, or an index for another file, or another      */
+  /* version of it, or for other options, is not an error, but no */
+  /* index is returned.  The places must be in order:             */
+
+  p = chars;
+  if (!*p) goto ristale;
+  if (   strncmp(p, "par index 1\n", 12)
+      || sscanf(p += 12, "%d %lu %lu\n%n", &ix->known, &ix->size,
+                &ix->mtime, &k) < 3)
+    goto ribad;
+  for (p += k, i = 0;  i < INDEXKEYSIZE;  ++i, p += 2) {
+    if (sscanf(p, "%2x", &c) < 1) goto ribad;
+    ix->key[i] = c;
+  }
+  if (*p++ != '\n') goto ribad;
+
+  while (*p) {
+    if (   sscanf(p, "%lu %lu %d\n%n", &sp.offset, &sp.line,
+                  &sp.sawnonblank, &k) < 3
+        || (unsigned) sp.sawnonblank > 1)
+      goto ribad;
+    sp.oweblank = 0;
+    last =  ix->numpoints  ?  ix->points + ix->numpoints - 1  :  NULL;
+    if (  last  ?  sp.offset <= last->offset || sp.line <= last->line
+               :  sp.offset || sp.line || sp.sawnonblank)
+      goto ribad;
+    if (!addpoint(ix, &sp, errmsg)) goto ricleanup;
+    p += k;
+  }
+  if (!ix->numpoints) goto ribad;
+
+  indexkey(&po, key);
+  if (   ix->known && inidentify(text, &size, &mtime)
+      && size == ix->size && mtime == ix->mtime
+      && !memcmp(key, ix->key, INDEXKEYSIZE))
+    goto ricleanup;
+
+ristale:
+
+  freeparindex(ix);
+  ix = NULL;
+  goto ricleanup;
+
+ribad:
+
+  strcpy(errmsg, "The index file was not made by par.\n");
+
+ricleanup:
+
+  if (*errmsg && ix) {
+    freeparindex(ix);
+    ix = NULL;
+  }
+  if (chars) free(chars);
+  if (cbuf) freebuffer(cbuf);
+
+  return ix;
+}
+
+
+static void copyinput(input *in, output *out, errmsg_t errmsg)
+
+/* Copies *in to *out until *in ends (or seems to, see inlimit()). */
+{
+  const char *span;
+  size_t n;
+
+  *errmsg = '\0';
+
+  for (;;) {
+    span = inspan(in,&n);
+    if (!n) break;
+    outchars(out, span, n, errmsg);
+    if (*errmsg) break;
+    inskip(in,n);
+  }
+}
+
+
+void parregion(
+  parctx *ctx, input *in, const parindex *ix, unsigned long start,
+  unsigned long end, output *out, errmsg_t errmsg
+)
+{
+  paropts po;
+  segreader sr;
+  syncpoint at, here, from;
+  size_t lo, hi, mid;
+  char key[INDEXKEYSIZE];
+  unsigned long outbefore;
+  int kind, gap = 1;
+
+  getopts(ctx, &po, errmsg);
+  if (*errmsg) return;
+  outbefore = outcount(out);
+
+  /* Begin at the last place recorded in the index before the first */
+  /* line, and find the last place a segment can begin before it    */
+  /* where no vacant line is owed, and the first place a segment    */
+  /* can begin after the last line:                                 */
+
+  at.offset = at.line = 0;
+  at.sawnonblank = at.oweblank = 0;
+  if (ix) indexkey(&po, key);
+  if (ix && !memcmp(key, ix->key, INDEXKEYSIZE)) {
+    for (lo = 0, hi = ix->numpoints;  hi - lo > 1;  ) {
+      mid = lo + (hi - lo) / 2;
+      if (ix->points[mid].line < start) lo = mid;
+      else hi = mid;
+    }
+    at = ix->points[lo];
+  }
+
+  PHASE(po.stats,PS_INPUT);
+  if (!inseek(in, at.offset)) goto prcantseek;
+  from = at;
+  for (;;) {
+    here = at;
+    kind = scanline(in, &po, &at);
+    if (gap || kind != 1) {
+      if (here.line < start) {
+        if (!here.oweblank) from = here;
+      }
+      else if (here.line >= end) break;
+    }
+    if (!kind) break;
+    gap = kind == 2;
+  }
+
+  /* Copy the text before the region, reformat the region, */
+  /* and copy the text after it:                           */
+
+  if (!inseek(in,0)) goto prcantseek;
+  inlimit(in, from.offset);
+  PHASE(po.stats,PS_OUTPUT);
+  copyinput(in, out, errmsg);
+  if (*errmsg) goto prcleanup;
+
+  inlimit(in, here.offset);
+  sr.in = in, sr.po = &po;
+  sr.sawnonblank = from.sawnonblank, sr.oweblank = from.oweblank;
+  formatsegments(&sr, out, ctx->scratch, errmsg);
+  if (*errmsg) goto prcleanup;
+
+  inlimit(in, (unsigned long) -1);
+  PHASE(po.stats,PS_OUTPUT);
+  copyinput(in, out, errmsg);
+
+  goto prcleanup;
+
+prcantseek:
+
+  strcpy(errmsg, "Cannot seek in the input.\n");
+
+prcleanup:
+
+  inlimit(in, (unsigned long) -1);
+  if (po.stats) endstats(po.stats, in, 0, out, outbefore, errmsg);
+}
@@ -0,0 +1,295 @@
+/*
+libpar.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+The functions declared here do everything par does, except for
+reading its environment variables and command line, so that a
+program can reformat text without running par for each piece of it.
+
+A parctx holds a set of options, the charsets they name, and storage
+that is reused from one call to the next.  A parctx must not be used
+by more than one thread at a time, but separate parctxs may be used by
+separate threads at once.  Nothing is shared between them, and once a
+parctx has been set up, reformatting does not depend on the locale or
+on any other global state.
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef LIBPAR_H
+#define LIBPAR_H
+
+#include "errmsg.h"
+#include "input.h"
+#include "output.h"
+
+#include <stddef.h>
+
+
+typedef struct parctx parctx;
+
+
+parctx *newparctx(errmsg_t errmsg);
+
+  /* newparctx(errmsg) returns a pointer to a new parctx whose     */
+  /* options are as if par had been run with no arguments and with */
+  /* none of its environment variables set.  Classes of characters */
+  /* (see "charset syntax" in par.doc) are resolved in the current */
+  /* locale, both here and whenever a charset is later given to    */
+  /* the parctx, so the locale should be set first.  Returns NULL  */
+  /* on failure.                                                   */
+
+
+parctx *copyparctx(const parctx *ctx, errmsg_t errmsg);
+
+  /* copyparctx(ctx,errmsg) returns a pointer to a new parctx with   */
+  /* the same options as *ctx, but storage of its own, so that it    */
+  /* can be used by another thread.  Returns NULL on failure.        */
+
+
+void freeparctx(parctx *ctx);
+
+  /* freeparctx(ctx) frees the memory associated with *ctx,  */
+  /* including the text last returned by parformat().  ctx   */
+  /* may not be used after this call.                        */
+
+
+void parsetchars(parctx *ctx, char which, const char *set, errmsg_t errmsg);
+
+  /* parsetchars(ctx,which,set,errmsg) replaces the body, protective,  */
+  /* quote, white, or terminal characters of *ctx, according to        */
+  /* whether which is 'B', 'P', 'Q', 'W', or 'Z', by the set defined   */
+  /* by set using charset syntax, as par does with the value of the    */
+  /* corresponding environment variable.  On failure, *ctx is not      */
+  /* changed.                                                          */
+
+
+int paroption(
+  parctx *ctx, const char * const *args, int *phelp, int *pversion,
+  int *pErr, errmsg_t errmsg
+);
+  /* paroption(ctx,args,phelp,pversion,pErr,errmsg) applies to *ctx   */
+  /* the option in args[0], as par does with an argument on its       */
+  /* command line or a word in PARINIT, and returns the number of     */
+  /* elements of args it used, which is 2 if args[0] is "--jobs" or   */
+  /* "--cache", whose value is in args[1], or 1 otherwise.  args must */
+  /* have a NULL element after the last one.  The help, version, and  */
+  /* E options don't affect reformatting, and set *phelp, *pversion,  */
+  /* and *pErr instead.  *phelp is also set to 1 if args[0] is not a  */
+  /* valid option.  The -- and --files0 options are not recognized.   */
+  /* The cache made by --cache belongs to *ctx, and is used only by   */
+  /* the thread calling the functions below, not by those they start  */
+  /* for --jobs.  It is emptied whenever a set of characters changes, */
+  /* and copyparctx() gives the copy an empty cache of its own.       */
+
+
+int parjobs(const parctx *ctx);
+
+  /* parjobs(ctx) returns the number given by the --jobs option */
+  /* of *ctx, which is 1 if there was none.                     */
+
+
+void setparjobs(parctx *ctx, int jobs);
+
+  /* setparjobs(ctx,jobs) sets the number that parjobs() returns. */
+  /* jobs must be positive.                                       */
+
+
+void setparstats(parctx *ctx, int on, errmsg_t errmsg);
+
+  /* setparstats(ctx,on,errmsg) makes the functions below count the  */
+  /* work they do with *ctx, and time each phase of it, starting     */
+  /* from zero, if on is non-zero, or stop counting if on is 0.      */
+  /* While they count, parinput(), parfiles(), and parrecords()      */
+  /* flush *out before returning, so that the time taken to write    */
+  /* the output is counted.  copyparctx() does not copy the counts,  */
+  /* and a copy does not count.                                      */
+
+
+void setpardiskcache(parctx *ctx, const char *dir, int mb, errmsg_t errmsg);
+
+  /* setpardiskcache(ctx,dir,mb,errmsg) makes the functions below look */
+  /* for each segment in the cache kept in the directory dir (see      */
+  /* opendiskcache() in diskcache.h, and the --cache-dir option in     */
+  /* par.doc) before reformatting it, and save it there if it is not   */
+  /* found, or stop using any such cache if dir is NULL.  The threads  */
+  /* started for --jobs use it too.  copyparctx() does not copy it.    */
+  /* On failure, *ctx is not changed.                                  */
+
+
+void putparstats(const parctx *ctx, output *out, errmsg_t errmsg);
+
+  /* putparstats(ctx,out,errmsg) writes what has been counted for    */
+  /* *ctx to *out, as par does for the --stats option (see par.doc), */
+  /* or nothing if *ctx is not counting.                             */
+
+
+void parcheck(const parctx *ctx, errmsg_t errmsg);
+
+  /* parcheck(ctx,errmsg) sets *errmsg if the options of *ctx are */
+  /* inconsistent.  The functions below check them anyway, but    */
+  /* calling parcheck() after setting them reports a problem      */
+  /* before any text is given.                                    */
+
+
+char *parformat(
+  parctx *ctx, const char *text, size_t len, size_t *plen, errmsg_t errmsg
+);
+  /* parformat(ctx,text,len,plen,errmsg) reformats the len characters */
+  /* starting at text, which need not be terminated, according to     */
+  /* the options of *ctx, and returns a pointer to the result, which  */
+  /* is terminated by '\0', setting *plen to its length.  The result  */
+  /* belongs to *ctx and remains valid until the next call with ctx.  */
+  /* Returns NULL on failure.                                         */
+
+
+void parinput(parctx *ctx, input *in, output *out, errmsg_t errmsg);
+
+  /* parinput(ctx,in,out,errmsg) reads *in until EOF and writes the */
+  /* reformatted text to *out, according to the options of *ctx.    */
+  /* If the --jobs option has given a number greater than 1, the    */
+  /* reading, reformatting, and writing are done in a pipeline of   */
+  /* threads, and *out is flushed as each batch of segments is      */
+  /* written.                                                       */
+
+
+void parfiles(
+  parctx *ctx, const char * const *files, int numfiles, output *out,
+  errmsg_t errmsg
+);
+  /* parfiles(ctx,files,numfiles,out,errmsg) reformats the numfiles   */
+  /* files named in files (with "-" naming the standard input) one    */
+  /* after another, as parinput() would, and writes the results to    */
+  /* *out in order.  If the --jobs option has given a number greater  */
+  /* than 1, up to that many files are reformatted at once, and *out  */
+  /* is flushed after each.                                           */
+
+
+void parrecords(
+  parctx *ctx, input *in, output *out, char framing, errmsg_t errmsg
+);
+  /* parrecords(ctx,in,out,framing,errmsg) reads *in until EOF as a    */
+  /* series of independent records, and writes each one, reformatted   */
+  /* as parinput() would reformat it alone, to *out, framed the same   */
+  /* way.  If framing is 'n', each record is terminated by a NUL       */
+  /* character (the last terminator may be omitted on input).  If      */
+  /* framing is 'l', each record is preceded by its length, a decimal  */
+  /* number of at most 9 digits, and a newline.  Records are           */
+  /* reformatted one at a time, whatever the --jobs option has given,  */
+  /* and *out is flushed whenever the next record is not yet           */
+  /* available.                                                        */
+
+
+typedef struct pardoc pardoc;
+
+
+pardoc *newpardoc(
+  const parctx *ctx, const char *text, size_t len, errmsg_t errmsg
+);
+  /* newpardoc(ctx,text,len,errmsg) returns a pointer to a new pardoc, */
+  /* which holds a copy of the len characters starting at text, and    */
+  /* of their reformatted output, according to the options of *ctx     */
+  /* (which are copied, so *ctx may be changed or freed afterwards),   */
+  /* so that the text can then be edited with pardocedit().  Each      */
+  /* edit rereads only the segments it might have changed, and         */
+  /* reformats only the paragraphs it did change.  The --jobs,         */
+  /* --stats, and --cache-dir options are ignored.  Returns NULL on    */
+  /* failure.                                                          */
+
+
+void freepardoc(pardoc *doc);
+
+  /* freepardoc(doc) frees the memory associated with *doc.  doc */
+  /* may not be used after this call.                            */
+
+
+const char *pardocoutput(const pardoc *doc, size_t *plen);
+
+  /* pardocoutput(doc,plen) returns a pointer to the reformatted     */
+  /* text of *doc, which is terminated by '\0', and sets *plen to    */
+  /* its length.  It remains valid until the next call with doc.     */
+
+
+const char *pardocedit(
+  pardoc *doc, size_t start, size_t end, const char *text, size_t len,
+  size_t *pstart, size_t *pend, size_t *plen, errmsg_t errmsg
+);
+  /* pardocedit(doc,start,end,text,len,pstart,pend,plen,errmsg)       */
+  /* replaces the characters of the text of *doc from start up to     */
+  /* (but not including) end with the len characters starting at      */
+  /* text, and brings its output up to date.  It sets *pstart and     */
+  /* *pend to the range of characters of the old output that have     */
+  /* changed, and returns a pointer to what replaces them, setting    */
+  /* *plen to its length, so that an editor showing the output need   */
+  /* replace only that range.  The pointer points into the output     */
+  /* (see pardocoutput()), and remains valid as long as that does.    */
+  /* start must not be greater than end, nor end than the length of   */
+  /* the text.  On failure, returns NULL, and *doc is not changed.    */
+
+
+typedef struct parindex parindex;
+
+
+parindex *newparindex(parctx *ctx, input *in, errmsg_t errmsg);
+
+  /* newparindex(ctx,in,errmsg) reads *in, which must be at the        */
+  /* beginning of a file, until EOF, and returns a pointer to a new    */
+  /* parindex, which records places in the file where a segment can    */
+  /* begin under the options of *ctx, about one every megabyte, so     */
+  /* that parregion() need not read the file from the beginning.       */
+  /* Only the protective and white characters and the expel option     */
+  /* matter.  Returns NULL on failure.                                 */
+
+
+void freeparindex(parindex *ix);
+
+  /* freeparindex(ix) frees the memory associated with *ix.  ix may */
+  /* not be used after this call.                                   */
+
+
+void writeparindex(const parindex *ix, output *out, errmsg_t errmsg);
+
+  /* writeparindex(ix,out,errmsg) writes *ix to *out as text, so that */
+  /* it can be read back by readparindex().                           */
+
+
+parindex *readparindex(
+  parctx *ctx, input *in, const input *text, errmsg_t errmsg
+);
+  /* readparindex(ctx,in,text,errmsg) reads *in until EOF, and returns */
+  /* a pointer to a new parindex holding what writeparindex() wrote    */
+  /* there, provided that it was made under the same options as those  */
+  /* of *ctx, for the file that *text reads, which must have the same  */
+  /* size and modification time as when it was indexed (see            */
+  /* inidentify() in input.h).  Otherwise, or if *in is empty, returns */
+  /* NULL without setting *errmsg.  Returns NULL on failure, which     */
+  /* includes finding something other than an index in *in.            */
+
+
+void parregion(
+  parctx *ctx, input *in, const parindex *ix, unsigned long start,
+  unsigned long end, output *out, errmsg_t errmsg
+);
+  /* parregion(ctx,in,ix,start,end,out,errmsg) writes to *out the text */
+  /* of the file read by *in, with the lines numbered start to end     */
+  /* (counting from 1) reformatted according to the options of *ctx,   */
+  /* and everything else copied unchanged.  Lines before start and     */
+  /* after end are reformatted too if they belong to the same          */
+  /* segments, and the segments are reformatted just as parinput()     */
+  /* would reformat them as part of the whole file.  If ix is not      */
+  /* NULL and was made by newparindex() or readparindex() under the    */
+  /* same options, only the text from the last place it records        */
+  /* before start is looked at to find the segments, and otherwise     */
+  /* the whole text before them is.  *in must be able to seek (see     */
+  /* inseek() in input.h).  start must be positive, and end must not   */
+  /* be less than start.  The --jobs option is ignored.                */
+
+
+#endif
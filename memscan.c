@@ -0,0 +1,237 @@
+/*
+memscan.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+These are the loops that compare lines character by character while
+finding common prefixes and suffixes and bodiless lines.  On deeply
+quoted text they run over the same long prefixes again and again.
+There is also the check for non-ASCII characters that lets UTF-8 text
+that happens to be plain ASCII be handled as quickly as ever.
+
+When compiled with PAR_SIMD defined, by gcc or a compiler compatible
+with it, for x86 or x86-64 with SSE2, they compare 16 characters at a
+time, or 32 at a time if the processor turns out to support AVX2 when
+par runs.  Otherwise, and for short arrays and leftover characters,
+they compare one character at a time.
+
+*/
+
+
+#include "memscan.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include <stddef.h>
+
+#if defined(PAR_SIMD) && defined(__GNUC__) \
+    && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define MS_X86
+#include <immintrin.h>
+#endif
+
+
+#ifdef MS_X86
+
+#define haveavx2() __builtin_cpu_supports("avx2")
+
+/* The following return the same as memmismatch(), memrmismatch(), */
+/* memspan(), and memascii(), 16 characters at a time using SSE2:   */
+
+static size_t mismatch16(const char *s1, const char *s2, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 16 <= n;  i += 16) {
+    m = _mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (s1 + i)),
+                         _mm_loadu_si128((const __m128i *) (s2 + i))));
+    if (m != 0xFFFF) return i + __builtin_ctz(~m);
+  }
+  while (i < n && s1[i] == s2[i]) ++i;
+
+  return i;
+}
+
+
+static size_t rmismatch16(const char *end1, const char *end2, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 16 <= n;  i += 16) {
+    m = _mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (end1 - i - 16)),
+                         _mm_loadu_si128((const __m128i *) (end2 - i - 16))));
+    if (m != 0xFFFF) return i + __builtin_clz(~m & 0xFFFF) - 16;
+  }
+  while (i < n && *(end1 - i - 1) == *(end2 - i - 1)) ++i;
+
+  return i;
+}
+
+
+static size_t span16(const char *s, char c, size_t n)
+{
+  size_t i;
+  unsigned int m;
+  __m128i cs = _mm_set1_epi8(c);
+
+  for (i = 0;  i + 16 <= n;  i += 16) {
+    m = _mm_movemask_epi8(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (s + i)), cs));
+    if (m != 0xFFFF) return i + __builtin_ctz(~m);
+  }
+  while (i < n && s[i] == c) ++i;
+
+  return i;
+}
+
+
+static size_t ascii16(const char *s, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 16 <= n;  i += 16) {
+    m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)));
+    if (m) return i + __builtin_ctz(m);
+  }
+  while (i < n && !(*(const unsigned char *) (s + i) & 0x80)) ++i;
+
+  return i;
+}
+
+
+/* The following do the same, 32 characters at a time using AVX2: */
+
+__attribute__((target("avx2")))
+static size_t mismatch32(const char *s1, const char *s2, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 32 <= n;  i += 32) {
+    m = _mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (s1 + i)),
+                            _mm256_loadu_si256((const __m256i *) (s2 + i))));
+    if (m != 0xFFFFFFFF) return i + __builtin_ctz(~m);
+  }
+
+  return i + mismatch16(s1 + i, s2 + i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t rmismatch32(const char *end1, const char *end2, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 32 <= n;  i += 32) {
+    m = _mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(
+            _mm256_loadu_si256((const __m256i *) (end1 - i - 32)),
+            _mm256_loadu_si256((const __m256i *) (end2 - i - 32))));
+    if (m != 0xFFFFFFFF) return i + __builtin_clz(~m);
+  }
+
+  return i + rmismatch16(end1 - i, end2 - i, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t span32(const char *s, char c, size_t n)
+{
+  size_t i;
+  unsigned int m;
+  __m256i cs = _mm256_set1_epi8(c);
+
+  for (i = 0;  i + 32 <= n;  i += 32) {
+    m = _mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) (s + i)),
+                            cs));
+    if (m != 0xFFFFFFFF) return i + __builtin_ctz(~m);
+  }
+
+  return i + span16(s + i, c, n - i);
+}
+
+
+__attribute__((target("avx2")))
+static size_t ascii32(const char *s, size_t n)
+{
+  size_t i;
+  unsigned int m;
+
+  for (i = 0;  i + 32 <= n;  i += 32) {
+    m = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (s + i)));
+    if (m) return i + __builtin_ctz(m);
+  }
+
+  return i + ascii16(s + i, n - i);
+}
+
+#endif
+
+
+size_t memmismatch(const char *s1, const char *s2, size_t n)
+{
+  size_t i;
+
+#ifdef MS_X86
+  if (n >= 32 && haveavx2()) return mismatch32(s1,s2,n);
+  if (n >= 16) return mismatch16(s1,s2,n);
+#endif
+
+  for (i = 0;  i < n && s1[i] == s2[i];  ++i);
+
+  return i;
+}
+
+
+size_t memrmismatch(const char *end1, const char *end2, size_t n)
+{
+  const char *p1;
+
+#ifdef MS_X86
+  if (n >= 32 && haveavx2()) return rmismatch32(end1,end2,n);
+  if (n >= 16) return rmismatch16(end1,end2,n);
+#endif
+
+  for (p1 = end1;  p1 > end1 - n && p1[-1] == end2[-1];  --p1, --end2);
+
+  return end1 - p1;
+}
+
+
+size_t memspan(const char *s, char c, size_t n)
+{
+  size_t i;
+
+#ifdef MS_X86
+  if (n >= 32 && haveavx2()) return span32(s,c,n);
+  if (n >= 16) return span16(s,c,n);
+#endif
+
+  for (i = 0;  i < n && s[i] == c;  ++i);
+
+  return i;
+}
+
+
+size_t memascii(const char *s, size_t n)
+{
+  size_t i;
+
+#ifdef MS_X86
+  if (n >= 32 && haveavx2()) return ascii32(s,n);
+  if (n >= 16) return ascii16(s,n);
+#endif
+
+  for (i = 0;  i < n && !(*(const unsigned char *) (s + i) & 0x80);  ++i);
+
+  return i;
+}
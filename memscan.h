@@ -0,0 +1,51 @@
+/*
+memscan.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef MEMSCAN_H
+#define MEMSCAN_H
+
+#include <stddef.h>
+
+
+size_t memmismatch(const char *s1, const char *s2, size_t n);
+
+  /* memmismatch(s1,s2,n) returns the number of characters at the */
+  /* beginnings of the n-character arrays s1 and s2 that are the  */
+  /* same, that is, the index of the first difference, or n if    */
+  /* there is none.                                               */
+
+
+size_t memrmismatch(const char *end1, const char *end2, size_t n);
+
+  /* memrmismatch(end1,end2,n) is like memmismatch(), except that */
+  /* end1 and end2 point just past the ends of the arrays, and    */
+  /* the number of characters at their ends that are the same is  */
+  /* returned.                                                    */
+
+
+size_t memspan(const char *s, char c, size_t n);
+
+  /* memspan(s,c,n) returns the number of characters at the */
+  /* beginning of the n-character array s that are equal to  */
+  /* c, or n if all of them are.                             */
+
+
+size_t memascii(const char *s, size_t n);
+
+  /* memascii(s,n) returns the number of characters at the      */
+  /* beginning of the n-character array s that are ASCII (less  */
+  /* than 128 when viewed as unsigned char), or n if all are.   */
+
+
+#endif
@@ -0,0 +1,428 @@
+/*
+output.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Writing each output line with its own call to the stdio library costs
+a call (and, on many systems, a lock) per line, and a write error is
+easy to lose that way.  An output instead collects lines in a large
+buffer of its own and writes it out in one step when it fills, or
+when the caller flushes it explicitly.  A memory output holds its
+characters in a list of chunks instead, so that text reformatted by
+another thread can be handed over and written out whole.
+
+When compiled with PAR_POSIX defined, stream outputs are written with
+write() and writev() on the underlying file descriptor, bypassing the
+stream's own buffer, so that a large memory output can be written
+without being copied, and an output to a terminal is flushed at the
+end of every line, as stdio would do.
+
+*/
+
+
+#include "output.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_POSIX
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#define OUTBUFSIZE 65536  /* The buffer size of a stream output, and */
+                          /* the largest chunk of a memory output.   */
+#define MINCHUNK 256      /* The first chunk of a memory output.     */
+#define MAXPIECES 16      /* The most pieces passed to writepieces(). */
+
+typedef struct chunk {
+  struct chunk *next;
+  char *chars;
+  size_t len,      /* Number of characters in *chars. */
+         size;     /* Room in *chars.                 */
+} chunk;
+
+struct output {
+  FILE *stream;    /* The stream written to, or NULL for a memory      */
+                   /* output.                                          */
+  chunk *first,    /* A stream output has one chunk, its buffer.  A    */
+        *last;     /* memory output has a list, each twice the size of */
+                   /* the one before (up to OUTBUFSIZE); *last is the  */
+                   /* one being filled, and any after it are spare.    */
+  unsigned long
+    count;         /* Number of characters ever written to the output. */
+  int linebuf,     /* Set if the stream is flushed after every line.   */
+      failed;      /* Set once a write to the stream has failed (to    */
+                   /* errno, if PAR_POSIX is defined).                 */
+};
+
+typedef struct piece {
+  const char *chars;
+  size_t len;
+} piece;
+
+
+static chunk *newchunk(size_t size)
+
+/* Returns a new empty chunk with room for size characters, */
+/* or NULL if there is not enough memory.                   */
+{
+  chunk *c;
+
+  c = malloc(sizeof (chunk));
+  if (!c) return NULL;
+  c->chars = malloc(size);
+  if (!c->chars) {
+    free(c);
+    return NULL;
+  }
+  c->next = NULL;
+  c->len = 0;
+  c->size = size;
+
+  return c;
+}
+
+
+static output *makeoutput(FILE *stream, size_t size, errmsg_t errmsg)
+
+/* Returns a new output for stream with a first chunk of size */
+/* characters, or NULL on failure.                            */
+{
+  output *out;
+
+  out = malloc(sizeof (output));
+  if (!out) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  out->first = out->last = newchunk(size);
+  if (!out->first) {
+    strcpy(errmsg,outofmem);
+    free(out);
+    return NULL;
+  }
+  out->stream = stream;
+  out->count = 0;
+  out->linebuf = out->failed = 0;
+
+  *errmsg = '\0';
+  return out;
+}
+
+
+output *newoutput(FILE *stream, errmsg_t errmsg)
+{
+  output *out;
+
+  out = makeoutput(stream, OUTBUFSIZE, errmsg);
+#ifdef PAR_POSIX
+  if (out) out->linebuf = isatty(fileno(stream));
+#endif
+
+  return out;
+}
+
+
+output *newmemoutput(errmsg_t errmsg)
+{
+  return makeoutput(NULL, MINCHUNK, errmsg);
+}
+
+
+void freeoutput(output *out)
+{
+  chunk *c, *next;
+
+  for (c = out->first;  c;  c = next) {
+    next = c->next;
+    free(c->chars);
+    free(c);
+  }
+  free(out);
+}
+
+
+static void writepieces(
+  output *out, const piece *pieces, int n, errmsg_t errmsg
+)
+/* Writes the n pieces of pieces to out->stream, in order.  n must */
+/* not exceed MAXPIECES.                                           */
+{
+#ifdef PAR_POSIX
+  struct iovec iov[MAXPIECES], *v = iov;
+  ssize_t r;
+  int i;
+
+  if (out->failed) goto wpfailed;
+
+  for (i = 0;  i < n;  ++i) {
+    iov[i].iov_base = (void *) pieces[i].chars;
+    iov[i].iov_len = pieces[i].len;
+  }
+
+  for (;;) {
+    while (n > 0 && !v->iov_len) ++v, --n;
+    if (!n) break;
+    r = writev(fileno(out->stream), v, n);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) {
+      out->failed =  r < 0  ?  errno  :  EIO;
+      goto wpfailed;
+    }
+    for (;  n > 0 && (size_t) r >= v->iov_len;  ++v, --n) r -= v->iov_len;
+    if (r) {
+      v->iov_base = (char *) v->iov_base + r;
+      v->iov_len -= r;
+    }
+  }
+
+  return;
+
+wpfailed:
+
+  sprintf(errmsg, "Cannot write output: %.*s\n",
+          errmsg_size - 23, strerror(out->failed));
+#else
+  int i;
+
+  if (!out->failed)
+    for (i = 0;  i < n;  ++i)
+      if (fwrite(pieces[i].chars, 1, pieces[i].len, out->stream)
+          != pieces[i].len) {
+        out->failed = 1;
+        break;
+      }
+
+  if (out->failed) strcpy(errmsg, "Cannot write output.\n");
+#endif
+}
+
+
+void outchars(output *out, const char *chars, size_t n, errmsg_t errmsg)
+{
+  chunk *c = out->last;
+  size_t k;
+  piece pieces[2];
+
+  *errmsg = '\0';
+  out->count += n;
+
+  if (out->stream) {
+    k = c->size - c->len;
+    if (n < k) {
+      memcpy(c->chars + c->len, chars, n);
+      c->len += n;
+      if (out->linebuf && memchr(chars, '\n', n)) flushoutput(out,errmsg);
+      return;
+    }
+    pieces[0].chars = c->chars;
+    if (n < c->size) {
+      memcpy(c->chars + c->len, chars, k);
+      pieces[0].len = c->size;
+      writepieces(out, pieces, 1, errmsg);
+      chars += k, n -= k;
+    }
+    else {
+      pieces[0].len = c->len;
+      pieces[1].chars = chars;
+      pieces[1].len = n;
+      writepieces(out, pieces, 2, errmsg);
+      n = 0;
+    }
+    memcpy(c->chars, chars, n);
+    c->len = n;
+    if (!*errmsg && out->linebuf && memchr(chars, '\n', n))
+      flushoutput(out,errmsg);
+    return;
+  }
+
+  for (;;) {
+    k = c->size - c->len;
+    if (k > n) k = n;
+    memcpy(c->chars + c->len, chars, k);
+    c->len += k, chars += k, n -= k;
+    if (!n) break;
+    if (!c->next) {
+      c->next =
+        newchunk(c->size < OUTBUFSIZE  ?  2 * c->size  :  OUTBUFSIZE);
+      if (!c->next) {
+        strcpy(errmsg,outofmem);
+        return;
+      }
+    }
+    out->last = c = c->next;
+  }
+}
+
+
+void outline(output *out, const char *line, errmsg_t errmsg)
+{
+  outchars(out, line, strlen(line), errmsg);
+  if (*errmsg) return;
+  outchars(out, "\n", 1, errmsg);
+}
+
+
+void outrepeat(output *out, char c, int n, errmsg_t errmsg)
+{
+  char block[256];
+  int k;
+
+  *errmsg = '\0';
+  if (n <= 0) return;
+
+  memset(block, c, n < (int) sizeof block  ?  n  :  (int) sizeof block);
+  for ( ;  n > 0;  n -= k) {
+    k =  n < (int) sizeof block  ?  n  :  (int) sizeof block;
+    outchars(out, block, k, errmsg);
+    if (*errmsg) return;
+  }
+}
+
+
+void outoutput(output *out, output *mem, errmsg_t errmsg)
+{
+  chunk *c;
+  piece pieces[MAXPIECES];
+  int n;
+
+  *errmsg = '\0';
+
+  if (out->stream && !out->linebuf && outlength(mem) >= OUTBUFSIZE) {
+    out->count += outlength(mem);
+    pieces[0].chars = out->first->chars;
+    pieces[0].len = out->first->len;
+    n = 1;
+    for (c = mem->first;  ;  c = c->next) {
+      if (n == MAXPIECES) {
+        writepieces(out, pieces, n, errmsg);
+        if (*errmsg) break;
+        n = 0;
+      }
+      pieces[n].chars = c->chars;
+      pieces[n].len = c->len;
+      ++n;
+      if (c == mem->last) {
+        writepieces(out, pieces, n, errmsg);
+        break;
+      }
+    }
+    out->first->len = 0;
+  }
+  else
+    for (c = mem->first;  ;  c = c->next) {
+      outchars(out, c->chars, c->len, errmsg);
+      if (*errmsg || c == mem->last) break;
+    }
+
+  clearoutput(mem);
+}
+
+
+unsigned long outcount(const output *out)
+{
+  return out->count;
+}
+
+
+int outfull(const output *out, size_t n)
+{
+  return out->stream && (out->linebuf || n >= out->first->size
+                                                - out->first->len);
+}
+
+
+size_t outlength(const output *mem)
+{
+  const chunk *c;
+  size_t n = 0;
+
+  for (c = mem->first;  ;  c = c->next) {
+    n += c->len;
+    if (c == mem->last) break;
+  }
+
+  return n;
+}
+
+
+char *copyoutput(const output *mem, errmsg_t errmsg)
+{
+  char *chars;
+  size_t n;
+
+  *errmsg = '\0';
+
+  n = outlength(mem);
+  if (!n) return NULL;
+  chars = malloc(n);
+  if (!chars) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  copyoutputto(mem,chars);
+
+  return chars;
+}
+
+
+void copyoutputto(const output *mem, char *chars)
+{
+  const chunk *c;
+
+  for (c = mem->first;  ;  c = c->next) {
+    memcpy(chars, c->chars, c->len);
+    chars += c->len;
+    if (c == mem->last) break;
+  }
+}
+
+
+void clearoutput(output *mem)
+{
+  chunk *c;
+
+  for (c = mem->first;  ;  c = c->next) {
+    c->len = 0;
+    if (c == mem->last) break;
+  }
+  mem->last = mem->first;
+}
+
+
+void flushoutput(output *out, errmsg_t errmsg)
+{
+  piece pc;
+
+  *errmsg = '\0';
+  if (!out->stream) return;
+
+  pc.chars = out->first->chars;
+  pc.len = out->first->len;
+  writepieces(out, &pc, 1, errmsg);
+  out->first->len = 0;
+#ifndef PAR_POSIX
+  if (!*errmsg && fflush(out->stream) == EOF) {
+    out->failed = 1;
+    strcpy(errmsg, "Cannot write output.\n");
+  }
+#endif
+}
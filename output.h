@@ -0,0 +1,129 @@
+/*
+output.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+
+typedef struct output output;
+
+
+output *newoutput(FILE *stream, errmsg_t errmsg);
+
+  /* newoutput(stream,errmsg) returns a pointer to a new output which */
+  /* collects characters in a large buffer and writes them to         */
+  /* *stream only when the buffer is full or when flushoutput() is    */
+  /* called.  Characters must not be written to *stream by any other  */
+  /* means while the output is in use, unless it has just been        */
+  /* flushed.  Returns NULL on failure.                               */
+
+
+output *newmemoutput(errmsg_t errmsg);
+
+  /* newmemoutput(errmsg) returns a pointer to a new output which  */
+  /* keeps in memory whatever is written to it, until it is passed */
+  /* to outoutput(), copyoutput(), or clearoutput().  Returns NULL */
+  /* on failure.                                                   */
+
+
+void freeoutput(output *out);
+
+  /* freeoutput(out) frees the memory associated with *out.  Any   */
+  /* characters not yet flushed are lost.  out may not be used     */
+  /* after this call.  A stream passed to newoutput() is not       */
+  /* closed.                                                       */
+
+
+void outchars(output *out, const char *chars, size_t n, errmsg_t errmsg);
+
+  /* outchars(out,chars,n,errmsg) writes the n characters */
+  /* starting at chars to *out.                           */
+
+
+void outline(output *out, const char *line, errmsg_t errmsg);
+
+  /* outline(out,line,errmsg) writes the string line, */
+  /* followed by a newline, to *out.                  */
+
+
+void outrepeat(output *out, char c, int n, errmsg_t errmsg);
+
+  /* outrepeat(out,c,n,errmsg) writes n copies of c to *out. */
+
+
+void outoutput(output *out, output *mem, errmsg_t errmsg);
+
+  /* outoutput(out,mem,errmsg) writes everything held by the memory */
+  /* output *mem to *out, and clears *mem.  If *out is a stream     */
+  /* output and *mem holds a lot, it is written directly, without   */
+  /* being copied into the buffer of *out first.                    */
+
+
+unsigned long outcount(const output *out);
+
+  /* outcount(out) returns the number of characters written to *out  */
+  /* since it was made, whether or not they are still held by it.    */
+
+
+int outfull(const output *out, size_t n);
+
+  /* outfull(out,n) returns 1 if writing n more characters to *out */
+  /* might make it write to its stream, or 0 if they would only be */
+  /* added to its buffer or to what it holds in memory.            */
+
+
+size_t outlength(const output *mem);
+
+  /* outlength(mem) returns the number of characters */
+  /* held by the memory output *mem.                 */
+
+
+char *copyoutput(const output *mem, errmsg_t errmsg);
+
+  /* copyoutput(mem,errmsg) returns a pointer to a new array holding */
+  /* the characters held by the memory output *mem, or NULL if there */
+  /* are none.  The array is not terminated.  Returns NULL on        */
+  /* failure.                                                        */
+
+
+void copyoutputto(const output *mem, char *chars);
+
+  /* copyoutputto(mem,chars) copies the characters held by the  */
+  /* memory output *mem into the array chars, which must have   */
+  /* room for outlength(mem) of them.  They are not terminated. */
+
+
+void clearoutput(output *mem);
+
+  /* clearoutput(mem) discards the characters held by the memory  */
+  /* output *mem, but keeps its storage for reuse.                */
+
+
+void flushoutput(output *out, errmsg_t errmsg);
+
+  /* flushoutput(out,errmsg) writes any characters buffered by the */
+  /* stream output *out to its stream, and does nothing if *out is */
+  /* a memory output.  This is the only way, other than filling    */
+  /* the buffer, that characters reach the stream, so the caller   */
+  /* must flush before waiting for more input and before exiting.  */
+  /* If a write fails, *errmsg is set, and so is it by every later */
+  /* call that writes to the stream.                               */
+
+
+#endif
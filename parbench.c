@@ -0,0 +1,526 @@
+/*
+parbench.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+parbench times the parts of par that do most of the work, and par as a
+whole, on each file named on its command line (typically made by
+gencorpus), so that changes in speed can be tracked from one version
+to the next.  It includes libpar.c itself rather than linking with
+libpar, so that it can call the functions that are static there.
+
+For each file, it measures:
+
+    readlines     cutting the text into segments of lines
+    csmember      testing every character against two charsets
+    compresuflen  finding the common affixes of every segment
+    delimit       delimiting every segment, including indexing it
+    reformat      breaking every paragraph into lines, once for each
+                  of the break policies: default, f, j, and g
+    par           everything, in memory, with each of the same options
+    edit          inserting a character into a document made from the
+                  file (see newpardoc()) and deleting it again, at a
+                  different place each time
+
+Each measurement is repeated until at least 0.2 seconds of processor
+time have gone by, and is written as one line of fields separated by
+tabs, after a header line naming the fields: the file, the
+measurement, the size of the file, the number of repetitions, the
+total time in microseconds, the time per repetition in nanoseconds,
+the throughput in megabytes of the file per second (to one decimal
+place), and the number of repetitions that failed (which can happen
+with j, when some line cannot be justified).
+
+*/
+
+
+#include "libpar.c"
+
+#include <time.h>
+
+
+#define MINTICKS (CLOCKS_PER_SEC / 5)  /* That is, 0.2 seconds. */
+
+
+/* The following are found once for each file, with the default */
+/* options, and reused for each measurement:                    */
+
+typedef struct bpara {
+  int first, numlines,       /* The lines of the paragraph.          */
+      afp, fs, prefix,       /* As found by setaffixes().            */
+      suffix;
+} bpara;
+
+typedef struct bsegment {
+  char **lines;              /* As returned by readsegment().        */
+  lineprop *props,           /* As returned by readsegment().        */
+           *delimited;       /* As set by delimit().                 */
+  int numlines;
+  segindex ix;               /* As set by makesegindex().            */
+  int *ixmem;
+  bpara *paras;              /* The paragraphs that are not bodiless */
+  int numparas;              /* lines.                               */
+} bsegment;
+
+typedef struct benchdata {
+  const char *text;          /* The contents of the file.            */
+  size_t len;
+  input *in;                 /* The input the segments were read by. */
+  bsegment *segs;
+  int numsegs;
+  paropts po;                /* The options being measured.          */
+  parctx *ctx;               /* A context with the same options.     */
+  output *sink;              /* Collects output, to be discarded.    */
+  pardoc *doc;               /* The file as a document, and where    */
+  size_t editat;             /* the next edit is made.               */
+  unsigned long errors,      /* Failed repetitions.                  */
+                sum;         /* Keeps results from being optimized   */
+                             /* away.                                */
+} benchdata;
+
+
+static const char * const policies[] = { "", "f", "j", "g", NULL };
+
+
+static unsigned long muldiv(unsigned long a, unsigned long b, unsigned long c)
+
+/* Returns a * b / c, rounded down, without overflowing */
+/* unless the result does, provided that b is small.    */
+{
+  return a / c * b + a % c * b / c;
+}
+
+
+static char *readfile(const char *name, size_t *plen, errmsg_t errmsg)
+
+/* Returns a pointer to the contents of the file named name, setting */
+/* *plen to their length, or NULL on failure.                        */
+{
+  FILE *f;
+  char *text = NULL, *bigger;
+  size_t size = 65536, len = 0, n;
+
+  f = fopen(name, "rb");
+  if (!f) {
+    sprintf(errmsg, "Cannot open %.*s\n", errmsg_size - 14, name);
+    return NULL;
+  }
+
+  for (;;) {
+    bigger = malloc(size);
+    if (!bigger) {
+      strcpy(errmsg,outofmem);
+      if (text) free(text);
+      text = NULL;
+      break;
+    }
+    if (text) {
+      memcpy(bigger, text, len);
+      free(text);
+    }
+    text = bigger;
+    n = fread(text + len, 1, size - len, f);
+    len += n;
+    if (len < size) break;
+    size *= 2;
+  }
+
+  if (text && ferror(f)) {
+    sprintf(errmsg, "Cannot read %.*s\n", errmsg_size - 14, name);
+    free(text);
+    text = NULL;
+  }
+  fclose(f);
+
+  *plen = len;
+  return text;
+}
+
+
+static void setpolicy(benchdata *b, const char *opt, errmsg_t errmsg)
+
+/* Makes b->ctx and b->po hold the default options followed by opt. */
+{
+  const char *args[2];
+  int help = 0, version = 0, Err = 0;
+
+  if (b->ctx) freeparctx(b->ctx);
+  b->ctx = newparctx(errmsg);
+  if (*errmsg) return;
+  if (*opt) {
+    args[0] = opt;
+    args[1] = NULL;
+    paroption(b->ctx, args, &help, &version, &Err, errmsg);
+    if (*errmsg) return;
+  }
+  getopts(b->ctx, &b->po, errmsg);
+}
+
+
+static void findparas(bsegment *seg, const paropts *po, errmsg_t errmsg)
+
+/* Delimits *seg and finds its paragraphs and their affixes, as */
+/* formatsegment() does.                                        */
+{
+  lineprop *props = seg->delimited;
+  int first, next, n = seg->numlines;
+
+  seg->paras = malloc(n * sizeof (bpara));
+  if (!seg->paras) {
+    strcpy(errmsg,outofmem);
+    return;
+  }
+
+  delimit(&seg->ix, n, po->bodychars, po->repeat, po->body, po->div, props);
+
+  for (first = 0;  first < n;  first = next) {
+    next = first + 1;
+    if (isbodiless(props + first)) continue;
+    while (next < n && !isbodiless(props + next) && !isfirst(props + next))
+      ++next;
+    seg->paras[seg->numparas].first = first;
+    seg->paras[seg->numparas].numlines = next - first;
+    seg->paras[seg->numparas].prefix = po->prefix;
+    seg->paras[seg->numparas].suffix = po->suffix;
+    setaffixes(&seg->ix, first, next - first, props + first, po->bodychars,
+               po->quotechars, po->hang, po->body, po->quote,
+               &seg->paras[seg->numparas].afp, &seg->paras[seg->numparas].fs,
+               &seg->paras[seg->numparas].prefix,
+               &seg->paras[seg->numparas].suffix);
+    ++seg->numparas;
+  }
+}
+
+
+static void prepare(benchdata *b, errmsg_t errmsg)
+
+/* Reads the segments of b->text into b->segs, with the options */
+/* in b->po, and finds their paragraphs.                        */
+{
+  segreader sr;
+  bsegment *seg;
+  char **lines;
+  lineprop *props;
+  int size = 0;
+
+  b->in = newmeminput(b->text, b->len, errmsg);
+  if (*errmsg) return;
+  sr.in = b->in;
+  sr.po = &b->po;
+  sr.sawnonblank = sr.oweblank = 0;
+
+  for (;;) {
+    lines = readsegment(&sr, b->sink, &props, errmsg);
+    clearoutput(b->sink);
+    if (!lines) return;
+
+    if (b->numsegs == size) {
+      size = 2 * size + 16;
+      seg = malloc(size * sizeof (bsegment));
+      if (!seg) {
+        freelines(lines, b->in);
+        free(props);
+        strcpy(errmsg,outofmem);
+        return;
+      }
+      if (b->segs) {
+        memcpy(seg, b->segs, b->numsegs * sizeof (bsegment));
+        free(b->segs);
+      }
+      b->segs = seg;
+    }
+    seg = b->segs + b->numsegs++;
+    memset(seg, 0, sizeof (bsegment));
+    seg->lines = lines;
+    seg->props = props;
+    while (lines[seg->numlines]) ++seg->numlines;
+
+    seg->delimited = malloc(seg->numlines * sizeof (lineprop));
+    if (!seg->delimited) {
+      strcpy(errmsg,outofmem);
+      return;
+    }
+    memcpy(seg->delimited, props, seg->numlines * sizeof (lineprop));
+    seg->ixmem = makesegindex(&seg->ix, (const char * const *) lines,
+                              seg->numlines, b->po.utf8, errmsg);
+    if (!seg->ixmem) return;
+    findparas(seg, &b->po, errmsg);
+    if (*errmsg) return;
+  }
+}
+
+
+static void unprepare(benchdata *b)
+
+/* Frees what prepare() allocated. */
+{
+  bsegment *seg;
+
+  for (seg = b->segs;  seg < b->segs + b->numsegs;  ++seg) {
+    freelines(seg->lines, b->in);
+    free(seg->props);
+    if (seg->delimited) free(seg->delimited);
+    if (seg->ixmem) free(seg->ixmem);
+    if (seg->paras) free(seg->paras);
+  }
+  if (b->segs) free(b->segs);
+  if (b->in) freeinput(b->in);
+  b->segs = NULL;
+  b->numsegs = 0;
+  b->in = NULL;
+}
+
+
+/* Each of the following does one repetition of a measurement: */
+
+static void runreadlines(benchdata *b, errmsg_t errmsg)
+{
+  segreader sr;
+  char **lines;
+  lineprop *props;
+
+  sr.in = newmeminput(b->text, b->len, errmsg);
+  if (*errmsg) return;
+  sr.po = &b->po;
+  sr.sawnonblank = sr.oweblank = 0;
+
+  while ((lines = readsegment(&sr, b->sink, &props, errmsg)) != NULL) {
+    b->sum += props[0].flags;
+    freelines(lines, sr.in);
+    free(props);
+    clearoutput(b->sink);
+  }
+  clearoutput(b->sink);
+  freeinput(sr.in);
+}
+
+
+static void runcsmember(benchdata *b, errmsg_t errmsg)
+{
+  const char *p, *end = b->text + b->len;
+  unsigned long n = 0;
+
+  for (p = b->text;  p < end;  ++p)
+    n += csmember(*p, b->po.whitechars) + csmember(*p, b->po.quotechars);
+
+  b->sum += n;
+  *errmsg = '\0';
+}
+
+
+static void runcompresuflen(benchdata *b, errmsg_t errmsg)
+{
+  bsegment *seg;
+  int pre, suf;
+
+  for (seg = b->segs;  seg < b->segs + b->numsegs;  ++seg) {
+    compresuflen(&seg->ix, 0, seg->numlines, b->po.bodychars,
+                 b->po.body, 0, 0, &pre, &suf);
+    b->sum += pre + suf;
+  }
+  *errmsg = '\0';
+}
+
+
+static void rundelimit(benchdata *b, errmsg_t errmsg)
+{
+  bsegment *seg;
+  segindex ix;
+  int *ixmem;
+
+  for (seg = b->segs;  seg < b->segs + b->numsegs;  ++seg) {
+    memcpy(seg->delimited, seg->props, seg->numlines * sizeof (lineprop));
+    ixmem = makesegindex(&ix, (const char * const *) seg->lines,
+                         seg->numlines, b->po.utf8, errmsg);
+    if (!ixmem) return;
+    delimit(&ix, seg->numlines, b->po.bodychars, b->po.repeat, b->po.body,
+            b->po.div, seg->delimited);
+    b->sum += seg->delimited[0].flags;
+    free(ixmem);
+  }
+}
+
+
+static void runreformat(benchdata *b, errmsg_t errmsg)
+{
+  const paropts *po = &b->po;
+  bsegment *seg;
+  bpara *para;
+  const char * const *lines;
+  lineout lo;
+  int failed = 0;
+
+  lo.out = b->sink, lo.stats = NULL, lo.cache = NULL;
+  for (seg = b->segs;  seg < b->segs + b->numsegs;  ++seg)
+    for (para = seg->paras;  para < seg->paras + seg->numparas;  ++para) {
+      lines = (const char * const *) seg->lines + para->first;
+      if (po->width <= para->prefix + para->suffix) {
+        failed = 1;
+        continue;
+      }
+      reformatto(lines, lines + para->numlines, para->afp, para->fs,
+                 po->hang, para->prefix, para->suffix, po->width, po->cap,
+                 po->fit, po->guess, po->just, po->last, po->Report,
+                 po->touch, po->utf8, po->reference, po->terminalchars,
+                 po->alnumchars, po->lowerchars, putoutline, &lo,
+                 b->ctx->scratch, NULL, NULL, errmsg);
+      if (*errmsg) failed = 1;
+      b->sum += outlength(b->sink);
+      clearoutput(b->sink);
+    }
+
+  b->errors += failed;
+  *errmsg = '\0';
+}
+
+
+static void runpar(benchdata *b, errmsg_t errmsg)
+{
+  size_t n;
+
+  if (!parformat(b->ctx, b->text, b->len, &n, errmsg)) ++b->errors;
+  b->sum += n;
+  *errmsg = '\0';
+}
+
+
+static void runedit(benchdata *b, errmsg_t errmsg)
+{
+  size_t start, end, n;
+
+  b->editat = (b->editat + 4099) % (b->len + 1);
+  if (!pardocedit(b->doc, b->editat, b->editat, "x", 1, &start, &end, &n,
+                  errmsg))
+    ++b->errors;
+  else if (!pardocedit(b->doc, b->editat, b->editat + 1, "", 0, &start,
+                       &end, &n, errmsg))
+    ++b->errors;
+  b->sum += n;
+  *errmsg = '\0';
+}
+
+
+static void timeit(
+  benchdata *b, const char *file, const char *name, const char *opt,
+  void (*run)(benchdata *b, errmsg_t errmsg), errmsg_t errmsg
+)
+/* Repeats run(b,errmsg) until at least MINTICKS have gone by, and */
+/* writes a line reporting how long it took, for the measurement   */
+/* named name, followed by opt if it is not empty.                 */
+{
+  clock_t start, now;
+  unsigned long iters = 0, usec, tenths;
+
+  b->errors = 0;
+  run(b,errmsg);  /* Warms up the caches. */
+  if (*errmsg) return;
+  b->errors = 0;
+
+  start = clock();
+  do {
+    run(b,errmsg);
+    if (*errmsg) return;
+    ++iters;
+    now = clock();
+  } while (now - start < MINTICKS);
+
+  usec = muldiv(now - start, 1000000, CLOCKS_PER_SEC);
+  if (!usec) usec = 1;
+  tenths = muldiv(b->len * iters, 10, usec);
+
+  printf("%s\t%s%s%s\t%lu\t%lu\t%lu\t%lu\t%lu.%lu\t%lu\n",
+         file, name, *opt ? "-" : "", opt, (unsigned long) b->len, iters,
+         usec, muldiv(usec, 1000, iters), tenths / 10, tenths % 10,
+         b->errors);
+  fflush(stdout);
+}
+
+
+static void benchfile(benchdata *b, const char *file, errmsg_t errmsg)
+
+/* Makes and reports all the measurements for the file named file. */
+{
+  const char * const *opt;
+
+  b->text = readfile(file, &b->len, errmsg);
+  if (*errmsg) return;
+
+  setpolicy(b, "", errmsg);
+  if (*errmsg) goto bfcleanup;
+  prepare(b,errmsg);
+  if (*errmsg) goto bfcleanup;
+
+  timeit(b, file, "readlines", "", runreadlines, errmsg);
+  if (*errmsg) goto bfcleanup;
+  timeit(b, file, "csmember", "", runcsmember, errmsg);
+  if (*errmsg) goto bfcleanup;
+  timeit(b, file, "compresuflen", "", runcompresuflen, errmsg);
+  if (*errmsg) goto bfcleanup;
+  timeit(b, file, "delimit", "", rundelimit, errmsg);
+  if (*errmsg) goto bfcleanup;
+
+  for (opt = policies;  *opt;  ++opt) {
+    setpolicy(b, *opt, errmsg);
+    if (*errmsg) goto bfcleanup;
+    timeit(b, file, "reformat", *opt, runreformat, errmsg);
+    if (*errmsg) goto bfcleanup;
+  }
+
+  for (opt = policies;  *opt;  ++opt) {
+    setpolicy(b, *opt, errmsg);
+    if (*errmsg) goto bfcleanup;
+    timeit(b, file, "par", *opt, runpar, errmsg);
+    if (*errmsg) goto bfcleanup;
+  }
+
+  setpolicy(b, "", errmsg);
+  if (*errmsg) goto bfcleanup;
+  b->doc = newpardoc(b->ctx, b->text, b->len, errmsg);
+  if (*errmsg) goto bfcleanup;
+  b->editat = b->len / 2;
+  timeit(b, file, "edit", "", runedit, errmsg);
+
+bfcleanup:
+
+  unprepare(b);
+  if (b->doc) freepardoc(b->doc);
+  b->doc = NULL;
+  free((char *) b->text);
+  b->text = NULL;
+}
+
+
+int main(int argc, const char * const *argv)
+{
+  benchdata b;
+  errmsg_t errmsg = { '\0' };
+  int i;
+
+  memset(&b, 0, sizeof (benchdata));
+
+  if (argc < 2) {
+    fputs("usage: parbench <file>...\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  b.sink = newmemoutput(errmsg);
+  if (*errmsg) goto bcleanup;
+
+  printf("file\tbench\tbytes\titers\tusec\tns_per_iter\tmb_per_s\terrors\n");
+  for (i = 1;  i < argc;  ++i) {
+    benchfile(&b, argv[i], errmsg);
+    if (*errmsg) break;
+  }
+
+bcleanup:
+
+  if (b.ctx) freeparctx(b.ctx);
+  if (b.sink) freeoutput(b.sink);
+
+  if (*errmsg) fprintf(stderr, "parbench error:\n%.*s", errmsg_size, errmsg);
+
+  return *errmsg ? EXIT_FAILURE : EXIT_SUCCESS;
+}
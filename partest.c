@@ -0,0 +1,326 @@
+/*
+partest.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89), except that if PAR_POSIX is defined it also
+uses POSIX sockets.
+
+partest is run by test-par to check what cannot be checked from the
+command line of par alone.  Its first argument names what to do:
+
+    partest edits <seed> <count> [<option>...]
+
+        Makes a document (see newpardoc()) of the text read from the
+        standard input, with the given options (as on the command line
+        of par), and makes count edits to it, each replacing a few
+        characters at some place with a few others, all chosen by a
+        pseudo-random sequence starting from seed.  After each edit, it
+        checks that the output of the document is what parformat()
+        makes of the edited text, that patching the old output with
+        what pardocedit() returned gives the same, and that the edit
+        failed if and only if parformat() did.  Writes "<count> edits"
+        if all of that held, or describes the first edit that didn't.
+
+    partest client <path>
+
+        Connects to the Unix domain socket named path, as made by
+        par --serve, retrying for up to 5 seconds while nothing is
+        listening there yet, sends it everything read from the
+        standard input, and copies what comes back to the standard
+        output until the connection is closed.  Requires PAR_POSIX.
+
+*/
+
+
+#include "errmsg.h"
+#include "libpar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_POSIX
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+
+#define MAXDELETE 40   /* The most characters an edit removes. */
+#define MAXINSERT 12   /* The most characters an edit inserts. */
+
+static const char inschars[] = "abcde fgh ij.\n\n>";
+
+  /* Inserted characters are drawn from inschars, so that edits  */
+  /* join and split words, lines, and paragraphs, and change the */
+  /* quotation of lines, as well as changing words.              */
+
+
+static unsigned long nextrandom(unsigned long *pseed)
+
+/* Advances the pseudo-random sequence kept in *pseed, */
+/* and returns its next number, which is below 65536.  */
+{
+  *pseed = (*pseed * 1103515245 + 12345) & 0xffffffff;
+  return *pseed >> 16;
+}
+
+
+static char *readall(FILE *f, size_t *plen, errmsg_t errmsg)
+
+/* Returns a pointer to everything read from *f, setting *plen */
+/* to its length, or NULL on failure.                          */
+{
+  char *text = NULL, *bigger;
+  size_t size = 65536, len = 0, n;
+
+  for (;;) {
+    bigger = malloc(size);
+    if (!bigger) {
+      strcpy(errmsg,outofmem);
+      if (text) free(text);
+      return NULL;
+    }
+    if (text) {
+      memcpy(bigger, text, len);
+      free(text);
+    }
+    text = bigger;
+    n = fread(text + len, 1, size - len, f);
+    len += n;
+    if (len < size) break;
+    size *= 2;
+  }
+
+  if (ferror(f)) {
+    strcpy(errmsg, "Cannot read the standard input.\n");
+    free(text);
+    return NULL;
+  }
+
+  *plen = len;
+  return text;
+}
+
+
+static void runedits(const char * const *args, errmsg_t errmsg)
+
+/* Does what "partest edits" does, given the arguments that follow */
+/* "edits" in args, which has a NULL element after the last one.   */
+{
+  parctx *ctx = NULL;
+  pardoc *doc = NULL;
+  char *text = NULL, *edited = NULL, *old = NULL, ins[MAXINSERT];
+  const char *out, *repl, *formatted;
+  size_t len = 0, start, end, inslen, outlen, oldlen, fmtlen, ostart, oend,
+         repllen, k;
+  unsigned long seed;
+  int count, i, n, help = 0, version = 0, Err = 0;
+  errmsg_t editerr, fmterr;
+
+  seed = strtoul(args[0], NULL, 10);
+  count = atoi(args[1]);
+
+  ctx = newparctx(errmsg);
+  if (*errmsg) goto recleanup;
+  for (args += 2;  *args;  args += n) {
+    n = paroption(ctx, args, &help, &version, &Err, errmsg);
+    if (*errmsg) goto recleanup;
+    if (help) {
+      sprintf(errmsg, "Bad option: %.*s\n", errmsg_size - 14, *args);
+      goto recleanup;
+    }
+  }
+
+  text = readall(stdin, &len, errmsg);
+  if (*errmsg) goto recleanup;
+  doc = newpardoc(ctx, text, len, errmsg);
+  if (*errmsg) goto recleanup;
+
+  for (i = 1;  i <= count;  ++i) {
+    out = pardocoutput(doc, &oldlen);
+    if (old) free(old);
+    old = malloc(oldlen + 1);
+    if (!old) {
+      strcpy(errmsg,outofmem);
+      goto recleanup;
+    }
+    memcpy(old, out, oldlen);
+
+    /* Deletions are mostly short, so that the text */
+    /* grows and shrinks by about the same amount:  */
+
+    start = nextrandom(&seed) % (len + 1);
+    k = nextrandom(&seed) % 4  ?  nextrandom(&seed) % 8
+                               :  nextrandom(&seed) % (MAXDELETE + 1);
+    end =  k > len - start  ?  len  :  start + k;
+    inslen = nextrandom(&seed) % (MAXINSERT + 1);
+    for (k = 0;  k < inslen;  ++k)
+      ins[k] = inschars[nextrandom(&seed) % (sizeof inschars - 1)];
+
+    edited = malloc(len - (end - start) + inslen + 1);
+    if (!edited) {
+      strcpy(errmsg,outofmem);
+      goto recleanup;
+    }
+    memcpy(edited, text, start);
+    memcpy(edited + start, ins, inslen);
+    memcpy(edited + start + inslen, text + end, len - end);
+
+    repl = pardocedit(doc, start, end, ins, inslen, &ostart, &oend,
+                      &repllen, editerr);
+    formatted = parformat(ctx, edited, len - (end - start) + inslen,
+                          &fmtlen, fmterr);
+    if (!repl != !formatted) {
+      sprintf(errmsg, "Edit %d (%lu:%lu) %s, but parformat() %s.\n", i,
+              (unsigned long) start, (unsigned long) end,
+              repl ? "succeeded" : "failed",
+              formatted ? "succeeded" : "failed");
+      goto recleanup;
+    }
+    if (!repl) {
+      free(edited);
+      edited = NULL;
+      continue;
+    }
+    free(text);
+    text = edited;
+    edited = NULL;
+    len = len - (end - start) + inslen;
+
+    out = pardocoutput(doc, &outlen);
+    if (outlen != fmtlen || memcmp(out, formatted, fmtlen)) {
+      sprintf(errmsg,
+              "After edit %d (%lu:%lu), the output differs from what\n"
+              "parformat() makes of the text.\n",
+              i, (unsigned long) start, (unsigned long) end);
+      goto recleanup;
+    }
+    if (   ostart > oend || oend > oldlen
+        || oldlen - (oend - ostart) + repllen != fmtlen
+        || memcmp(old, formatted, ostart)
+        || memcmp(repl, formatted + ostart, repllen)
+        || memcmp(old + oend, formatted + ostart + repllen, oldlen - oend)) {
+      sprintf(errmsg,
+              "Edit %d (%lu:%lu) reported the wrong change of output\n"
+              "(%lu:%lu, %lu characters).\n",
+              i, (unsigned long) start, (unsigned long) end,
+              (unsigned long) ostart, (unsigned long) oend,
+              (unsigned long) repllen);
+      goto recleanup;
+    }
+  }
+
+  printf("%d edits\n", count);
+
+recleanup:
+
+  if (doc) freepardoc(doc);
+  if (ctx) freeparctx(ctx);
+  if (text) free(text);
+  if (edited) free(edited);
+  if (old) free(old);
+}
+
+
+static void runclient(const char *path, errmsg_t errmsg)
+
+/* Does what "partest client" does, for the socket named path. */
+{
+#ifdef PAR_POSIX
+  struct sockaddr_un addr;
+  struct timespec pause;
+  char *text = NULL, buf[4096];
+  size_t len, sent;
+  ssize_t n;
+  int fd = -1, tries = 0, err;
+
+  *errmsg = '\0';
+
+  if (strlen(path) >= sizeof addr.sun_path) {
+    sprintf(errmsg, "Socket name too long: %.*s\n", errmsg_size - 24, path);
+    return;
+  }
+  memset(&addr, 0, sizeof addr);
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  text = readall(stdin, &len, errmsg);
+  if (*errmsg) return;
+
+  /* par may not have made the socket yet, or may not be listening: */
+
+  for (;;) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) goto rcerror;
+    if (connect(fd, (struct sockaddr *) &addr, sizeof addr) == 0) break;
+    err = errno;
+    close(fd);
+    fd = -1;
+    if ((err != ENOENT && err != ECONNREFUSED) || ++tries == 500)
+      goto rcerror;
+    pause.tv_sec = 0;
+    pause.tv_nsec = 10000000;
+    nanosleep(&pause, NULL);
+  }
+
+  /* par closes the connection after a bad request, perhaps */
+  /* before all of it has been sent, which is not an error: */
+
+  signal(SIGPIPE, SIG_IGN);
+  for (sent = 0;  sent < len;  sent += n) {
+    n = write(fd, text + sent, len - sent);
+    if (n < 0 && errno == EINTR) n = 0;
+    else if (n < 0) break;
+  }
+  shutdown(fd, SHUT_WR);
+
+  while ((n = read(fd, buf, sizeof buf)) != 0) {
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) goto rcerror;
+    fwrite(buf, 1, n, stdout);
+  }
+  goto rccleanup;
+
+rcerror:
+
+  sprintf(errmsg, "Cannot talk to %.*s\n", errmsg_size - 17, path);
+
+rccleanup:
+
+  if (fd >= 0) close(fd);
+  free(text);
+#else
+  sprintf(errmsg, "Cannot connect to %.*s without PAR_POSIX.\n",
+          errmsg_size - 39, path);
+#endif
+}
+
+
+int main(int argc, const char * const *argv)
+{
+  errmsg_t errmsg = { '\0' };
+
+  if (argc >= 4 && strcmp(argv[1], "edits") == 0)
+    runedits(argv + 2, errmsg);
+  else if (argc == 3 && strcmp(argv[1], "client") == 0)
+    runclient(argv[2], errmsg);
+  else {
+    fputs("usage: partest edits <seed> <count> [<option>...]\n"
+          "       partest client <path>\n", stderr);
+    return EXIT_FAILURE;
+  }
+
+  if (*errmsg) fprintf(stderr, "partest error:\n%.*s", errmsg_size, errmsg);
+
+  return *errmsg ? EXIT_FAILURE : EXIT_SUCCESS;
+}
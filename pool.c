@@ -0,0 +1,445 @@
+/*
+pool.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89), except that if PAR_THREADS is defined it
+also uses POSIX threads.
+
+For a pool made by startpool(), the tasks are dealt out round-robin,
+so each worker starts with its own queue holding every numworkers-th
+task in increasing order.  A worker takes tasks from the front of its
+own queue, so that early tasks (the ones an ordered consumer is waiting
+for) tend to finish first.  When its queue is empty, it steals from
+the back of another worker's queue.  Because the tasks' sizes are not
+known in advance and may differ by orders of magnitude, this keeps
+every worker busy until there is nothing left to take, which a fixed
+partition of the tasks would not.
+
+For a pool made by startstream(), a producer thread makes the tasks
+one at a time, and the workers take them in the order they were made,
+since the consumer needs them in that order and at most window of them
+are outstanding anyway.  All the shared counters are protected by a
+single mutex; a task is small enough next to the locking that finer
+grained locking would gain nothing.
+
+Without PAR_THREADS there are no threads, and waittask() simply makes
+and runs every task up to the one being waited for.
+
+*/
+
+
+#include "pool.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_THREADS
+#include <pthread.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#ifdef PAR_THREADS
+
+typedef struct queue {
+  pthread_mutex_t lock;  /* Protects head and tail.                   */
+  int *tasks,            /* tasks[head] through tasks[tail - 1] have  */
+      head, tail;        /* yet to be started.                        */
+} queue;
+
+typedef struct worker {
+  pool *p;               /* The pool this worker belongs to.          */
+  int index;             /* This worker's index in p->queues.         */
+} worker;
+
+#endif
+
+struct pool {
+  int (*produce)(void *arg, int task);  /* NULL for startpool().     */
+  void (*run)(void *arg, int task);
+  void *arg;
+  int numtasks,             /* Number of tasks, for startpool().      */
+      window,               /* Window size, for startstream().        */
+      ended;                /* Set once produce() has returned 0.     */
+#ifdef PAR_THREADS
+  int numqueues,            /* Number of threads asked for.           */
+      numworkers;           /* Number of threads actually started.    */
+  queue *queues;            /* One queue per thread asked for.        */
+  worker *workers;          /* Arguments for the threads.             */
+  pthread_t *threads;
+  char *done;               /* done[t] is 1 once task t has finished  */
+                            /* (done[t % window] for startstream()).  */
+  int numproduced,          /* Number of tasks produce() has made.    */
+      nextrun,              /* The next task for a worker to run.     */
+      numreleased,          /* Number of tasks released.              */
+      stopping,             /* Set by endpool().                      */
+      hasproducer;          /* Set if producer was started.           */
+  pthread_t producer;
+  pthread_mutex_t donelock; /* Protects done and the counters above.  */
+  pthread_cond_t donecond;  /* Signaled whenever any of them change.  */
+#else
+  int next;                 /* The next task to run.                  */
+#endif
+};
+
+
+#ifdef PAR_THREADS
+
+static int taketask(pool *p, int me)
+
+/* Removes and returns a task for worker me: the first task in its */
+/* own queue if there is one, otherwise the last task in another   */
+/* worker's queue.  Returns -1 if every queue is empty.            */
+{
+  queue *q;
+  int i, task = -1;
+
+  q = p->queues + me;
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) task = q->tasks[q->head++];
+  pthread_mutex_unlock(&q->lock);
+
+  for (i = 1;  task < 0 && i < p->numqueues;  ++i) {
+    q = p->queues + (me + i) % p->numqueues;
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) task = q->tasks[--q->tail];
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  return task;
+}
+
+
+static void *workerloop(void *arg)
+{
+  worker *w = arg;
+  pool *p = w->p;
+  int task;
+
+  while ((task = taketask(p, w->index)) >= 0) {
+    p->run(p->arg, task);
+    pthread_mutex_lock(&p->donelock);
+    p->done[task] = 1;
+    pthread_cond_broadcast(&p->donecond);
+    pthread_mutex_unlock(&p->donelock);
+  }
+
+  return NULL;
+}
+
+
+static void *streamloop(void *arg)
+
+/* The body of each worker of a pool made by startstream(). */
+{
+  pool *p = arg;
+  int task;
+
+  pthread_mutex_lock(&p->donelock);
+  for (;;) {
+    while (p->nextrun >= p->numproduced && !p->ended && !p->stopping)
+      pthread_cond_wait(&p->donecond, &p->donelock);
+    if (p->stopping || p->nextrun >= p->numproduced) break;
+    task = p->nextrun++;
+    pthread_mutex_unlock(&p->donelock);
+    p->run(p->arg, task);
+    pthread_mutex_lock(&p->donelock);
+    p->done[task % p->window] = 1;
+    pthread_cond_broadcast(&p->donecond);
+  }
+  pthread_mutex_unlock(&p->donelock);
+
+  return NULL;
+}
+
+
+static void *producerloop(void *arg)
+
+/* The body of the producer of a pool made by startstream(). */
+{
+  pool *p = arg;
+  int task, made;
+
+  for (task = 0;  ;  ++task) {
+    pthread_mutex_lock(&p->donelock);
+    while (task - p->numreleased >= p->window && !p->stopping)
+      pthread_cond_wait(&p->donecond, &p->donelock);
+    if (p->stopping) {
+      pthread_mutex_unlock(&p->donelock);
+      break;
+    }
+    pthread_mutex_unlock(&p->donelock);
+
+    made = p->produce(p->arg, task);
+
+    pthread_mutex_lock(&p->donelock);
+    if (made) {
+      p->done[task % p->window] = 0;
+      p->numproduced = task + 1;
+    }
+    else p->ended = 1;
+    pthread_cond_broadcast(&p->donecond);
+    pthread_mutex_unlock(&p->donelock);
+    if (!made) break;
+  }
+
+  return NULL;
+}
+
+#endif
+
+
+static pool *newpool(
+  int numtasks, int window, int numworkers,
+  int (*produce)(void *arg, int task), void (*run)(void *arg, int task),
+  void *arg, errmsg_t errmsg
+)
+/* Does the work common to startpool() and startstream(), except for */
+/* starting any threads.  The queues are made only if produce is     */
+/* NULL.  Returns NULL on failure.                                   */
+{
+  pool *p;
+#ifdef PAR_THREADS
+  queue *q;
+  int i, task;
+#endif
+
+  p = malloc(sizeof (pool));
+  if (!p) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+  p->produce = produce;
+  p->run = run;
+  p->arg = arg;
+  p->numtasks = numtasks;
+  p->window = window;
+  p->ended = 0;
+
+#ifdef PAR_THREADS
+  p->numqueues = produce ? 0 : numworkers;
+  p->numworkers = 0;
+  p->numproduced = p->nextrun = p->numreleased = 0;
+  p->stopping = p->hasproducer = 0;
+  p->queues = NULL;
+  p->workers = malloc(numworkers * sizeof (worker));
+  p->threads = malloc(numworkers * sizeof (pthread_t));
+  p->done = calloc(produce ? window : numtasks, 1);
+  if (!p->workers || !p->threads || !p->done) {
+    strcpy(errmsg,outofmem);
+    goto nperror;
+  }
+
+  if (!produce) {
+    p->queues = malloc(numworkers * sizeof (queue));
+    if (p->queues) p->queues->tasks = malloc(numtasks * sizeof (int));
+    if (!p->queues || !p->queues->tasks) {
+      strcpy(errmsg,outofmem);
+      goto nperror;
+    }
+
+    /* All the queues share one array; queue i gets the slice holding */
+    /* tasks i, i + numworkers, i + 2 * numworkers, and so on.         */
+
+    for (i = 0, task = 0;  i < numworkers;  ++i) {
+      q = p->queues + i;
+      q->tasks = p->queues->tasks + task;
+      q->head = q->tail = 0;
+      task += numtasks / numworkers + (i < numtasks % numworkers);
+    }
+    for (task = 0;  task < numtasks;  ++task) {
+      q = p->queues + task % numworkers;
+      q->tasks[q->tail++] = task;
+    }
+    for (i = 0;  i < numworkers;  ++i)
+      pthread_mutex_init(&p->queues[i].lock, NULL);
+  }
+
+  pthread_mutex_init(&p->donelock, NULL);
+  pthread_cond_init(&p->donecond, NULL);
+#else
+  (void) numworkers;
+  p->next = 0;
+#endif
+
+  *errmsg = '\0';
+  return p;
+
+#ifdef PAR_THREADS
+nperror:
+
+  if (p->queues) {
+    if (p->queues->tasks) free(p->queues->tasks);
+    free(p->queues);
+  }
+  if (p->workers) free(p->workers);
+  if (p->threads) free(p->threads);
+  if (p->done) free(p->done);
+  free(p);
+  return NULL;
+#endif
+}
+
+
+pool *startpool(
+  int numtasks, int numworkers, void (*run)(void *arg, int task),
+  void *arg, errmsg_t errmsg
+)
+{
+  pool *p;
+#ifdef PAR_THREADS
+  int i;
+#endif
+
+  if (numworkers > numtasks) numworkers = numtasks;
+  p = newpool(numtasks, 0, numworkers, NULL, run, arg, errmsg);
+  if (*errmsg) return NULL;
+
+#ifdef PAR_THREADS
+  for (i = 0;  i < numworkers;  ++i) {
+    p->workers[i].p = p;
+    p->workers[i].index = i;
+  }
+  for (i = 0;  i < numworkers;  ++i) {
+    if (pthread_create(p->threads + i, NULL, workerloop, p->workers + i))
+      break;
+    ++p->numworkers;
+  }
+  if (!p->numworkers) {
+    strcpy(errmsg, "Cannot create threads.\n");
+    endpool(p);
+    return NULL;
+  }
+#endif
+
+  return p;
+}
+
+
+pool *startstream(
+  int window, int numworkers, int (*produce)(void *arg, int task),
+  void (*run)(void *arg, int task), void *arg, errmsg_t errmsg
+)
+{
+  pool *p;
+#ifdef PAR_THREADS
+  int i;
+#endif
+
+  p = newpool(0, window, numworkers, produce, run, arg, errmsg);
+  if (*errmsg) return NULL;
+
+#ifdef PAR_THREADS
+  for (i = 0;  i < numworkers;  ++i) {
+    if (pthread_create(p->threads + i, NULL, streamloop, p))
+      break;
+    ++p->numworkers;
+  }
+  if (p->numworkers
+      && !pthread_create(&p->producer, NULL, producerloop, p))
+    p->hasproducer = 1;
+  if (!p->hasproducer) {
+    strcpy(errmsg, "Cannot create threads.\n");
+    endpool(p);
+    return NULL;
+  }
+#endif
+
+  return p;
+}
+
+
+int waittask(pool *p, int task)
+{
+#ifdef PAR_THREADS
+  int r;
+
+  pthread_mutex_lock(&p->donelock);
+  if (p->produce) {
+    while (  task >= p->numproduced  ?  !p->ended
+                                     :  !p->done[task % p->window])
+      pthread_cond_wait(&p->donecond, &p->donelock);
+    r = task < p->numproduced;
+  }
+  else {
+    while (!p->done[task])
+      pthread_cond_wait(&p->donecond, &p->donelock);
+    r = 1;
+  }
+  pthread_mutex_unlock(&p->donelock);
+
+  return r;
+#else
+  while (p->next <= task) {
+    if (p->produce && (p->ended || !p->produce(p->arg, p->next))) {
+      p->ended = 1;
+      return 0;
+    }
+    p->run(p->arg, p->next);
+    ++p->next;
+  }
+
+  return 1;
+#endif
+}
+
+
+void releasetask(pool *p, int task)
+{
+#ifdef PAR_THREADS
+  if (!p->produce) return;
+  pthread_mutex_lock(&p->donelock);
+  if (p->numreleased <= task) p->numreleased = task + 1;
+  pthread_cond_broadcast(&p->donecond);
+  pthread_mutex_unlock(&p->donelock);
+#else
+  (void) p;
+  (void) task;
+#endif
+}
+
+
+void endpool(pool *p)
+{
+#ifdef PAR_THREADS
+  queue *q;
+  int i;
+
+  for (i = 0;  i < p->numqueues;  ++i) {
+    q = p->queues + i;
+    pthread_mutex_lock(&q->lock);
+    q->tail = q->head;
+    pthread_mutex_unlock(&q->lock);
+  }
+
+  pthread_mutex_lock(&p->donelock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->donecond);
+  pthread_mutex_unlock(&p->donelock);
+
+  if (p->hasproducer) pthread_join(p->producer, NULL);
+  for (i = 0;  i < p->numworkers;  ++i)
+    pthread_join(p->threads[i], NULL);
+
+  if (p->queues) {
+    free(p->queues->tasks);
+    free(p->queues);
+  }
+  free(p->workers);
+  free(p->threads);
+  free(p->done);
+#endif
+
+  free(p);
+}
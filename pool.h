@@ -0,0 +1,79 @@
+/*
+pool.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "errmsg.h"
+
+
+typedef struct pool pool;
+
+
+pool *startpool(
+  int numtasks, int numworkers, void (*run)(void *arg, int task),
+  void *arg, errmsg_t errmsg
+);
+  /* startpool(numtasks,numworkers,run,arg,errmsg) returns a pointer  */
+  /* to a new pool which will call run(arg,task) once for each task   */
+  /* from 0 through numtasks - 1.  If par was compiled with           */
+  /* PAR_THREADS defined, the calls are made by numworkers threads    */
+  /* (which may be fewer if there are fewer tasks) that share the     */
+  /* tasks by work stealing; otherwise each call is made by           */
+  /* waittask().  run must be safe to call from several threads at    */
+  /* once.  numtasks and numworkers must be positive.  Returns NULL   */
+  /* on failure.                                                      */
+
+
+pool *startstream(
+  int window, int numworkers, int (*produce)(void *arg, int task),
+  void (*run)(void *arg, int task), void *arg, errmsg_t errmsg
+);
+  /* startstream(window,numworkers,produce,run,arg,errmsg) returns a  */
+  /* pointer to a new pool for tasks that are not known in advance.   */
+  /* produce(arg,task) is called for task 0, 1, 2, and so on, in      */
+  /* order, and returns 1 if it has made that task or 0 if there are  */
+  /* no more (in which case it is not called again).  run(arg,task)   */
+  /* is then called once for each task made.  No task is made until  */
+  /* every task at least window before it has been released by        */
+  /* releasetask(), so the caller can keep the tasks in a ring of     */
+  /* window slots.  If par was compiled with PAR_THREADS defined,     */
+  /* produce is called by a thread of its own and run by numworkers   */
+  /* others; otherwise both are called by waittask().  run must be    */
+  /* safe to call from several threads at once, and at the same time  */
+  /* as produce.  window and numworkers must be positive.  Returns    */
+  /* NULL on failure.                                                 */
+
+
+int waittask(pool *p, int task);
+
+  /* waittask(p,task) returns 1 once run(arg,task) has returned,  */
+  /* or 0 if produce() has reported that there is no such task.   */
+
+
+void releasetask(pool *p, int task);
+
+  /* releasetask(p,task) tells a pool made by startstream() that   */
+  /* the caller is finished with task, and with every task before  */
+  /* it.  It has no effect on a pool made by startpool().          */
+
+
+void endpool(pool *p);
+
+  /* endpool(p) discards any tasks that have not yet been started,    */
+  /* waits for those already started to finish, and frees the memory  */
+  /* associated with *p.  p may not be used after this call.          */
+
+
+#endif
@@ -1,24 +1,47 @@
 /*
 reformat.c
-last touched in Par 1.53.0
-last meaningful change in Par 1.53.0
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
 Copyright 1993, 2001, 2020 Adam M. Costello
 
 This is ANSI C code (C89).
 
-The issues regarding char and unsigned char are relevant to the use of
-the ctype.h functions.  See the comments near the beginning of par.c.
+Letters and digits are recognized by charsets passed in by the caller
+rather than by the ctype.h functions, so that reformatting does not
+depend on the locale at the time, only on the one in which the charsets
+were parsed.
+
+A paragraph longer than STREAMCHARS characters is not turned into a
+list of words.  Instead, the words are read from the input lines as
+they are needed, once per pass, and the line breaks are chosen by
+dynamic programming forward from the first word rather than backward
+from the last, keeping only the words that could still begin or end a
+line, plus any whose fate is not yet settled.  A line is passed on as
+soon as every path still under consideration breaks at both of its
+ends, which usually happens within a line or two.  The breaks chosen
+are exactly those the list-based code would choose: where it would
+choose among equally good breaks by preferring the longest first
+line, then the longest second line, and so on, the forward code
+compares the tied paths at the first place where they differ.
+
+If utf8 is 1, the lengths that matter when choosing line breaks are
+widths in columns, as counted by utf8width(), rather than numbers of
+characters, so each word and line has both.  A paragraph that turns
+out to be entirely ASCII, as most do, is handled as if utf8 were 0.
 
 */
 
 
 #include "reformat.h"  /* Makes sure we're consistent with the prototype. */
 
+#include "arena.h"
 #include "buffer.h"
 #include "charset.h"
 #include "errmsg.h"
+#include "memscan.h"
+#include "stats.h"
+#include "utf8.h"
 
-#include <ctype.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,514 +57,1728 @@ the ctype.h functions.  See the comments near the beginning of par.c.
 
 typedef unsigned char wflag_t;
 
-typedef struct word {
-  const char *chrs;       /* Pointer to the characters in the word */
-                          /* (NOT terminated by '\0').             */
-  struct word *prev,      /* Pointer to previous word.             */
-              *next,      /* Pointer to next word.                 */
-                          /* Supposing this word were the first... */
-              *nextline;  /*   Pointer to first word in next line. */
-  int score,              /*   Value of the objective function.    */
-      length;             /* Length of this word.                  */
-  wflag_t flags;          /* Notable properties of this word.      */
-} word;
-
 /* The following may be bitwise-OR'd together */
-/* to set the flags field of a word:          */
+/* to describe a word while guessing:         */
 
 static const wflag_t
-  W_SHIFTED = 1,  /* This word should have an extra space before */
-                  /* it unless it's the first word in the line.  */
   W_CURIOUS = 2,  /* This is a curious word (see par.doc).       */
   W_CAPITAL = 4;  /* This is a capitalized word (see par.doc).   */
 
-#define isshifted(w) ( (w)->flags & 1)
-#define iscurious(w) (((w)->flags & 2) != 0)
-#define iscapital(w) (((w)->flags & 4) != 0)
-
-
-static int checkcapital(word *w)
-/* Returns 1 if *w is capitalized according to the definition */
-/* in par.doc (assuming <cap> is 0), or 0 if not.             */
+/* The words of a paragraph, kept in parallel arrays rather than as */
+/* a list of separate nodes, so that the loops that choose line     */
+/* breaks walk memory in order:                                     */
+
+typedef struct wordlist {
+  int numwords;           /* Number of words.                          */
+  const char **chrs;      /* chrs[i] points to the characters in word  */
+                          /* i (NOT terminated by '\0').               */
+  int *length,            /* length[i] is the length of word i, and    */
+      *width;             /* width[i] is its width (width is length    */
+                          /* unless utf8 is 1).                        */
+  unsigned char *shifted; /* shifted[i] is 1 if word i should have an  */
+                          /* extra space before it unless it's the     */
+                          /* first word in the line, else 0.           */
+  long *pos;              /* pos[i] is the total, over all words       */
+                          /* before i, of 1 + width + shifted (there   */
+                          /* are numwords + 1 of these).               */
+                          /* Supposing word i were the first...        */
+  int *score,             /*   score[i] is the value of the objective  */
+                          /*   function (there is room for numwords +  */
+                          /*   1 of these), and                        */
+      *nextline;          /*   nextline[i] is the first word in the    */
+                          /*   next line, or numwords if none.         */
+  int *cands, *bounds;    /* Scratch space for lwsbreaks() (there is   */
+                          /* room for numwords + 1 of each).           */
+  parstats *stats;        /* Where the work is counted, or NULL.       */
+  const breakmemo *memo;  /* The breaks of an earlier paragraph with   */
+                          /* the same L, fit, just, and last, or NULL. */
+  int kept,               /* The number of words at the end of each    */
+                          /* that are alike (see keptwords()).         */
+      target, bound;      /* Set by normalbreaks() and justbreaks() to */
+                          /* the target length of the lines, and to    */
+                          /* the length of the shortest line or the    */
+                          /* largest gap.                              */
+} wordlist;
+
+/* A breakmemo remembers the words of a paragraph and the breaks    */
+/* chosen for them, as far as they matter for choosing the breaks   */
+/* of another paragraph, typically the same one after an edit.      */
+/* score[i] and nextline[i] depend only on words i and later, and   */
+/* on the target and bound, so wherever a later paragraph ends with */
+/* the same words, and has the same target and bound, they are      */
+/* already known.  The target and bound themselves must be found    */
+/* again, but the old ones can be checked more quickly than new     */
+/* ones can be found, and usually still hold:                       */
+
+struct breakmemo {
+  int numwords, size;     /* The words remembered, with room for size. */
+  int *width, *score,     /* As in the wordlist they came from.        */
+      *nextline;
+  unsigned char *shifted;
+  int L, fit, just, last, /* The arguments of reformatto() that the    */
+                          /* breaks depend on.                         */
+      target, bound;      /* As in the wordlist.                       */
+};
+
+/* The length of a line holding words i through j - 1 is     */
+/* wl->pos[j] - STARTOF(wl,i), which is why pos is kept:     */
+
+#define STARTOF(wl,i) ((wl)->pos[i] + 1 + (wl)->shifted[i])
+
+
+static int checkcapital(
+  const char *chrs, int length, const charset *alnumchars,
+  const charset *lowerchars
+)
+/* Returns 1 if the word of the given length at chrs is capitalized */
+/* according to the definition in par.doc (assuming <cap> is 0), or */
+/* 0 if not.  alnumchars and lowerchars are the sets of             */
+/* alphanumeric and lower case characters.                          */
 {
   const char *p, *end;
 
-  for (p = w->chrs, end = p + w->length;
-       p < end && !isalnum(*(unsigned char *)p);
+  for (p = chrs, end = p + length;
+       p < end && !csmember(*p, alnumchars);
        ++p);
-  return p < end && !islower(*(unsigned char *)p);
+  return p < end && !csmember(*p, lowerchars);
 }
 
 
-static int checkcurious(word *w, const charset *terminalchars)
-/* Returns 1 if *w is curious according to */
-/* the definition in par.doc, or 0 if not. */
+static int checkcurious(
+  const char *chrs, int length, const charset *terminalchars,
+  const charset *alnumchars
+)
+/* Returns 1 if the word of the given length at chrs is curious */
+/* according to the definition in par.doc, or 0 if not.         */
 {
   const char *start, *p;
   char ch;
 
-  for (start = w->chrs, p = start + w->length;  p > start;  --p) {
+  for (start = chrs, p = start + length;  p > start;  --p) {
     ch = p[-1];
-    if (isalnum(*(unsigned char *)&ch)) return 0;
+    if (csmember(ch, alnumchars)) return 0;
     if (csmember(ch,terminalchars)) break;
   }
 
   if (p <= start + 1) return 0;
 
   --p;
-  do if (isalnum(*(unsigned char *)--p)) return 1;
+  do if (csmember(*--p, alnumchars)) return 1;
   while (p > start);
 
   return 0;
 }
 
 
-static int simplebreaks(word *head, word *tail, int L, int last)
+breakmemo *newbreakmemo(errmsg_t errmsg)
+{
+  breakmemo *bm;
+
+  bm = calloc(1, sizeof (breakmemo));
+  if (!bm) {
+    strcpy(errmsg,outofmem);
+    return NULL;
+  }
+
+  *errmsg = '\0';
+  return bm;
+}
+
+
+void freebreakmemo(breakmemo *bm)
+{
+  if (bm->width) free(bm->width);
+  if (bm->score) free(bm->score);
+  if (bm->nextline) free(bm->nextline);
+  if (bm->shifted) free(bm->shifted);
+  free(bm);
+}
+
+
+static int keptwords(const wordlist *wl, const breakmemo *bm)
+
+/* Returns the number of words at the end of *wl that have the same */
+/* widths and shiftedness as those at the end of *bm.               */
+{
+  int i = wl->numwords, j = bm->numwords;
+
+  while (   i > 0 && j > 0 && wl->width[i - 1] == bm->width[j - 1]
+         && wl->shifted[i - 1] == bm->shifted[j - 1])
+    --i, --j;
+
+  return wl->numwords - i;
+}
+
+
+static void remember(
+  breakmemo *bm, const wordlist *wl, int L, int fit, int just, int last,
+  errmsg_t errmsg
+)
+/* Makes *bm remember the words and breaks of *wl, which were chosen */
+/* for the given values of L, fit, just, and last.  On failure, *bm  */
+/* remembers nothing.                                                */
+{
+  int n = wl->numwords, size;
+  void *width, *score, *nextline, *shifted;
+
+  *errmsg = '\0';
+
+  if (n > bm->size) {
+    size =  2 * bm->size > n  ?  2 * bm->size  :  n;
+    width = realloc(bm->width, size * sizeof (int));
+    if (width) bm->width = width;
+    score = realloc(bm->score, size * sizeof (int));
+    if (score) bm->score = score;
+    nextline = realloc(bm->nextline, size * sizeof (int));
+    if (nextline) bm->nextline = nextline;
+    shifted = realloc(bm->shifted, size);
+    if (shifted) bm->shifted = shifted;
+    if (!width || !score || !nextline || !shifted) {
+      bm->numwords = 0;
+      strcpy(errmsg,outofmem);
+      return;
+    }
+    bm->size = size;
+  }
+
+  memcpy(bm->width, wl->width, n * sizeof (int));
+  memcpy(bm->score, wl->score, n * sizeof (int));
+  memcpy(bm->nextline, wl->nextline, n * sizeof (int));
+  memcpy(bm->shifted, wl->shifted, n);
+  bm->numwords = n;
+  bm->L = L, bm->fit = fit, bm->just = just, bm->last = last;
+  bm->target = wl->target, bm->bound = wl->bound;
+}
 
-/* Chooses line breaks in a list of words which maximize the length of the   */
-/* shortest line.  L is the maximum line length.  The last line counts as a  */
-/* line only if last is non-zero. _head must point to a dummy word, and tail */
-/* must point to the last word, whose next field must be NULL.  Returns the  */
-/* length of the shortest line on success, -1 if there is a word of length   */
-/* greater than L, or L if there are no lines.                               */
+
+static void reusebreaks(wordlist *wl)
+
+/* Copies into wl->score and wl->nextline the values remembered in */
+/* *wl->memo for the last wl->kept words, and sets wl->score[n] to */
+/* 0 (n being the number of words).                                */
 {
-  word *w1, *w2;
-  int linelen, score;
+  const breakmemo *bm = wl->memo;
+  int n = wl->numwords, d = bm->numwords - n, i;
+
+  for (i = n - wl->kept;  i < n;  ++i) {
+    wl->score[i] = bm->score[i + d];
+    wl->nextline[i] = bm->nextline[i + d] - d;
+  }
+  wl->score[n] = 0;
+}
 
-  if (!head->next) return L;
 
-  for (w1 = tail, linelen = w1->length;
-       w1 != head && linelen <= L;
-       linelen += isshifted(w1), w1 = w1->prev, linelen += 1 + w1->length) {
-    w1->score = last ? linelen : L;
-    w1->nextline = NULL;
+static int simplebreaks(wordlist *wl, int L, int last)
+
+/* Chooses line breaks in the words of *wl which maximize the length of */
+/* the shortest line.  L is the maximum line length.  The last line     */
+/* counts as a line only if last is non-zero.  Returns the length of    */
+/* the shortest line on success, -1 if there is a word of length        */
+/* greater than L, or L if there are no lines.                          */
+{
+  const long *pos = wl->pos;
+  int *score = wl->score, *nextline = wl->nextline;
+  int n = wl->numwords, i, j, linelen, sc;
+  long start;
+  unsigned long relax = 0;
+
+  if (!n) return L;
+
+  for (i = n - 1;  i >= 0 && pos[n] - STARTOF(wl,i) <= L;  --i) {
+    score[i] = last ? pos[n] - STARTOF(wl,i) : L;
+    nextline[i] = n;
   }
 
-  for ( ;  w1 != head;  w1 = w1->prev) {
-    w1->score = -1;
-    for (linelen = w1->length,  w2 = w1->next;
-         linelen <= L;
-         linelen += 1 + isshifted(w2) + w2->length,  w2 = w2->next) {
-      score = w2->score;
-      if (linelen < score) score = linelen;
-      if (score >= w1->score) {
-        w1->nextline = w2;
-        w1->score = score;
+  for ( ;  i >= 0;  --i) {
+    start = STARTOF(wl,i);
+    score[i] = -1;
+    for (j = i + 1;  pos[j] - start <= L;  ++j) {
+      linelen = pos[j] - start;
+      sc = score[j];
+      if (linelen < sc) sc = linelen;
+      if (sc >= score[i]) {
+        nextline[i] = j;
+        score[i] = sc;
       }
     }
+    relax += j - i - 1;
   }
 
-  return head->next->score;
+  if (wl->stats) wl->stats->simplerelax += relax;
+  return score[0];
+}
+
+
+static int feasible(wordlist *wl, int minlen, int L, int last)
+
+/* Returns 1 if the words of *wl can be broken into lines no longer */
+/* than L, none of which is shorter than minlen (except that the    */
+/* last line is exempt if last is 0), or 0 if not.  This is the     */
+/* same as asking whether simplebreaks(wl,L,last) would return at   */
+/* least minlen (provided minlen <= L), but it takes time linear in */
+/* the number of words, because the lines ending just before word j */
+/* that are short enough begin at or after some word lo, and those  */
+/* that are long enough begin before some word hi, and neither lo   */
+/* nor hi ever decreases as j increases.  Once no word from lo to j */
+/* can begin a line, no later word can either, so the answer is     */
+/* usually found early when it is 0.  wl->score is overwritten.     */
+{
+  const long *pos = wl->pos;
+  int *count = wl->score;  /* count[j] is the number of words before */
+                           /* word j that can begin a line.          */
+  int n = wl->numwords, j, lo = 0, hi = 0, ok;
+
+  count[0] = 0;
+  count[1] = 1;
+  for (j = 1;  ;  ++j) {
+    while (lo < j && pos[j] - STARTOF(wl,lo) > L) ++lo;
+    if (j == n && !last) hi = j;
+    else while (hi < j && pos[j] - STARTOF(wl,hi) >= minlen) ++hi;
+    ok = hi > lo && count[hi] > count[lo];
+    if (j == n) break;
+    count[j + 1] = count[j] + ok;
+    if (count[j + 1] == count[lo]) {
+      ok = 0;
+      break;
+    }
+  }
+
+  if (wl->stats) wl->stats->normalrelax += j;
+  return ok;
+}
+
+
+static int beats(wordlist *wl, int c, int f, int i, int target)
+
+/* Returns 1 if a line of words i through c - 1, followed by the best  */
+/* lines for the words from c on, scores strictly lower than a line of */
+/* words i through f - 1, followed by the best lines for the words     */
+/* from f on, or if the latter line is longer than target; returns 0   */
+/* if not.  c must be less than f, and score[c] and score[f] must not  */
+/* be negative.                                                        */
+{
+  long start = STARTOF(wl,i);
+  int lenc = wl->pos[c] - start, lenf = wl->pos[f] - start;
+
+  if (wl->stats) ++wl->stats->normalrelax;
+  if (lenf > target) return 1;
+  return   (target - lenc) * (target - lenc) + wl->score[c]
+         < (target - lenf) * (target - lenf) + wl->score[f];
+}
+
+
+static void lwsbreaks(wordlist *wl, int target, int shortest, int last)
+
+/* Sets wl->score and wl->nextline exactly as the reference loop at the */
+/* end of normalbreaks() does, in time proportional to n log n rather   */
+/* than to n times the number of words per line (n being the number of */
+/* words).  Because the square of the difference between target and a  */
+/* line's length grows faster the further the line is from target, if  */
+/* a line ending before word c beats one ending before a later word f  */
+/* (in the sense of beats()) when it begins at word i, it also does so */
+/* when it begins at any word before i.  So as i decreases, a queue of */
+/* candidate ends is kept, ordered from the last word to the first, in */
+/* which each candidate is the best end for a range of words, and the  */
+/* ranges are ordered the same way.  A new candidate c displaces those */
+/* at the front of the queue that it beats over their whole range, and */
+/* its range is found by binary search.  Candidates whose lines become */
+/* too long, or whose ranges have been passed, leave from the back.    */
+/* Ties are broken in favor of the longer line, as they are there.     */
+{
+  const long *pos = wl->pos;
+  int *score = wl->score, *nextline = wl->nextline,
+      *cands = wl->cands,  /* cands[k] for back <= k < front are the     */
+      *bounds = wl->bounds,/* candidates, and cands[k] is best for words */
+                           /* bounds[k + 1] + 1 through bounds[k].       */
+      n = wl->numwords, i, c, f, r, lo, hi, mid, step, len,
+      entered, back = 0, front = 0;
+  long start;
+
+  score[n] = 0;
+  entered =  last  ?  n + 1  :  n;  /* The first word j that has been */
+                                    /* considered as a candidate.     */
+  for (i = n - 1;  i >= 0;  --i) {
+    start = STARTOF(wl,i);
+
+  /* Add the candidates that can end a line long enough */
+  /* beginning at word i, but not at word i + 1:        */
+
+    while (entered - 1 > i && pos[entered - 1] - start >= shortest) {
+      c = --entered;
+      if (score[c] < 0) continue;
+      for (;;) {
+        if (front == back) {
+          cands[front] = c;
+          bounds[front++] = i;
+          break;
+        }
+        f = cands[front - 1];
+        hi =  bounds[front - 1] < i  ?  bounds[front - 1]  :  i;
+        if (beats(wl,c,f,hi,target)) {
+          --front;
+          continue;
+        }
+        for (lo = hi, step = 1;  ;  step *= 2) {
+          r = lo - step;
+          if (r < 0) {
+            r = -1;
+            break;
+          }
+          if (beats(wl,c,f,r,target)) break;
+          lo = r;
+        }
+        while (lo - r > 1) {
+          mid = r + (lo - r) / 2;
+          if (beats(wl,c,f,mid,target)) r = mid;
+          else lo = mid;
+        }
+        if (r >= 0) {
+          cands[front] = c;
+          bounds[front++] = r;
+        }
+        break;
+      }
+    }
+
+  /* The last line, if it is exempt, needs only to fit: */
+
+    if (!last && pos[n] - start <= target) {
+      score[i] = 0;
+      nextline[i] = n;
+      continue;
+    }
+
+    while (back < front && (pos[cands[back]] - start > target
+                            || (back + 1 < front && bounds[back + 1] >= i)))
+      ++back;
+    if (back == front) {
+      score[i] = -1;
+      continue;
+    }
+    c = cands[back];
+    len = pos[c] - start;
+    score[i] = (target - len) * (target - len) + score[c];
+    nextline[i] = c;
+  }
+}
+
+
+static void solvenormal(
+  wordlist *wl, int target, int shortest, int last, int from
+)
+/* Sets wl->score[i] and wl->nextline[i] for each word i before word */
+/* from, down to word 0, by the reference loop of normalbreaks(),    */
+/* with target and shortest as found there.  Those for the words     */
+/* from word from on must already be set.                            */
+{
+  const long *pos = wl->pos;
+  int *score = wl->score, *nextline = wl->nextline;
+  int n = wl->numwords, i, j, sc, linelen, extra, minlen;
+  long start;
+  unsigned long relax = 0;
+
+  for (i = from - 1;  i >= 0;  --i) {
+    start = STARTOF(wl,i);
+    score[i] = -1;
+    for (j = i + 1;  j <= n && pos[j] - start <= target;  ++j) {
+      linelen = pos[j] - start;
+      extra = target - linelen;
+      minlen = shortest;
+      if (j < n)
+        sc = score[j];
+      else {
+        sc = 0;
+        if (!last) extra = minlen = 0;
+      }
+      if (linelen >= minlen  &&  sc >= 0) {
+        sc += extra * extra;
+        if (score[i] < 0  ||  sc <= score[i]) {
+          nextline[i] = j;
+          score[i] = sc;
+        }
+      }
+    }
+    relax += j - i - 1;
+  }
+
+  if (wl->stats) wl->stats->normalrelax += relax;
+}
+
+
+static int holdsshortest(wordlist *wl, int shortest, int target, int last)
+
+/* Returns 1 if shortest is the greatest length that the shortest  */
+/* line can have when the words of *wl are broken into lines no    */
+/* longer than target (as found in normalbreaks()), or 0 if not.   */
+{
+  return    feasible(wl,shortest,target,last)
+         && (shortest >= target || !feasible(wl,shortest + 1,target,last));
 }
 
 
 static void normalbreaks(
-  word *head, word *tail, int L, int fit, int last, errmsg_t errmsg
+  wordlist *wl, int L, int fit, int last, int reference, errmsg_t errmsg
 )
-/* Chooses line breaks in a list of words according to the policy   */
+/* Chooses line breaks in the words of *wl according to the policy  */
 /* in "par.doc" for <just> = 0 (L is <L>, fit is <fit>, and last is */
-/* <last>).  head must point to a dummy word, and tail must point   */
-/* to the last word, whose next field must be NULL.                 */
+/* <last>).  If reference is non-zero, the simplest code is used,   */
+/* which takes much longer for long paragraphs or large widths, but */
+/* chooses the same breaks.  Otherwise, if wl->memo is not NULL,    */
+/* what it remembers is reused wherever it still holds.             */
 {
-  word *w1, *w2;
-  int tryL, shortest, score, target, linelen, extra, minlen;
+  const breakmemo *bm =  reference  ?  NULL  :  wl->memo;
+  const long *pos = wl->pos;
+  int n = wl->numwords, i, tryL, shortest, sc, seed, target, minlen,
+      maxlen, toolong;
+  unsigned long tries = 0;
 
   *errmsg = '\0';
-  if (!head->next) return;
+  if (!n) return;
 
   target = L;
-
-/* Determine minimum possible difference between  */
-/* the lengths of the shortest and longest lines: */
-
-  if (fit) {
-    score = L + 1;
+  sc = L + 1;
+
+/* Determine minimum possible difference between the lengths of the  */
+/* shortest and longest lines.  Allowing longer lines can only make  */
+/* the shortest line longer, so a width tryL can beat the smallest   */
+/* difference sc found so far (at a greater width) only if there is  */
+/* a way to break the lines with none shorter than tryL - sc + 1,    */
+/* and only then is the length of the shortest line for tryL needed. */
+/* That length is then found by binary search.  Every width down to */
+/* the length of the longest word is considered, and the greatest    */
+/* width with the smallest difference is chosen, just as if          */
+/* simplebreaks() had been called for each one, which is what the    */
+/* reference code does.  Starting sc at one more than the difference */
+/* remembered in bm skips the searches for widths that cannot win,   */
+/* and chooses the same width unless none does as well as that, in   */
+/* which case the search is done again from the start:               */
+
+  if (fit && reference) {
     for (tryL = L;  ;  --tryL) {
-      shortest = simplebreaks(head,tail,tryL,last);
+      ++tries;
+      shortest = simplebreaks(wl,tryL,last);
       if (shortest < 0) break;
-      if (tryL - shortest < score) {
+      if (tryL - shortest < sc) {
         target = tryL;
-        score = target - shortest;
+        sc = target - shortest;
       }
     }
   }
+  else if (fit) {
+    for (maxlen = 0, i = 0;  i < n;  ++i)
+      if (wl->width[i] > maxlen) maxlen = wl->width[i];
+    seed =  bm  ?  bm->target - bm->bound + 1  :  L + 1;
+    for (;;) {
+      sc = seed;
+      for (tryL = L;  tryL >= maxlen && sc > 0;  --tryL) {
+        ++tries;
+        shortest = tryL - sc + 1;
+        if (!feasible(wl,shortest,tryL,last)) continue;
+        toolong = tryL + 1;
+        while (toolong - shortest > 1) {
+          minlen = shortest + (toolong - shortest) / 2;
+          if (feasible(wl,minlen,tryL,last)) shortest = minlen;
+          else toolong = minlen;
+        }
+        target = tryL;
+        sc = target - shortest;
+      }
+      if (sc < seed || seed > L) break;
+      seed = L + 1;
+    }
+  }
 
-/* Determine maximum possible length of the shortest line: */
-
-  shortest = simplebreaks(head,tail,target,last);
+/* Determine maximum possible length of the shortest line, which the */
+/* search above has already found if it found anything, and which is */
+/* usually the one remembered in bm, if that is for the same target. */
+/* Unless there are many words per line, simplebreaks() is quicker   */
+/* than a binary search like the one above:                          */
+
+  if (fit && !reference && sc <= L) shortest = target - sc;
+  else if (   bm && bm->target == target
+           && holdsshortest(wl,bm->bound,target,last))
+    shortest = bm->bound;
+  else if (reference || (long) target * n < 64 * pos[n])
+    shortest = simplebreaks(wl,target,last);
+  else if (!feasible(wl,0,target,last)) shortest = -1;
+  else {
+    shortest = 0;
+    toolong = target + 1;
+    while (toolong - shortest > 1) {
+      minlen = shortest + (toolong - shortest) / 2;
+      if (feasible(wl,minlen,target,last)) shortest = minlen;
+      else toolong = minlen;
+    }
+  }
   if (shortest < 0) {
     sprintf(errmsg,impossibility,1);
     return;
   }
+  wl->target = target;
+  wl->bound = shortest;
+
+/* Minimize the sum of the squares of the differences between    */
+/* target and the lengths of the lines.  The scores remembered   */
+/* in bm for the same words are reused if the target and the     */
+/* shortest length are the same, and the rest are found by the   */
+/* reference loop, unless lwsbreaks() would be quicker:          */
+
+  if (reference) solvenormal(wl,target,shortest,last,n);
+  else if (   bm && wl->kept && bm->target == target
+           && bm->bound == shortest
+           && (long) target * (n - wl->kept) < 16 * pos[n]) {
+    reusebreaks(wl);
+    solvenormal(wl,target,shortest,last,n - wl->kept);
+  }
+  else lwsbreaks(wl,target,shortest,last);
 
-/* Minimize the sum of the squares of the differences */
-/* between target and the lengths of the lines:       */
+  if (wl->stats) wl->stats->tryls += tries;
+  if (wl->score[0] < 0)
+    sprintf(errmsg,impossibility,2);
+}
 
-  w1 = tail;
-  do {
-    w1->score = -1;
-    for (linelen = w1->length,  w2 = w1->next;
-         linelen <= target;
-         linelen += 1 + isshifted(w2) + w2->length,  w2 = w2->next) {
-      extra = target - linelen;
-      minlen = shortest;
-      if (w2)
-        score = w2->score;
-      else {
-        score = 0;
-        if (!last) extra = minlen = 0;
-      }
-      if (linelen >= minlen  &&  score >= 0) {
-        score += extra * extra;
-        if (w1->score < 0  ||  score <= w1->score) {
-          w1->nextline = w2;
-          w1->score = score;
-        }
+
+static int justfeasible(wordlist *wl, int maxgap, int L, int last)
+
+/* Returns 1 if the words of *wl can be broken into lines no longer   */
+/* than L that can be justified to length L without putting more than */
+/* maxgap extra spaces in any gap between words (except that the last */
+/* line is exempt if last is 0), or 0 if not.  Works like feasible(): */
+/* a line ending just before word j that is short enough begins at or */
+/* after some word lo, and one that has enough gaps for its extra     */
+/* spaces begins before some word hi, and neither decreases as j      */
+/* increases.  wl->score is overwritten.                              */
+{
+  const long *pos = wl->pos;
+  int *count = wl->score;  /* count[j] is the number of words before */
+                           /* word j that can begin a line.          */
+  int n = wl->numwords, j, lo = 0, hi = 0, ok;
+
+  count[0] = 0;
+  count[1] = 1;
+  for (j = 1;  ;  ++j) {
+    while (lo < j && pos[j] - STARTOF(wl,lo) > L) ++lo;
+    if (j == n && !last) hi = j;
+    else
+      while (hi < j - 1  &&    L - (pos[j] - STARTOF(wl,hi))
+                            <= (long) maxgap * (j - hi - 1))
+        ++hi;
+    ok = hi > lo && count[hi] > count[lo];
+    if (j == n) break;
+    count[j + 1] = count[j] + ok;
+    if (count[j + 1] == count[lo]) {
+      ok = 0;
+      break;
+    }
+  }
+
+  if (wl->stats) wl->stats->justrelax += j;
+  return ok;
+}
+
+
+static void solvejust(wordlist *wl, int L, int maxgap, int last, int from)
+
+/* Sets wl->score[i] and wl->nextline[i] for each word i before word */
+/* from, down to word 0, by the faster loop of justbreaks(), with    */
+/* maxgap as found there, and sets wl->score[n] to 0 (n being the    */
+/* number of words).  Those for the words from word from on must     */
+/* already be set.  The faster loop considers only the lines that    */
+/* need no gap larger than maxgap, which are those ending before     */
+/* word jlo or later, where jlo never increases as i decreases.      */
+{
+  const long *pos = wl->pos;
+  int *score = wl->score, *nextline = wl->nextline;
+  int n = wl->numwords, i, j, jlo, numgaps, extra, sc, numbiggaps;
+  long start;
+  unsigned long relax = 0;
+
+  score[n] = 0;
+  for (jlo = n + 1, i = from - 1;  i >= 0;  --i) {
+    start = STARTOF(wl,i);
+    if (!last && pos[n] - start <= L) {
+      nextline[i] = n;
+      score[i] = 0;
+      continue;
+    }
+    while (jlo - 1 >= i + 2  &&    L - (pos[jlo - 1] - start)
+                                <= (long) maxgap * (jlo - i - 2))
+      --jlo;
+    score[i] = -1;
+    for (j = jlo;  j <= n && pos[j] - start <= L;  ++j) {
+      sc = score[j];
+      if (sc < 0) continue;
+      extra = L - (pos[j] - start);
+      numgaps = j - i - 1;
+      numbiggaps = extra % numgaps;
+      sc += (extra / numgaps) * (extra + numbiggaps) + numbiggaps;
+      if (score[i] < 0  ||  sc <= score[i]) {
+        nextline[i] = j;
+        score[i] = sc;
       }
-      if (!w2) break;
     }
-    w1 = w1->prev;
-  } while (w1 != head);
+    relax += j - jlo;
+  }
 
-  if (head->next->score < 0)
-    sprintf(errmsg,impossibility,2);
+  if (wl->stats) wl->stats->justrelax += relax;
+}
+
+
+static int holdsmaxgap(wordlist *wl, int maxgap, int L, int last)
+
+/* Returns 1 if maxgap is the smallest largest gap that justifying */
+/* the words of *wl to length L needs (as found in justbreaks()),  */
+/* or 0 if not.                                                    */
+{
+  return    maxgap < L && justfeasible(wl,maxgap,L,last)
+         && (maxgap == 0 || !justfeasible(wl,maxgap - 1,L,last));
 }
 
 
 static void justbreaks(
-  word *head, word *tail, int L, int last, errmsg_t errmsg
+  wordlist *wl, int L, int last, int reference, errmsg_t errmsg
 )
-/* Chooses line breaks in a list of words according to the  */
-/* policy in "par.doc" for <just> = 1 (L is <L> and last is */
-/* <last>).  head must point to a dummy word, and tail must */
-/* point to the last word, whose next field must be NULL.   */
+/* Chooses line breaks in the words of *wl according to the policy */
+/* in "par.doc" for <just> = 1 (L is <L> and last is <last>).  If  */
+/* reference is non-zero, the simplest code is used, which takes   */
+/* much longer for long paragraphs or large widths, but chooses    */
+/* the same breaks.  Otherwise, if wl->memo is not NULL, what it   */
+/* remembers is reused wherever it still holds.                    */
 {
-  word *w1, *w2;
-  int numgaps, extra, score, gap, maxgap, numbiggaps;
+  const breakmemo *bm =  reference  ?  NULL  :  wl->memo;
+  const long *pos = wl->pos;
+  int *score = wl->score, *nextline = wl->nextline;
+  int n = wl->numwords, i, j, numgaps, extra, sc, gap, maxgap, numbiggaps,
+      toobig;
+  long start;
+  unsigned long relax = 0;
 
   *errmsg = '\0';
-  if (!head->next) return;
-
-/* Determine the minimum possible largest inter-word gap: */
-
-  w1 = tail;
-  do {
-    w1->score = L;
-    for (numgaps = 0, extra = L - w1->length, w2 = w1->next;
-         extra >= 0;
-         ++numgaps, extra -= 1 + isshifted(w2) + w2->length, w2 = w2->next) {
-      gap = numgaps ? (extra + numgaps - 1) / numgaps : L;
-      if (w2)
-        score = w2->score;
-      else {
-        score = 0;
-        if (!last) gap = 0;
+  if (!n) return;
+
+/* Determine the minimum possible largest inter-word gap.  The one   */
+/* remembered in bm usually still holds, which two calls to          */
+/* justfeasible() can show.  When lines hold many words, the faster   */
+/* code tries 0, 1, 3, 7, and so on until justfeasible() succeeds,   */
+/* then finds the smallest by binary search.  The answer is usually  */
+/* small, and most of the tries that fail, fail early.  Otherwise it */
+/* tries every line, as the reference code does, but divides only    */
+/* for lines that would lower score[i]:                              */
+
+  if (bm && holdsmaxgap(wl,bm->bound,L,last)) maxgap = bm->bound;
+  else if (!reference && (long) L * n >= 32 * pos[n]) {
+    toobig = -1;  /* justfeasible() fails for toobig, and succeeds for */
+    maxgap = L;   /* maxgap unless it is L, which stands for failure.  */
+    for (gap = 0;  gap < L;  gap = 2 * gap + 1) {
+      if (justfeasible(wl,gap,L,last)) {
+        maxgap = gap;
+        break;
       }
-      if (gap > score) score = gap;
-      if (score < w1->score) {
-        w1->nextline = w2;
-        w1->score = score;
+      toobig = gap;
+    }
+    while (maxgap - toobig > 1) {
+      gap = toobig + (maxgap - toobig) / 2;
+      if (justfeasible(wl,gap,L,last)) maxgap = gap;
+      else toobig = gap;
+    }
+  }
+  else if (!reference) {
+    for (i = n - 1;  i >= 0;  --i) {
+      start = STARTOF(wl,i);
+      score[i] = L;
+      if (!last && pos[n] - start <= L) {
+        score[i] = 0;
+        continue;
+      }
+      for (j = i + 2;  j <= n && pos[j] - start <= L;  ++j) {
+        sc =  j < n  ?  score[j]  :  0;
+        if (sc >= score[i]) continue;
+        extra = L - (pos[j] - start);
+        numgaps = j - i - 1;
+        if (extra > (score[i] - 1) * numgaps) continue;
+        gap = (extra + numgaps - 1) / numgaps;
+        score[i] =  gap > sc  ?  gap  :  sc;
+      }
+      relax += j - i - 2;
+    }
+    maxgap = score[0];
+  }
+  else {
+    for (i = n - 1;  i >= 0;  --i) {
+      start = STARTOF(wl,i);
+      score[i] = L;
+      for (j = i + 1;  j <= n && pos[j] - start <= L;  ++j) {
+        extra = L - (pos[j] - start);
+        numgaps = j - i - 1;
+        gap = numgaps ? (extra + numgaps - 1) / numgaps : L;
+        if (j < n)
+          sc = score[j];
+        else {
+          sc = 0;
+          if (!last) gap = 0;
+        }
+        if (gap > sc) sc = gap;
+        if (sc < score[i]) {
+          nextline[i] = j;
+          score[i] = sc;
+        }
       }
-      if (!w2) break;
+      relax += j - i - 1;
     }
-    w1 = w1->prev;
-  } while (w1 != head);
+    maxgap = score[0];
+  }
 
-  maxgap = head->next->score;
   if (maxgap >= L) {
     strcpy(errmsg, "Cannot justify.\n");
-    return;
+    goto jbcount;
+  }
+  wl->target = L;
+  wl->bound = maxgap;
+
+/* Minimize the sum of the squares of the numbers of extra spaces */
+/* required in each inter-word gap.  The scores remembered in bm  */
+/* for the same words are reused if maxgap is the same:           */
+
+  if (!reference) {
+    i = n;
+    if (bm && wl->kept && bm->bound == maxgap) {
+      reusebreaks(wl);
+      i -= wl->kept;
+    }
+    solvejust(wl,L,maxgap,last,i);
   }
+  else
+    for (i = n - 1;  i >= 0;  --i) {
+      start = STARTOF(wl,i);
+      score[i] = -1;
+      for (j = i + 1;  j <= n && pos[j] - start <= L;  ++j) {
+        extra = L - (pos[j] - start);
+        numgaps = j - i - 1;
+        gap = numgaps ? (extra + numgaps - 1) / numgaps : L;
+        if (j < n)
+          sc = score[j];
+        else {
+          if (!last) {
+            nextline[i] = n;
+            score[i] = 0;
+            break;
+          }
+          sc = 0;
+        }
+        if (gap <= maxgap && sc >= 0) {
+          numbiggaps = extra % numgaps;
+          sc += (extra / numgaps) * (extra + numbiggaps) + numbiggaps;
+          /* The above may not look like the sum of the squares of the numbers */
+          /* of extra spaces required in each inter-word gap, but trust me, it */
+          /* is.  It's easier to prove graphically than algebraicly.           */
+          if (score[i] < 0  ||  sc <= score[i]) {
+            nextline[i] = j;
+            score[i] = sc;
+          }
+        }
+      }
+      relax += j - i - 1;
+    }
 
-/* Minimize the sum of the squares of the numbers   */
-/* of extra spaces required in each inter-word gap: */
+  if (score[0] < 0)
+    sprintf(errmsg,impossibility,3);
 
-  w1 = tail;
-  do {
-    w1->score = -1;
-    for (numgaps = 0, extra = L - w1->length, w2 = w1->next;
-         extra >= 0;
-         ++numgaps, extra -= 1 + isshifted(w2) + w2->length, w2 = w2->next) {
-      gap = numgaps ? (extra + numgaps - 1) / numgaps : L;
-      if (w2)
-        score = w2->score;
+jbcount:
+
+  if (wl->stats) wl->stats->justrelax += relax;
+}
+
+
+/* A piece of a line handed to makeline(): */
+
+typedef struct piece {
+  const char *chrs;       /* Pointer to the characters in the word */
+                          /* (NOT terminated by '\0').             */
+  int length,             /* Length of this word.                  */
+      width,              /* Its width (see wordlist).             */
+      shifted;            /* 1 if the word is shifted, else 0.     */
+} piece;
+
+/* The state of makeline(), which builds the output lines: */
+
+typedef struct linemaker {
+  const char * const *inlines,  /* The input lines, as passed */
+             * const *endline;  /* to reformatto().           */
+  int numin, afp, fs, hang, prefix, suffix, L, just, last, utf8,
+      numout,                   /* Number of lines made.      */
+      more,                     /* See makeline().            */
+      size;                     /* Size of line.              */
+  char *line;                   /* Storage for one line.      */
+  arena *scratch;               /* Where to get a bigger one. */
+  void (*putline)(void *arg, const char *line, errmsg_t errmsg);
+  void *arg;
+} linemaker;
+
+
+static const char *endofline(const char *line)
+
+/* Returns a pointer to the '\0' that terminates line. */
+{
+  while (*line) ++line;
+  return line;
+}
+
+
+static int fillwidth(const linemaker *lm, const char *s, int n)
+
+/* Returns the width of the n characters at s, which is n unless */
+/* lm->utf8 is 1.                                                */
+{
+  return lm->utf8 ? utf8width(s,n) : n;
+}
+
+
+static void makeline(
+  linemaker *lm, const piece *pieces, int n, int more, errmsg_t errmsg
+)
+/* Builds the next output line from the n words in pieces (n may be 0 */
+/* for a line with no words, in which case more is ignored and the    */
+/* value from the previous call is used) and passes it to putline.    */
+/* more is 1 unless this is the last line of the paragraph to contain */
+/* words.  Spaces are added to fill out the prefix, body, and suffix  */
+/* to their widths, which differ from their lengths only if utf8 is   */
+/* 1, in which case the line may need to be longer than L + prefix + */
+/* suffix, and a longer one is allocated if necessary.                */
+{
+  int prefix = lm->prefix, suffix = lm->suffix, bodylen, numgaps, extra,
+      excess, phase, size, i;
+  char *q1, *q2;
+  const char *src, *suf;
+
+  if (n) lm->more = more;
+
+  numgaps = extra = excess = 0;
+  if (n) {
+    extra = lm->L - pieces->width;
+    excess = pieces->length - pieces->width;
+    for (i = 1;  i < n;  ++i) {
+      extra -= 1 + pieces[i].shifted + pieces[i].width;
+      excess += pieces[i].length - pieces[i].width;
+    }
+    numgaps = n - 1;
+  }
+  bodylen = suffix || (lm->just && (lm->more || lm->last)) ?
+              lm->L :
+              n ? lm->L - extra : 0;
+
+  size = prefix + lm->L + excess + suffix + 1;
+  if (size > lm->size) {
+    if (size < 2 * lm->size) size = 2 * lm->size;
+    q1 = arenaalloc(lm->scratch, size * sizeof (char), errmsg);
+    if (*errmsg) return;
+    lm->line = q1;
+    lm->size = size;
+  }
+
+  ++lm->numout;
+  q1 = lm->line;
+  src =  lm->numout <= lm->numin  ?  lm->inlines[lm->numout - 1]  :
+                                     lm->endline[-1];
+  if (lm->numout <= lm->numin || lm->numin > lm->hang) {
+    memcpy(q1, src, prefix);
+    q1 += prefix;
+  }
+  else {
+    if (lm->afp > prefix) lm->afp = prefix;
+    memcpy(q1, src, lm->afp);
+    q1 += lm->afp;
+    for (i = fillwidth(lm, src + lm->afp, prefix - lm->afp);  i > 0;  --i)
+      *q1++ = ' ';
+  }
+  q2 = q1 + bodylen + excess;
+  if (n) {
+    phase = numgaps / 2;
+    for (i = 0;  ;  ) {
+      memcpy(q1, pieces[i].chrs, pieces[i].length);
+      q1 += pieces[i].length;
+      if (++i == n) break;
+      *q1++ = ' ';
+      if (lm->just && (more || lm->last)) {
+        phase += extra;
+        while (phase >= numgaps) {
+          *q1++ = ' ';
+          phase -= numgaps;
+        }
+      }
+      if (pieces[i].shifted) *q1++ = ' ';
+    }
+  }
+  while (q1 < q2) *q1++ = ' ';
+  if (suffix) {
+    suf = endofline(src) - suffix;
+    if (lm->numin > lm->hang || lm->numout <= lm->numin) {
+      memcpy(q1, suf, suffix);
+      q1 += suffix;
+    }
+    else {
+      if (lm->fs > suffix) lm->fs = suffix;
+      memcpy(q1, suf, lm->fs);
+      q1 += lm->fs;
+      for (i = fillwidth(lm, suf + lm->fs, suffix - lm->fs);  i > 0;  --i)
+        *q1++ = ' ';
+    }
+  }
+  *q1 = '\0';
+
+  lm->putline(lm->arg, lm->line, errmsg);
+}
+
+
+/* The streaming line breaker: */
+
+#ifndef STREAMCHARS
+#define STREAMCHARS 1048576
+#endif
+
+/* A source of words, read from the lines of a paragraph one at a   */
+/* time and merged and split as necessary.  reformatto() drains one */
+/* into a wordlist; the streaming line breaker reads one per pass:  */
+
+typedef struct wsource {
+  const char * const *inlines,  /* The input lines, up to but not */
+             * const *endline,  /* including endline.             */
+             * const *line;     /* The next line to scan.         */
+  const char *body,             /* The body of the current line,  */
+             *p, *end;          /* the rest of it, and its end.   */
+  int prefix, suffix, L, cap, guess, Report, utf8,
+      onfirstword,              /* Set until the first word.      */
+      haveheld,                 /* Set if held is valid.          */
+      haverest;                 /* Set if rest is valid.          */
+  unsigned long splits;         /* Pieces split off long words.   */
+  const charset *terminalchars, *alnumchars, *lowerchars;
+  piece held,                   /* A word not yet passed on, in   */
+                                /* case it must be merged.        */
+        rest;                   /* The rest of a long word.       */
+  wflag_t heldflags;            /* The flags of held.             */
+} wsource;
+
+
+static void startsource(wsource *ws)
+
+/* Arranges for *ws to begin again with the first word. */
+{
+  ws->line = ws->inlines;
+  ws->p = ws->end = *ws->inlines;
+  ws->onfirstword = 1;
+  ws->haveheld = ws->haverest = 0;
+  ws->splits = 0;
+}
+
+
+static int rawword(wsource *ws, piece *pw)
+
+/* Sets *pw to the next word in the lines of *ws, before any merging */
+/* or splitting, and returns 1, or returns 0 if there are no more.   */
+{
+  const char *p1, *p2;
+
+  for (;;) {
+    while (ws->p < ws->end && *ws->p == ' ') ++ws->p;
+    if (ws->p < ws->end) break;
+    if (ws->line == ws->endline) return 0;
+    ws->body = ws->p = *ws->line + ws->prefix;
+    ws->end = endofline(*ws->line) - ws->suffix;
+    ++ws->line;
+  }
+
+  p1 = ws->p;
+  if (ws->onfirstword) {
+    p1 = ws->body;
+    ws->onfirstword = 0;
+  }
+  for (p2 = ws->p;  p2 < ws->end && *p2 != ' ';  ++p2);
+  pw->chrs = p1;
+  pw->length = p2 - p1;
+  pw->width =  ws->utf8  ?  utf8width(p1, p2 - p1)  :  p2 - p1;
+  pw->shifted = 0;
+  ws->p = p2;
+
+  return 1;
+}
+
+
+static int guessword(wsource *ws, piece *pw)
+
+/* Like rawword(), except that if guess is 1, words are shifted and */
+/* merged as described for the g option in par.doc.                 */
+{
+  piece w;
+  wflag_t flags;
+
+  if (!ws->guess) return rawword(ws,pw);
+
+  for (;;) {
+    if (!rawword(ws,&w)) {
+      if (!ws->haveheld) return 0;
+      *pw = ws->held;
+      ws->haveheld = 0;
+      return 1;
+    }
+    flags = 0;
+    if (checkcurious(w.chrs, w.length, ws->terminalchars, ws->alnumchars))
+      flags |= W_CURIOUS;
+    if (   ws->cap
+        || checkcapital(w.chrs, w.length, ws->alnumchars, ws->lowerchars)) {
+      flags |= W_CAPITAL;
+      if (ws->haveheld && (ws->heldflags & W_CURIOUS)) {
+        if (   ws->held.chrs[ws->held.length]
+            && ws->held.chrs + ws->held.length + 1 == w.chrs) {
+          w.length += ws->held.length + 1;
+          w.width += ws->held.width + 1;
+          w.chrs = ws->held.chrs;
+          w.shifted = ws->held.shifted;
+          flags &= ~W_CAPITAL;
+          flags |= ws->heldflags & W_CAPITAL;
+          ws->haveheld = 0;
+        }
+        else w.shifted = 1;
+      }
+    }
+    if (ws->haveheld) {
+      *pw = ws->held;
+      ws->held = w;
+      ws->heldflags = flags;
+      return 1;
+    }
+    ws->held = w;
+    ws->heldflags = flags;
+    ws->haveheld = 1;
+  }
+}
+
+
+static int nextword(wsource *ws, piece *pw, errmsg_t errmsg)
+
+/* Like guessword(), except that words wider than L are split, or */
+/* if Report is 1, cause an error (in which case 0 is returned),  */
+/* as does a word beginning with a character wider than L.        */
+{
+  int n, w;
+
+  if (ws->haverest) *pw = ws->rest;
+  else if (!guessword(ws,pw)) return 0;
+
+  ws->haverest = 0;
+  if (pw->width > ws->L) {
+    if (ws->utf8) n = utf8fit(pw->chrs, pw->length, ws->L, &w);
+    else n = w = ws->L;
+    if (ws->Report || w > ws->L) {
+      n = pw->length;
+      if (n > errmsg_size - 17)
+        n = errmsg_size - 17;
+      sprintf(errmsg, "Word too long: %.*s\n", n, pw->chrs);
+      return 0;
+    }
+    ws->rest = *pw;
+    ws->rest.chrs += n;
+    ws->rest.length -= n;
+    ws->rest.width -= w;
+    ws->rest.shifted = 0;
+    ws->haverest = 1;
+    ++ws->splits;
+    pw->length = n;
+    pw->width = w;
+  }
+
+  return 1;
+}
+
+
+/* A node is a place where a line may begin or end: node k is just */
+/* before word k, and the last node is just after the last word.   */
+
+typedef struct snode {
+  piece w;                /* The word after this node, if any.        */
+  long pos;               /* The total, over all words before this    */
+                          /* node, of 1 + width + shifted.            */
+  int score,              /* Value of the objective function for the  */
+                          /* best way to get here, or -1 if none.     */
+      pred,               /* The node before this one on that way.    */
+      refs;               /* Number of reasons to keep this node.     */
+} snode;
+
+/* The kinds of pass made by streampass(): */
+
+#define SP_SHORTEST 0  /* As simplebreaks().                          */
+#define SP_MAXGAP   1  /* As the first half of justbreaks().          */
+#define SP_NORMAL   2  /* As the rest of normalbreaks().              */
+#define SP_JUST     3  /* As the second half of justbreaks().         */
+
+typedef struct sbreaker {
+  wsource ws;             /* The words.                                 */
+  int last,               /* <last>.                                    */
+      numwords;           /* Number of words seen by the last pass.     */
+  snode *nodes;           /* nodes[k - first] is node k, for nodes      */
+  int first, size;        /* first through first + size - 1.            */
+  piece *pieces;          /* Storage for the words of one line.         */
+  parstats *stats;        /* Where the work is counted, or NULL.        */
+} sbreaker;
+
+#define NODE(sb,k) ((sb)->nodes + ((k) - (sb)->first))
+
+
+static int pathgreater(sbreaker *sb, int a, int b, int k)
+
+/* Returns 1 if the best path to node a followed by node k is greater */
+/* than the best path to node b followed by node k (comparing the     */
+/* positions of their nodes in order, as for words in a dictionary),  */
+/* or 0 if not.  a and b must differ, and both paths must exist.      */
+{
+  int pa = k, pb = k;
+
+  while (a != b)
+    if (a > b) {
+      pa = a;
+      a = NODE(sb,a)->pred;
+    }
+    else {
+      pb = b;
+      b = NODE(sb,b)->pred;
+    }
+
+  return pa > pb;
+}
+
+
+static int emitline(
+  sbreaker *sb, int i, int j, int more, linemaker *lm, errmsg_t errmsg
+)
+/* Passes the line made of words i through j - 1 to makeline(), if  */
+/* lm is not NULL.  Returns the length of the line.                  */
+{
+  snode *nd;
+  int n;
+
+  if (lm) {
+    for (n = 0;  i + n < j;  ++n) {
+      nd = NODE(sb, i + n);
+      sb->pieces[n] = nd->w;
+    }
+    makeline(lm, sb->pieces, n, more, errmsg);
+  }
+
+  return NODE(sb,j)->pos - NODE(sb,i)->pos - 1 - NODE(sb,i)->w.shifted;
+}
+
+
+static int streampass(
+  sbreaker *sb, int kind, int L, int bound, linemaker *lm, errmsg_t errmsg
+)
+/* Reads the words of *sb once, choosing line breaks according to  */
+/* kind.  L is the maximum line length.  For SP_SHORTEST, returns  */
+/* the same as simplebreaks() would, and bound is ignored.  For     */
+/* SP_MAXGAP, returns the smallest possible largest inter-word gap  */
+/* (L or more if there is none), and bound is ignored.  For         */
+/* SP_NORMAL (with bound as the length of the shortest line) and    */
+/* SP_JUST (with bound as the largest allowed gap), passes each     */
+/* line to makeline() as soon as it is settled, if lm is not NULL,  */
+/* and returns the length of the longest line, or -1 if there is no */
+/* way to break the lines.  Sets sb->numwords.  If the words cannot */
+/* be read, sets *errmsg and returns -1.                            */
+{
+  snode *nd, *ni, *tmp;
+  piece w;
+  int retain, final, k, i, lo, root, len, numgaps, extra, gap, score,
+      best, bestpred, longest = 0, next;
+  unsigned long ignored, *relax = &ignored;
+
+  *errmsg = '\0';
+  if (sb->stats)
+    relax =  kind == SP_SHORTEST  ?  &sb->stats->simplerelax  :
+             kind == SP_NORMAL    ?  &sb->stats->normalrelax  :
+                                     &sb->stats->justrelax;
+  retain = kind == SP_NORMAL || kind == SP_JUST;
+  startsource(&sb->ws);
+  sb->first = lo = root = 0;
+  best = bestpred = -1;
+
+  if (!nextword(&sb->ws, &w, errmsg)) {
+    sb->numwords = 0;
+    return  *errmsg  ?  -1  :  kind == SP_SHORTEST ? L : 0;
+  }
+  if (kind == SP_SHORTEST && w.width > L) return -1;
+
+  nd = sb->nodes;
+  nd->w = w;
+  nd->pos = 0;
+  nd->score =  kind == SP_SHORTEST  ?  L  :  0;
+  nd->pred = -1;
+  nd->refs = 1;
+
+  for (k = 1;  ;  ++k) {
+    final = !nextword(&sb->ws, &w, errmsg);
+    if (*errmsg) return -1;
+    if (!final && kind == SP_SHORTEST && w.width > L) return -1;
+
+  /* Make room for node k, discarding nodes no longer needed: */
+
+    if (k - sb->first >= sb->size) {
+      i =  retain && root < lo  ?  root  :  lo;
+      if (i - sb->first >= sb->size / 2) {
+        memmove(sb->nodes, NODE(sb,i), (k - i) * sizeof (snode));
+        sb->first = i;
+      }
       else {
-        if (!last) {
-          w1->nextline = NULL;
-          w1->score = 0;
-          break;
+        tmp = realloc(sb->nodes, 2 * sb->size * sizeof (snode));
+        if (!tmp) {
+          strcpy(errmsg,outofmem);
+          return -1;
         }
+        sb->nodes = tmp;
+        sb->size *= 2;
+      }
+    }
+
+    nd = NODE(sb,k);
+    ni = NODE(sb, k - 1);
+    nd->pos = ni->pos + 1 + ni->w.width + ni->w.shifted;
+    if (!final) nd->w = w;
+
+  /* Find the best way to get to node k: */
+
+    best =  kind == SP_MAXGAP  ?  L  :  -1;
+    bestpred = -1;
+    for (i = k - 1;  i >= lo;  --i) {
+      ni = NODE(sb,i);
+      len = nd->pos - ni->pos - 1 - ni->w.shifted;
+      if (len > L) break;
+      if (kind == SP_SHORTEST) {
+        score = ni->score;
+        if (final && !sb->last) len = L;
+        if (len < score) score = len;
+        if (score > best) best = score;
+        continue;
+      }
+      numgaps = k - i - 1;
+      extra = L - len;
+      gap = numgaps ? (extra + numgaps - 1) / numgaps : L;
+      if (final && !sb->last) gap = 0;
+      if (kind == SP_MAXGAP) {
+        score =  ni->score > gap  ?  ni->score  :  gap;
+        if (score < best) best = score;
+        continue;
+      }
+      if (ni->score < 0) continue;
+      if (final && !sb->last)
         score = 0;
+      else if (kind == SP_NORMAL) {
+        if (len < bound) continue;
+        score = extra * extra;
       }
-      if (gap <= maxgap && score >= 0) {
-        numbiggaps = extra % numgaps;
-        score += (extra / numgaps) * (extra + numbiggaps) + numbiggaps;
-        /* The above may not look like the sum of the squares of the numbers */
-        /* of extra spaces required in each inter-word gap, but trust me, it */
-        /* is.  It's easier to prove graphically than algebraicly.           */
-        if (w1->score < 0  ||  score <= w1->score) {
-          w1->nextline = w2;
-          w1->score = score;
-        }
+      else {
+        if (gap > bound) continue;
+        score = (extra / numgaps) * (extra + extra % numgaps)
+                + extra % numgaps;
+      }
+      score += ni->score;
+      if (best < 0 || score < best
+          || (score == best && pathgreater(sb, i, bestpred, k))) {
+        best = score;
+        bestpred = i;
       }
-      if (!w2) break;
     }
-    w1 = w1->prev;
-  } while (w1 != head);
+    *relax += k - 1 - i;
+
+    nd->score = best;
+    nd->pred = bestpred;
+    if (final) break;
+    nd->refs = 1;
+    if (!retain) {
+      lo = i + 1;
+      continue;
+    }
+    if (bestpred >= 0) ++NODE(sb,bestpred)->refs;
+
+  /* Forget the nodes that can no longer begin a line: */
+
+    for ( ;  lo <= i;  ++lo)
+      for (next = lo;  next >= 0 && --NODE(sb,next)->refs == 0;  )
+        next = NODE(sb,next)->pred;
+
+  /* Pass on the lines that every remaining path has in common.   */
+  /* Every node still kept for a reason other than being unable to */
+  /* get anywhere lies on a path through root, so if root is kept  */
+  /* only for one such node, it is the next node on every path:    */
+
+    while (root < lo && NODE(sb,root)->refs == 1) {
+      for (next = root + 1;
+           !NODE(sb,next)->refs || NODE(sb,next)->score < 0;
+           ++next);
+      len = emitline(sb, root, next, 1, lm, errmsg);
+      if (*errmsg) return -1;
+      if (len > longest) longest = len;
+      root = next;
+    }
+    if (root < lo && !NODE(sb,root)->refs) return -1;
+  }
 
-  if (head->next->score < 0)
-    sprintf(errmsg,impossibility,3);
+  sb->numwords = k;
+  if (!retain) return best;
+  if (best < 0) return -1;
+
+/* Pass on the rest of the lines, after reversing */
+/* the remaining path so it can be followed:      */
+
+  for (i = k, next = -1;  ;  ) {
+    ni = NODE(sb,i);
+    k = ni->pred;
+    ni->pred = next;
+    next = i;
+    if (i == root) break;
+    i = k;
+  }
+  for (i = root;  NODE(sb,i)->pred >= 0;  i = next) {
+    next = NODE(sb,i)->pred;
+    len = emitline(sb, i, next, NODE(sb,next)->pred >= 0, lm, errmsg);
+    if (*errmsg) return -1;
+    if (len > longest) longest = len;
+  }
+
+  return longest;
 }
 
 
-char **reformat(
+static void streambreaks(
+  sbreaker *sb, int L, int fit, int just, int touch, linemaker *lm,
+  errmsg_t errmsg
+)
+/* Chooses line breaks in the words of *sb according to the policy  */
+/* in "par.doc", just as normalbreaks() or justbreaks() would, and  */
+/* passes the lines to makeline() as they are settled.  Each pass   */
+/* reads the words again, so the memory used depends only on the    */
+/* lengths of the lines, not on the number of words.                */
+{
+  int tryL, shortest, score, target, maxgap, longest;
+
+  *errmsg = '\0';
+
+  if (just) {
+    maxgap = streampass(sb, SP_MAXGAP, L, 0, NULL, errmsg);
+    if (*errmsg || !sb->numwords) return;
+    if (maxgap >= L) {
+      strcpy(errmsg, "Cannot justify.\n");
+      return;
+    }
+    if (streampass(sb, SP_JUST, L, maxgap, lm, errmsg) < 0 && !*errmsg)
+      sprintf(errmsg,impossibility,3);
+    return;
+  }
+
+  target = L;
+
+  if (fit) {
+    score = L + 1;
+    for (tryL = L;  score > 0;  --tryL) {
+      if (sb->stats) ++sb->stats->tryls;
+      shortest = streampass(sb, SP_SHORTEST, tryL, 0, NULL, errmsg);
+      if (*errmsg || !sb->numwords) return;
+      if (shortest < 0) break;
+      if (tryL - shortest < score) {
+        target = tryL;
+        score = target - shortest;
+      }
+    }
+  }
+
+  shortest = streampass(sb, SP_SHORTEST, target, 0, NULL, errmsg);
+  if (*errmsg || !sb->numwords) return;
+  if (shortest < 0) {
+    sprintf(errmsg,impossibility,1);
+    return;
+  }
+
+  if (touch) {
+    longest = streampass(sb, SP_NORMAL, target, shortest, NULL, errmsg);
+    if (*errmsg) return;
+    if (longest < 0) {
+      sprintf(errmsg,impossibility,2);
+      return;
+    }
+    lm->L = longest;
+  }
+
+  if (streampass(sb, SP_NORMAL, target, shortest, lm, errmsg) < 0
+      && !*errmsg)
+    sprintf(errmsg,impossibility,2);
+}
+
+
+void reformatto(
   const char * const *inlines, const char * const *endline, int afp, int fs,
   int hang, int prefix, int suffix, int width, int cap, int fit, int guess,
-  int just, int last, int Report, int touch, const charset *terminalchars,
-  errmsg_t errmsg
+  int just, int last, int Report, int touch, int utf8, int reference,
+  const charset *terminalchars, const charset *alnumchars,
+  const charset *lowerchars,
+  void (*putline)(void *arg, const char *line, errmsg_t errmsg), void *arg,
+  arena *scratch, breakmemo *memo, parstats *stats, errmsg_t errmsg
 )
 {
-  int numin, affix, L, onfirstword = 1, linelen, numout, numgaps, extra, phase;
-  const char * const *line, **suffixes = NULL, **suf, *end, *p1, *p2;
-  char *q1, *q2, **outlines = NULL;
-  word dummy, *head, *tail, *w1, *w2;
-  buffer *pbuf = NULL;
+  int numin, numascii = 0, affix, L, linelen, maxwords, maxpieces, n, i, j;
+  long numchars = 0;
+  const char * const *line, *end;
+  piece *pieces, w;
+  linemaker lm;
+  wsource ws;
+  wordlist wl;
+  sbreaker sb;
+  arena *ownscratch = NULL;
 
 /* Initialization: */
 
   *errmsg = '\0';
-  dummy.next = dummy.prev = NULL;
-  dummy.flags = 0;
-  head = tail = &dummy;
+  sb.nodes = NULL;
   numin = endline - inlines;
   if (numin <= 0) {
     sprintf(errmsg,impossibility,4);
     goto rfcleanup;
   }
-  numgaps = extra = 0;  /* unnecessary, but quiets compiler warnings */
-
-/* Allocate space for pointers to the suffixes: */
 
-  suffixes = malloc(numin * sizeof (const char *));
-  if (!suffixes) {
-    strcpy(errmsg,outofmem);
-    goto rfcleanup;
+  if (scratch) cleararena(scratch);
+  else {
+    scratch = ownscratch = newarena(errmsg);
+    if (*errmsg) goto rfcleanup;
   }
 
-/* Set the pointers to the suffixes, and create the words: */
-
   affix = prefix + suffix;
-  L = width - prefix - suffix;
 
-  line = inlines, suf = suffixes;
+/* Check the lengths of the lines, and whether */
+/* there is anything but ASCII in them:        */
+
+  line = inlines;
   do {
-    for (end = *line;  *end;  ++end);
+    end = endofline(*line);
     if (end - *line < affix) {
       sprintf(errmsg,
               "Line %ld shorter than <prefix> + <suffix> = %d + %d = %d\n",
               (long)(line - inlines + 1), prefix, suffix, affix);
       goto rfcleanup;
     }
-    end -= suffix;
-    *suf = end;
-    p1 = *line + prefix;
-    for (;;) {
-      while (p1 < end && *p1 == ' ') ++p1;
-      if (p1 == end) break;
-      p2 = p1;
-      if (onfirstword) {
-        p1 = *line + prefix;
-        onfirstword = 0;
-      }
-      while (p2 < end && *p2 != ' ') ++p2;
-      w1 = malloc(sizeof (word));
-      if (!w1) {
-        strcpy(errmsg,outofmem);
-        goto rfcleanup;
-      }
-      w1->next = NULL;
-      w1->prev = tail;
-      tail = tail->next = w1;
-      w1->chrs = p1;
-      w1->length = p2 - p1;
-      w1->flags = 0;
-      p1 = p2;
-    }
-    ++line, ++suf;
+    numchars += end - *line - affix;
+    if (   utf8 && numascii == line - inlines
+        && memascii(*line, end - *line) == (size_t) (end - *line))
+      ++numascii;
+    ++line;
   } while (line < endline);
+  if (numascii == numin) utf8 = 0;
 
-/* If guess is 1, set flag values and merge words: */
-
-  if (guess) {
-    for (w1 = head, w2 = head->next;  w2;  w1 = w2, w2 = w2->next) {
-      if (checkcurious(w2,terminalchars)) w2->flags |= W_CURIOUS;
-      if (cap || checkcapital(w2)) {
-        w2->flags |= W_CAPITAL;
-        if (iscurious(w1)) {
-          if (w1->chrs[w1->length] && w1->chrs + w1->length + 1 == w2->chrs) {
-            w2->length += w1->length + 1;
-            w2->chrs = w1->chrs;
-            w2->prev = w1->prev;
-            w2->prev->next = w2;
-            if (iscapital(w1)) w2->flags |= W_CAPITAL;
-            else w2->flags &= ~W_CAPITAL;
-            if (isshifted(w1)) w2->flags |= W_SHIFTED;
-            else w2->flags &= ~W_SHIFTED;
-            free(w1);
-          }
-          else w2->flags |= W_SHIFTED;
-        }
-      }
+  L = width - prefix - suffix;
+  if (utf8)
+    L = width - utf8width(endline[-1], prefix)
+              - utf8width(endofline(endline[-1]) - suffix, suffix);
+
+  lm.inlines = inlines, lm.endline = endline;
+  lm.numin = numin, lm.afp = afp, lm.fs = fs, lm.hang = hang;
+  lm.prefix = prefix, lm.suffix = suffix, lm.L = L;
+  lm.just = just, lm.last = last, lm.utf8 = utf8;
+  lm.numout = lm.more = 0;
+  lm.putline = putline, lm.arg = arg;
+  lm.scratch = scratch;
+
+  ws.inlines = inlines, ws.endline = endline;
+  ws.prefix = prefix, ws.suffix = suffix, ws.L = L;
+  ws.cap = cap, ws.guess = guess, ws.Report = Report, ws.utf8 = utf8;
+  ws.terminalchars = terminalchars;
+  ws.alnumchars = alnumchars, ws.lowerchars = lowerchars;
+  startsource(&ws);
+
+/* Allocate space for one line and its words.  Every word is at */
+/* least one column wide unless utf8 is 1:                      */
+
+  lm.size = L + affix + 1;
+  lm.line = arenaalloc(scratch, lm.size * sizeof (char), errmsg);
+  if (*errmsg) goto rfcleanup;
+  maxpieces =  utf8  ?  L + 1  :  (L + 1) / 2 + 1;
+  pieces = arenaalloc(scratch, maxpieces * sizeof (piece), errmsg);
+  if (*errmsg) goto rfcleanup;
+
+/* If the paragraph is very long, don't make a list of its words */
+/* (unless the reference code is wanted):                        */
+
+  if (numchars > STREAMCHARS && !reference) {
+    sb.ws = ws;
+    sb.last = last;
+    sb.pieces = pieces;
+    sb.stats = stats;
+    sb.size = 256;
+    sb.nodes = malloc(sb.size * sizeof (snode));
+    if (!sb.nodes) {
+      strcpy(errmsg,outofmem);
+      goto rfcleanup;
+    }
+    streambreaks(&sb, L, fit, just, !just && touch && suffix, &lm, errmsg);
+    if (*errmsg) goto rfcleanup;
+    if (stats) {
+      stats->words += sb.numwords;
+      stats->splits += sb.ws.splits;
     }
-    tail = w1;
+    goto rffiller;
   }
 
-/* Check for too-long words: */
+/* Make the list of words.  Each word in the input is followed by a  */
+/* space or the end of a line, and splitting a long word adds at     */
+/* most one piece per L characters (per L - 1 if utf8 is 1, because  */
+/* a piece may stop short of a wide character), so there can be no   */
+/* more than maxwords of them:                                       */
 
-  if (Report)
-    for (w2 = head->next;  w2;  w2 = w2->next) {
-      if (w2->length > L) {
-        linelen = w2->length;
-        if (linelen > errmsg_size - 17)
-          linelen = errmsg_size - 17;
-        sprintf(errmsg, "Word too long: %.*s\n", linelen, w2->chrs);
-        goto rfcleanup;
-      }
-    }
-  else
-    for (w2 = head->next;  w2;  w2 = w2->next)
-      while (w2->length > L) {
-        w1 = malloc(sizeof (word));
-        if (!w1) {
-          strcpy(errmsg,outofmem);
-          goto rfcleanup;
-        }
-        w1->next = w2;
-        w1->prev = w2->prev;
-        w1->prev->next = w1;
-        w2->prev = w1;
-        w1->chrs = w2->chrs;
-        w2->chrs += L;
-        w1->length = L;
-        w2->length -= L;
-        w1->flags = 0;
-        if (iscapital(w2)) {
-          w1->flags |= W_CAPITAL;
-          w2->flags &= ~W_CAPITAL;
-        }
-        if (isshifted(w2)) {
-          w1->flags |= W_SHIFTED;
-          w2->flags &= ~W_SHIFTED;
-        }
-      }
+  maxwords = (numchars + numin) / 2 + numchars / (utf8 && L > 1 ? L - 1 : L)
+             + 1;
+  wl.chrs = arenaalloc(scratch, maxwords * sizeof (const char *), errmsg);
+  if (*errmsg) goto rfcleanup;
+  wl.length = arenaalloc(scratch, maxwords * sizeof (int), errmsg);
+  if (*errmsg) goto rfcleanup;
+  wl.width = wl.length;
+  if (utf8) {
+    wl.width = arenaalloc(scratch, maxwords * sizeof (int), errmsg);
+    if (*errmsg) goto rfcleanup;
+  }
+  wl.shifted = arenaalloc(scratch, maxwords, errmsg);
+  if (*errmsg) goto rfcleanup;
+  wl.pos = arenaalloc(scratch, (maxwords + 1) * sizeof (long), errmsg);
+  if (*errmsg) goto rfcleanup;
+  wl.score = arenaalloc(scratch, (maxwords + 1) * sizeof (int), errmsg);
+  if (*errmsg) goto rfcleanup;
+  wl.nextline = arenaalloc(scratch, maxwords * sizeof (int), errmsg);
+  if (*errmsg) goto rfcleanup;
+  if (!just) {
+    wl.cands = arenaalloc(scratch, (maxwords + 1) * sizeof (int), errmsg);
+    if (*errmsg) goto rfcleanup;
+    wl.bounds = arenaalloc(scratch, (maxwords + 1) * sizeof (int), errmsg);
+    if (*errmsg) goto rfcleanup;
+  }
+
+  n = 0;
+  wl.pos[0] = 0;
+  while (nextword(&ws, &w, errmsg)) {
+    wl.chrs[n] = w.chrs;
+    wl.length[n] = w.length;
+    wl.width[n] = w.width;
+    wl.shifted[n] = w.shifted;
+    wl.pos[n + 1] = wl.pos[n] + 1 + w.width + w.shifted;
+    ++n;
+  }
+  if (*errmsg) goto rfcleanup;
+  wl.numwords = n;
+  wl.stats = stats;
+  wl.memo = NULL;
+  wl.kept = 0;
+  if (   memo && !reference && memo->numwords && memo->L == L
+      && memo->fit == fit && memo->just == just && memo->last == last) {
+    wl.memo = memo;
+    wl.kept = keptwords(&wl,memo);
+  }
+  if (stats) {
+    stats->words += n;
+    stats->splits += ws.splits;
+  }
 
 /* Choose line breaks according to policy in "par.doc": */
 
-  if (just) justbreaks(head,tail,L,last,errmsg);
-  else normalbreaks(head,tail,L,fit,last,errmsg);
+  if (just) justbreaks(&wl,L,last,reference,errmsg);
+  else normalbreaks(&wl,L,fit,last,reference,errmsg);
   if (*errmsg) goto rfcleanup;
+  if (memo && !reference) {
+    remember(memo, &wl, L, fit, just, last, errmsg);
+    if (*errmsg) goto rfcleanup;
+  }
 
 /* Change L to the length of the longest line if required: */
 
   if (!just && touch) {
-    L = 0;
-    w1 = head->next;
-    while (w1) {
-      for (linelen = w1->length, w2 = w1->next;
-           w2 != w1->nextline;
-           linelen += 1 + isshifted(w2) + w2->length, w2 = w2->next);
-      if (linelen > L) L = linelen;
-      w1 = w2;
+    lm.L = 0;
+    for (i = 0;  i < n;  i = wl.nextline[i]) {
+      linelen = wl.pos[wl.nextline[i]] - STARTOF(&wl,i);
+      if (linelen > lm.L) lm.L = linelen;
     }
   }
 
 /* Construct the lines: */
 
-  pbuf = newbuffer(sizeof (char *), errmsg);
-  if (*errmsg) goto rfcleanup;
-
-  numout = 0;
-  w1 = head->next;
-  while (numout < hang || w1) {
-    if (w1)
-      for (w2 = w1->next, numgaps = 0, extra = L - w1->length;
-           w2 != w1->nextline;
-           ++numgaps, extra -= 1 + isshifted(w2) + w2->length, w2 = w2->next);
-    linelen = suffix || (just && (w2 || last)) ?
-                L + affix :
-                w1 ? prefix + L - extra : prefix;
-    q1 = malloc((linelen + 1) * sizeof (char));
-    if (!q1) {
-      strcpy(errmsg,outofmem);
-      goto rfcleanup;
+  for (i = 0;  i < n;  i = wl.nextline[i]) {
+    for (j = i;  j < wl.nextline[i];  ++j) {
+      pieces[j - i].chrs = wl.chrs[j];
+      pieces[j - i].length = wl.length[j];
+      pieces[j - i].width = wl.width[j];
+      pieces[j - i].shifted = wl.shifted[j];
     }
-    additem(pbuf, &q1, errmsg);
+    makeline(&lm, pieces, j - i, j < n, errmsg);
     if (*errmsg) goto rfcleanup;
-    ++numout;
-    q2 = q1 + prefix;
-    if      (numout <= numin) memcpy(q1, inlines[numout - 1], prefix);
-    else if (numin  >  hang ) memcpy(q1, endline[-1],         prefix);
-    else {
-      if (afp > prefix) afp = prefix;
-      memcpy(q1, endline[-1], afp);
-      q1 += afp;
-      while (q1 < q2) *q1++ = ' ';
-    }
-    q1 = q2;
-    if (w1) {
-      phase = numgaps / 2;
-      for (w2 = w1;  ;  ) {
-        memcpy(q1, w2->chrs, w2->length);
-        q1 += w2->length;
-        w2 = w2->next;
-        if (w2 == w1->nextline) break;
-        *q1++ = ' ';
-        if (just && (w1->nextline || last)) {
-          phase += extra;
-          while (phase >= numgaps) {
-            *q1++ = ' ';
-            phase -= numgaps;
-          }
-        }
-        if (isshifted(w2)) *q1++ = ' ';
-      }
-    }
-    q2 += linelen - affix;
-    while (q1 < q2) *q1++ = ' ';
-    q2 = q1 + suffix;
-    if      (numout <= numin) memcpy(q1, suffixes[numout - 1], suffix);
-    else if (numin  >  hang ) memcpy(q1, suffixes[numin  - 1], suffix);
-    else {
-      if (fs > suffix) fs = suffix;
-      memcpy(q1, suffixes[numin - 1], fs);
-      q1 += fs;
-      while(q1 < q2) *q1++ = ' ';
-    }
-    *q2 = '\0';
-    if (w1) w1 = w1->nextline;
   }
 
-  q1 = NULL;
-  additem(pbuf, &q1, errmsg);
-  if (*errmsg) goto rfcleanup;
+rffiller:
 
-  outlines = copyitems(pbuf,errmsg);
+  while (lm.numout < hang) {
+    makeline(&lm, pieces, 0, 0, errmsg);
+    if (*errmsg) goto rfcleanup;
+  }
 
 rfcleanup:
 
-  if (suffixes) free(suffixes);
+  if (sb.nodes) free(sb.nodes);
+  if (ownscratch) freearena(ownscratch);
+}
+
+
+static void collectline(void *arg, const char *line, errmsg_t errmsg)
 
-  while (tail != head) {
-    tail = tail->prev;
-    free(tail->next);
+/* Appends a copy of line to the buffer *arg. */
+{
+  char *q;
+
+  q = malloc((strlen(line) + 1) * sizeof (char));
+  if (!q) {
+    strcpy(errmsg,outofmem);
+    return;
   }
+  strcpy(q,line);
+  additem(arg, &q, errmsg);
+  if (*errmsg) free(q);
+}
+
+
+char **reformat(
+  const char * const *inlines, const char * const *endline, int afp, int fs,
+  int hang, int prefix, int suffix, int width, int cap, int fit, int guess,
+  int just, int last, int Report, int touch, const charset *terminalchars,
+  errmsg_t errmsg
+)
+{
+  buffer *pbuf = NULL;
+  charset *alnumchars = NULL, *lowerchars = NULL;
+  char *q = NULL, **outlines = NULL;
+
+  alnumchars = parsecharset("_A_a_@_0", errmsg);
+  if (*errmsg) goto rcleanup;
+  lowerchars = parsecharset("_a", errmsg);
+  if (*errmsg) goto rcleanup;
+  pbuf = newbuffer(sizeof (char *), errmsg);
+  if (*errmsg) goto rcleanup;
+
+  reformatto(inlines, endline, afp, fs, hang, prefix, suffix, width, cap,
+             fit, guess, just, last, Report, touch, 0, 0, terminalchars,
+             alnumchars, lowerchars, collectline, pbuf, NULL, NULL, NULL,
+             errmsg);
+  if (*errmsg) goto rcleanup;
+
+  additem(pbuf, &q, errmsg);
+  if (*errmsg) goto rcleanup;
+
+  outlines = copyitems(pbuf,errmsg);
+
+rcleanup:
 
+  if (alnumchars) freecharset(alnumchars);
+  if (lowerchars) freecharset(lowerchars);
   if (pbuf) {
     if (!outlines)
       for (;;) {
         outlines = nextitem(pbuf);
         if (!outlines) break;
-        free(*outlines);
+        if (*outlines) free(*outlines);
       }
     freebuffer(pbuf);
   }
@@ -1,7 +1,7 @@
 /*
 reformat.h
-last touched in Par 1.53.0
-last meaningful change in Par 1.53.0
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
 Copyright 1993, 2020 Adam M. Costello
 
 This is ANSI C code (C89).
@@ -9,8 +9,10 @@ This is ANSI C code (C89).
 */
 
 
+#include "arena.h"
 #include "charset.h"
 #include "errmsg.h"
+#include "stats.h"
 
 
 char **reformat(
@@ -27,5 +29,65 @@ char **reformat(
   /* suffix, width, cap, fit, guess, just, last, Report, touch,     */
   /* terminalchars, errmsg) returns a NULL-terminated array of      */
   /* pointers to output lines containing the reformatted paragraph, */
-  /* according to the specification in "par.doc".  None of the      */
-  /* integer parameters may be negative.  Returns NULL on failure.  */
+  /* according to the specification in "par.doc", with letters and  */
+  /* digits classified in the current locale.  None of the integer  */
+  /* parameters may be negative.  Returns NULL on failure.          */
+
+
+typedef struct breakmemo breakmemo;
+
+
+breakmemo *newbreakmemo(errmsg_t errmsg);
+
+  /* newbreakmemo(errmsg) returns a pointer to a new breakmemo, which  */
+  /* remembers nothing yet.  When passed to reformatto(), it remembers */
+  /* the words of each paragraph and the line breaks chosen for them,  */
+  /* so that the breaks for the next paragraph given the same memo     */
+  /* (typically the same paragraph after an edit) need be chosen again */
+  /* only for the words before those it ends with that are the same,   */
+  /* and the bounds that the breaks depend on can be checked rather    */
+  /* than searched for.  The breaks chosen are always the same as      */
+  /* without it.  Returns NULL on failure.                             */
+
+
+void freebreakmemo(breakmemo *bm);
+
+  /* freebreakmemo(bm) frees the memory associated with *bm.  bm */
+  /* may not be used after this call.                            */
+
+
+void reformatto(
+  const char * const *inlines, const char * const *endline, int afp, int fs,
+  int hang, int prefix, int suffix, int width, int cap, int fit, int guess,
+  int just, int last, int Report, int touch, int utf8, int reference,
+  const charset *terminalchars, const charset *alnumchars,
+  const charset *lowerchars,
+  void (*putline)(void *arg, const char *line, errmsg_t errmsg), void *arg,
+  arena *scratch, breakmemo *memo, parstats *stats, errmsg_t errmsg
+);
+  /* reformatto(inlines, endline, afp, ..., terminalchars, alnumchars, */
+  /* lowerchars, putline, arg, scratch, memo, stats, errmsg) reformats */
+  /* the paragraph just as reformat() would, but instead of returning  */
+  /* the output lines, it passes each one to putline(arg,line,errmsg), */
+  /* which should set *errmsg if it fails.  line remains valid only    */
+  /* until putline returns.  For a very long paragraph, each line is   */
+  /* passed on as soon as it has been chosen, and the memory used does */
+  /* not grow with the length of the paragraph (see reformat.c).       */
+  /* Words and other per-paragraph data are allocated from *scratch,   */
+  /* which is cleared first, so a caller that reformats many           */
+  /* paragraphs can pass the same arena each time and avoid calling    */
+  /* malloc() for every word.  If scratch is NULL, a temporary arena   */
+  /* is used instead.  The alphanumeric and lower case characters      */
+  /* (which matter for <guess>) are the members of *alnumchars and     */
+  /* *lowerchars, typically parsed from "_A_a_@_0" and "_a", so that   */
+  /* nothing depends on the locale at the time of the call.  If        */
+  /* reference is non-zero, the line breaks are chosen by the simplest */
+  /* code, which is much slower but chooses exactly the same ones; it  */
+  /* is there for checking the faster code.  If utf8 is non-zero, the  */
+  /* lines are taken to be UTF-8, and the lengths of words and lines   */
+  /* are their widths in columns (see utf8.h), except that prefix and  */
+  /* suffix remain numbers of characters.  If memo is not NULL, it is  */
+  /* used as described for newbreakmemo(), unless reference is         */
+  /* non-zero or the paragraph is very long.  If stats is not NULL,    */
+  /* the words, the pieces split off long words, and the work done     */
+  /* choosing line breaks are added to the counts in *stats.           */
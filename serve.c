@@ -0,0 +1,956 @@
+/*
+serve.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89), except that if PAR_POSIX is defined it also
+uses POSIX sockets and clocks, and if PAR_THREADS is defined, POSIX
+threads.
+
+The thread that calls parserve() accepts clients and waits on all of
+them at once with poll(), reading whatever each one sends into a
+buffer of its own.  Once a whole request has arrived, the client's
+session is put on a queue for the serving threads, and the client is
+not read from again until its answer has been written, so a client
+that stays connected without sending anything holds up no one.
+Without PAR_THREADS, the request is answered at once instead.  Each
+serving thread keeps its own cache of contexts, one for each of the
+last few option strings it has seen, so a context is never used by two
+threads and needs no locking; an option string used by every client is
+parsed at most once per thread.  Each client may also have one
+document open (see newpardoc() in libpar.h), which belongs to its
+session and is freed when it disconnects.  The statistics and the
+queues are shared, and protected by a single mutex.  Latencies are
+counted in a histogram with 16 buckets for each power of two
+microseconds, so the percentiles reported are never more than 1/16
+too high.
+
+*/
+
+
+#include "serve.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+#include "libpar.h"
+#include "pool.h"
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef PAR_POSIX
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef PAR_THREADS
+#include <pthread.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+#ifdef PAR_POSIX
+
+#define CACHESIZE 16        /* Contexts cached by each thread.          */
+#define MAXHEADER 64        /* Longest request header line.             */
+#define MAXOPTS 4096        /* Longest option string accepted.          */
+#define MAXTEXT 67108864    /* Longest text accepted.                   */
+#define MINBUF 4096         /* Initial size of a client's input buffer. */
+#define SENDTIMEOUT 10      /* Seconds a client may take to read.       */
+
+/* Latency histogram buckets: values below 1 << SUBBITS have a bucket */
+/* each, and every power of two above that is split into that many:   */
+
+#define SUBBITS 4
+#define ULBITS (sizeof (unsigned long) * CHAR_BIT)
+#define NUMBUCKETS ((int) (ULBITS - SUBBITS + 1) << SUBBITS)
+
+typedef struct stats {
+  unsigned long requests,      /* Requests answered, other than   */
+                               /* for stats.                      */
+                errors,        /* Those answered with an error.   */
+                clients,       /* Connections accepted.           */
+                hits, misses,  /* Option strings found in a cache */
+                               /* or not.                         */
+                bytesin,       /* Characters of text received and */
+                bytesout,      /* sent back.                      */
+                maxlatency,    /* In microseconds.                */
+                hist[NUMBUCKETS];
+} stats;
+
+typedef struct session session;
+typedef struct worker worker;
+
+typedef struct server {
+  const parctx *base;            /* The options of par itself.       */
+  const char *path;              /* The name of the socket.          */
+  int fd;                        /* The listening socket.            */
+  worker *workers;               /* One for each serving thread, or  */
+                                 /* just one without PAR_THREADS.    */
+  session **all;                 /* Every session, numall of them,   */
+  int numall, maxall;            /* with room for maxall.            */
+  stats st;
+  session *done;                 /* Sessions whose requests have     */
+                                 /* been answered.                   */
+#ifdef PAR_THREADS
+  session *queue, **queueend;    /* Sessions with a request waiting  */
+                                 /* to be answered, oldest first.    */
+  int stop;                      /* Tells the serving threads to     */
+                                 /* return once the queue is empty.  */
+  int wake[2];                   /* A pipe written to whenever a     */
+                                 /* session is added to done.        */
+  pthread_mutex_t lock;          /* Protects st, done, and the       */
+                                 /* three fields above.              */
+  pthread_cond_t queued;         /* Signaled when queue or stop is   */
+                                 /* set.                             */
+#endif
+} server;
+
+typedef struct entry {
+  char *opts;             /* An option string, or NULL if unused.     */
+  size_t optlen;          /* Its length.                              */
+  parctx *ctx;            /* The context for it.                      */
+  unsigned long used;     /* The value of tick when last used.        */
+} entry;
+
+struct worker {
+  server *srv;
+  entry cache[CACHESIZE];
+  unsigned long tick;     /* Counts the option strings looked up.     */
+};
+
+struct session {
+  server *srv;
+  int fd;                 /* The client being served.                 */
+  char *buf;              /* Input from the client: buf[start] up to  */
+  size_t size,            /* buf[end] has not been consumed yet, and  */
+         start, end;      /* buf has room for size characters.        */
+  char kind;              /* The first letter of the request whose    */
+                          /* line has been consumed, or '\0'.         */
+  size_t optlen, textlen, /* The numbers on that line (from and to    */
+         from, to;        /* only for edit).                          */
+  struct timespec t0;     /* When that line was consumed.             */
+  int waiting;            /* Set while a request is being answered.   */
+  int gone;               /* Set if the connection should be closed.  */
+  int slot;               /* The index of the session in srv->all.    */
+  pardoc *doc;            /* The document opened by the client, or    */
+                          /* NULL.                                    */
+  session *next;          /* The next session in the same queue.      */
+};
+
+
+#ifdef PAR_THREADS
+#define lockserver(srv) pthread_mutex_lock(&(srv)->lock)
+#define unlockserver(srv) pthread_mutex_unlock(&(srv)->lock)
+#else
+#define lockserver(srv)
+#define unlockserver(srv)
+#endif
+
+
+static int bucketof(unsigned long us)
+
+/* Returns the index of the histogram bucket for us. */
+{
+  int e;
+
+  if (us < 1UL << SUBBITS) return us;
+  for (e = SUBBITS;  us >> e > 1;  ++e);
+  return ((e - SUBBITS + 1) << SUBBITS)
+         + (int) (us >> (e - SUBBITS) & ((1UL << SUBBITS) - 1));
+}
+
+
+static unsigned long bucketmax(int i)
+
+/* Returns the largest value counted in bucket i. */
+{
+  int e;
+
+  if (i < 1 << SUBBITS) return i;
+  e = (i >> SUBBITS) + SUBBITS - 1;
+  return (((1UL << SUBBITS) + (i & ((1 << SUBBITS) - 1))) << (e - SUBBITS))
+         + ((1UL << (e - SUBBITS)) - 1);
+}
+
+
+static unsigned long percentile(const stats *st, int permille)
+
+/* Returns the smallest latency that at least permille thousandths */
+/* of the requests in *st took no longer than, to within a bucket, */
+/* or 0 if there have been none.                                   */
+{
+  unsigned long n = st->requests, target, sum = 0, max;
+  int i;
+
+  target = n / 1000 * permille + (n % 1000 * permille + 999) / 1000;
+  if (!target) return 0;
+
+  for (i = 0;  i < NUMBUCKETS;  ++i) {
+    sum += st->hist[i];
+    if (sum >= target) break;
+  }
+
+  max = bucketmax(i);
+  return  max < st->maxlatency  ?  max  :  st->maxlatency;
+}
+
+
+static unsigned long since(const struct timespec *t0)
+
+/* Returns the number of microseconds since *t0. */
+{
+  struct timespec t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return (t1.tv_sec - t0->tv_sec) * 1000000UL
+         + t1.tv_nsec / 1000 - t0->tv_nsec / 1000;
+}
+
+
+static int makeroom(session *s, size_t n)
+
+/* Makes sure that s->buf has room for n characters from s->start, */
+/* moving the unconsumed ones to the front or growing s->buf if    */
+/* need be.  Returns 1, or 0 if there is not enough memory.        */
+{
+  char *buf;
+  size_t size, have = s->end - s->start;
+
+  if (s->start + n <= s->size) return 1;
+
+  if (n > s->size) {
+    size =  2 * s->size > n  ?  2 * s->size  :  n;
+    if (size < MINBUF) size = MINBUF;
+    buf = malloc(size);
+    if (!buf) return 0;
+    if (have) memcpy(buf, s->buf + s->start, have);
+    if (s->buf) free(s->buf);
+    s->buf = buf;
+    s->size = size;
+  }
+  else memmove(s->buf, s->buf + s->start, have);
+  s->start = 0;
+  s->end = have;
+
+  return 1;
+}
+
+
+static const char *getlength(const char *p, size_t *pn)
+
+/* Parses a space followed by a decimal number of at most 9 digits */
+/* at p, storing the number in *pn.  Returns a pointer to what     */
+/* follows, or NULL if p does not point to such a thing.           */
+{
+  const char *d, * const digits = "0123456789";
+  size_t n = 0;
+  int k = 0;
+
+  if (*p++ != ' ') return NULL;
+  for (;  *p && (d = strchr(digits,*p)) != NULL;  ++p) {
+    if (++k > 9) return NULL;
+    n = 10 * n + (d - digits);
+  }
+  if (!k) return NULL;
+
+  *pn = n;
+  return p;
+}
+
+
+static int respond(
+  session *s, const char *status, const char *body, size_t len
+)
+/* Sends the client a response with the given status ("ok",  */
+/* perhaps followed by more, or "error") and body.  Returns  */
+/* 1, or 0 if the client has gone.                           */
+{
+  char head[2 * MAXHEADER];
+  struct iovec iov[2];
+  ssize_t r;
+
+  sprintf(head, "%s %lu\n", status, (unsigned long) len);
+  iov[0].iov_base = head;
+  iov[0].iov_len = strlen(head);
+  iov[1].iov_base = (char *) body;
+  iov[1].iov_len = len;
+
+  while (iov[0].iov_len + iov[1].iov_len) {
+    r = writev(s->fd, iov + !iov[0].iov_len, 2 - !iov[0].iov_len);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return 0;
+    if ((size_t) r >= iov[0].iov_len) {
+      r -= iov[0].iov_len;
+      iov[0].iov_len = 0;
+      iov[1].iov_base = (char *) iov[1].iov_base + r;
+      iov[1].iov_len -= r;
+    }
+    else {
+      iov[0].iov_base = (char *) iov[0].iov_base + r;
+      iov[0].iov_len -= r;
+    }
+  }
+
+  return 1;
+}
+
+
+static int nextrequest(session *s)
+
+/* Consumes the line that begins the next request from the client,   */
+/* if it has arrived and was not consumed already.  Returns 1 if the */
+/* rest of the request has arrived too, 0 if more must be read       */
+/* first, or -1 if the line is bad (in which case the client has     */
+/* been told so, unless the line was too long) and the connection    */
+/* should be closed.                                                 */
+{
+  char *nl, *line;
+  const char *p;
+
+  if (!s->kind) {
+    nl = memchr(s->buf + s->start, '\n', s->end - s->start);
+    if (!nl) return  s->end - s->start < MAXHEADER  ?  0  :  -1;
+    *nl = '\0';
+    line = s->buf + s->start;
+    s->start = nl + 1 - s->buf;
+    clock_gettime(CLOCK_MONOTONIC, &s->t0);
+
+    p = NULL;
+    s->optlen = s->textlen = 0;
+    if (!strcmp(line, "stats")) p = line + 5;
+    else {
+      if (!strncmp(line, "format", 6)) p = getlength(line + 6, &s->optlen);
+      else if (!strncmp(line, "open", 4)) p = getlength(line + 4, &s->optlen);
+      else if (!strncmp(line, "edit", 4)) {
+        p = getlength(line + 4, &s->from);
+        if (p) p = getlength(p, &s->to);
+      }
+      if (p) p = getlength(p, &s->textlen);
+    }
+    if (!p || *p) {
+      respond(s, "error", "Bad request.\n", 13);
+      return -1;
+    }
+    if (s->optlen > MAXOPTS) {
+      respond(s, "error", "Options too long.\n", 18);
+      return -1;
+    }
+    if (s->textlen > MAXTEXT) {
+      respond(s, "error", "Text too long.\n", 15);
+      return -1;
+    }
+    s->kind = *line;
+  }
+
+  return s->end - s->start >= s->optlen + s->textlen;
+}
+
+
+static parctx *getctx(
+  worker *w, const char *opts, size_t optlen, int *phit, errmsg_t errmsg
+)
+/* Returns a pointer to a context for the options of the server */
+/* followed by the optlen characters of opts, from the cache of */
+/* *w if they are there, setting *phit to 1, and otherwise made */
+/* and added to the cache.  Returns NULL on failure.            */
+{
+  entry *e, *old;
+  parctx *ctx = NULL;
+  char *str = NULL, *words = NULL, *p, *word;
+  const char *args[2], * const white = " \f\n\r\t\v";
+  int help = 0, version = 0, Err = 0;
+
+  *errmsg = '\0';
+  ++w->tick;
+
+  for (e = w->cache, old = e;  e < w->cache + CACHESIZE;  ++e) {
+    if (   e->opts && e->optlen == optlen
+        && !memcmp(e->opts, opts, optlen)) {
+      e->used = w->tick;
+      *phit = 1;
+      return e->ctx;
+    }
+    if (!e->opts || (old->opts && e->used < old->used)) old = e;
+  }
+  *phit = 0;
+
+  if (memchr(opts, '\0', optlen)) {
+    strcpy(errmsg, "Options must not contain NUL characters.\n");
+    return NULL;
+  }
+  str = malloc(optlen + 1);
+  words = malloc(optlen + 1);
+  if (!str || !words) {
+    strcpy(errmsg,outofmem);
+    goto gccleanup;
+  }
+  memcpy(str, opts, optlen);
+  str[optlen] = '\0';
+  strcpy(words,str);
+
+  ctx = copyparctx(w->srv->base, errmsg);
+  if (*errmsg) goto gccleanup;
+  setparjobs(ctx,1);
+
+  /* strtok() is not safe to use in more than one thread at once: */
+
+  args[1] = NULL;
+  for (p = words + strspn(words,white);  *p;  p += strspn(p,white)) {
+    word = p;
+    p += strcspn(p,white);
+    if (*p) *p++ = '\0';
+    args[0] = word;
+    paroption(ctx, args, &help, &version, &Err, errmsg);
+    if (*errmsg) goto gccleanup;
+    if (help || version) {
+      sprintf(errmsg, "Bad argument: %.*s\n", errmsg_size - 16, word);
+      goto gccleanup;
+    }
+  }
+  parcheck(ctx,errmsg);
+  if (*errmsg) goto gccleanup;
+
+  if (old->opts) {
+    free(old->opts);
+    freeparctx(old->ctx);
+  }
+  old->opts = str;
+  old->optlen = optlen;
+  old->ctx = ctx;
+  old->used = w->tick;
+  str = NULL;
+
+gccleanup:
+
+  if (*errmsg && ctx) {
+    freeparctx(ctx);
+    ctx = NULL;
+  }
+  if (str) free(str);
+  if (words) free(words);
+
+  return ctx;
+}
+
+
+static int answerstats(session *s)
+
+/* Answers a stats request.  Returns 1, or 0 if the client has gone. */
+{
+  server *srv = s->srv;
+  stats *st = &srv->st;
+  char body[1024];
+
+  lockserver(srv);
+  sprintf(body,
+          "requests %lu\nerrors %lu\nclients %lu\n"
+          "cache_hits %lu\ncache_misses %lu\n"
+          "bytes_in %lu\nbytes_out %lu\n"
+          "latency_us_p50 %lu\nlatency_us_p90 %lu\n"
+          "latency_us_p99 %lu\nlatency_us_p999 %lu\n"
+          "latency_us_max %lu\n",
+          st->requests, st->errors, st->clients,
+          st->hits, st->misses, st->bytesin, st->bytesout,
+          percentile(st,500), percentile(st,900),
+          percentile(st,990), percentile(st,999), st->maxlatency);
+  unlockserver(srv);
+
+  return respond(s, "ok", body, strlen(body));
+}
+
+
+static int answer(worker *w, session *s)
+
+/* Answers the request from the client whose line nextrequest() has */
+/* consumed, all of which has arrived, using the cache of *w.       */
+/* Returns 1, or 0 if the client has gone.                          */
+{
+  server *srv = s->srv;
+  stats *st = &srv->st;
+  const char *opts, *text, *result = NULL;
+  char kind = s->kind, status[MAXHEADER];
+  size_t optlen = s->optlen, textlen = s->textlen, start = s->from,
+         end = s->to, len = 0;
+  unsigned long us;
+  parctx *ctx;
+  pardoc *doc;
+  int hit = 0, ok;
+  errmsg_t errmsg;
+
+  s->kind = '\0';
+  if (kind == 's') return answerstats(s);
+
+  opts = s->buf + s->start;
+  text = opts + optlen;
+  s->start += optlen + textlen;
+
+  /* An edit looks up no options, and is counted as neither */
+  /* a hit nor a miss:                                      */
+
+  strcpy(status, "ok");
+  if (kind == 'e') {
+    hit = -1;
+    if (!s->doc) strcpy(errmsg, "No document is open.\n");
+    else {
+      result = pardocedit(s->doc, start, end, text, textlen,
+                          &start, &end, &len, errmsg);
+      sprintf(status, "ok %lu %lu", (unsigned long) start,
+              (unsigned long) end);
+    }
+  }
+  else {
+    ctx = getctx(w, opts, optlen, &hit, errmsg);
+    if (ctx && kind == 'f')
+      result = parformat(ctx, text, textlen, &len, errmsg);
+    else if (ctx) {
+      doc = newpardoc(ctx, text, textlen, errmsg);
+      if (doc) {
+        if (s->doc) freepardoc(s->doc);
+        s->doc = doc;
+        result = pardocoutput(doc, &len);
+      }
+    }
+  }
+
+  ok =  *errmsg  ?  respond(s, "error", errmsg, strlen(errmsg))
+                 :  respond(s, status, result, len);
+  us = since(&s->t0);
+
+  lockserver(srv);
+  ++st->requests;
+  if (*errmsg) ++st->errors;
+  if (hit > 0) ++st->hits;
+  else if (!hit) ++st->misses;
+  st->bytesin += textlen;
+  st->bytesout += len;
+  ++st->hist[bucketof(us)];
+  if (us > st->maxlatency) st->maxlatency = us;
+  unlockserver(srv);
+
+  return ok;
+}
+
+
+static void handrequest(session *s)
+
+/* Has the request from the client of *s answered, all of which has */
+/* arrived, and afterward puts *s on s->srv->done: if par was       */
+/* compiled with PAR_THREADS, by queueing it for a serving thread,  */
+/* and otherwise at once.                                           */
+{
+  server *srv = s->srv;
+
+#ifdef PAR_THREADS
+  s->next = NULL;
+  lockserver(srv);
+  *srv->queueend = s;
+  srv->queueend = &s->next;
+  pthread_cond_signal(&srv->queued);
+  unlockserver(srv);
+#else
+  s->gone = !answer(srv->workers, s);
+  s->next = srv->done;
+  srv->done = s;
+#endif
+}
+
+
+#ifdef PAR_THREADS
+
+static void runworker(void *arg, int i)
+
+/* Answers the requests queued on the server *arg, using worker i, */
+/* until it is told to stop and the queue is empty.                */
+{
+  server *srv = arg;
+  worker *w = srv->workers + i;
+  session *s;
+
+  for (;;) {
+    lockserver(srv);
+    while (!srv->queue && !srv->stop)
+      pthread_cond_wait(&srv->queued, &srv->lock);
+    s = srv->queue;
+    if (s) {
+      srv->queue = s->next;
+      if (!srv->queue) srv->queueend = &srv->queue;
+    }
+    unlockserver(srv);
+    if (!s) break;
+
+    s->gone = !answer(w,s);
+
+    lockserver(srv);
+    s->next = srv->done;
+    srv->done = s;
+    unlockserver(srv);
+    while (write(srv->wake[1], "", 1) < 0 && errno == EINTR);
+  }
+}
+
+#endif
+
+
+static session *addsession(server *srv, int fd)
+
+/* Adds a new session for the client connected by fd to srv->all,  */
+/* and returns a pointer to it, or returns NULL if there is not    */
+/* enough memory.                                                  */
+{
+  session *s, **all;
+  int max;
+
+  if (srv->numall == srv->maxall) {
+    max =  srv->maxall  ?  2 * srv->maxall  :  16;
+    all = realloc(srv->all, max * sizeof (session *));
+    if (!all) return NULL;
+    srv->all = all;
+    srv->maxall = max;
+  }
+
+  s = calloc(1, sizeof (session));
+  if (!s) return NULL;
+  s->srv = srv;
+  s->fd = fd;
+  s->slot = srv->numall;
+  srv->all[srv->numall++] = s;
+
+  return s;
+}
+
+
+static void closesession(session *s)
+
+/* Closes the connection to the client of *s, removes *s */
+/* from s->srv->all, and frees it.                       */
+{
+  server *srv = s->srv;
+
+  srv->all[s->slot] = srv->all[--srv->numall];
+  srv->all[s->slot]->slot = s->slot;
+  close(s->fd);
+  if (s->doc) freepardoc(s->doc);
+  if (s->buf) free(s->buf);
+  free(s);
+}
+
+
+static void readclient(session *s)
+
+/* Reads what the client of *s has sent, which poll() has said there */
+/* is, and hands the request to handrequest() if that completes it,  */
+/* or closes the connection if the client has gone.                  */
+{
+  ssize_t n;
+  int r;
+
+  if (!makeroom(s,  s->kind  ?  s->optlen + s->textlen  :  MAXHEADER)) {
+    closesession(s);
+    return;
+  }
+  do n = read(s->fd, s->buf + s->end, s->size - s->end);
+  while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    closesession(s);
+    return;
+  }
+  s->end += n;
+
+  r = nextrequest(s);
+  if (r < 0) closesession(s);
+  else if (r > 0) {
+    s->waiting = 1;
+    handrequest(s);
+  }
+}
+
+
+static void acceptclient(server *srv, errmsg_t errmsg)
+
+/* Accepts a client of *srv, if one is still there, and begins a */
+/* session for it.                                               */
+{
+  struct timeval tv;
+  session *s;
+  int fd, flags;
+
+  fd = accept(srv->fd, NULL, NULL);
+  if (fd < 0) {
+    if (   errno != EINTR && errno != ECONNABORTED
+        && errno != EAGAIN && errno != EWOULDBLOCK)
+      sprintf(errmsg, "Cannot accept clients on %.*s\n",
+              errmsg_size - 27, srv->path);
+    return;
+  }
+
+  /* The client is read from only when poll() says there is */
+  /* something to read, but answers are written by blocking */
+  /* writes, which must not wait forever for it to read:    */
+
+  flags = fcntl(fd, F_GETFL);
+  if (flags >= 0) fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  tv.tv_sec = SENDTIMEOUT;
+  tv.tv_usec = 0;
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof tv);
+
+  s = addsession(srv,fd);
+  if (!s) {
+    close(fd);
+    return;
+  }
+  lockserver(srv);
+  ++srv->st.clients;
+  unlockserver(srv);
+}
+
+
+static void pollclients(server *srv, errmsg_t errmsg)
+
+/* Accepts the clients of *srv and reads their requests, handing   */
+/* each one to handrequest() once it has arrived, until something  */
+/* goes wrong that does not concern just one client.               */
+{
+  session **polled = NULL, *s, *next;
+  struct pollfd *fds = NULL;
+  int maxfds = 0, numfds, first, i, r;
+#ifdef PAR_THREADS
+  char drain[64];
+#endif
+
+  *errmsg = '\0';
+
+  for (;;) {
+
+    /* Look again at the clients whose requests have been answered, */
+    /* answering at once any further ones that have arrived whole:  */
+
+    for (;;) {
+      lockserver(srv);
+      s = srv->done;
+      srv->done = NULL;
+      unlockserver(srv);
+      if (!s) break;
+      for ( ;  s;  s = next) {
+        next = s->next;
+        r =  s->gone  ?  -1  :  nextrequest(s);
+        if (r < 0) closesession(s);
+        else if (r > 0) handrequest(s);
+        else s->waiting = 0;
+      }
+    }
+
+    /* Wait for a client, a request, or an answer, watching only */
+    /* the clients that are not waiting for answers:             */
+
+    if (srv->numall + 2 > maxfds) {
+      if (fds) free(fds);
+      if (polled) free(polled);
+      maxfds = 2 * (srv->numall + 2);
+      fds = malloc(maxfds * sizeof (struct pollfd));
+      polled = malloc(maxfds * sizeof (session *));
+      if (!fds || !polled) {
+        strcpy(errmsg,outofmem);
+        break;
+      }
+    }
+    fds[0].fd = srv->fd;
+    fds[0].events = POLLIN;
+    numfds = 1;
+#ifdef PAR_THREADS
+    fds[1].fd = srv->wake[0];
+    fds[1].events = POLLIN;
+    numfds = 2;
+#endif
+    first = numfds;
+    for (i = 0;  i < srv->numall;  ++i)
+      if (!srv->all[i]->waiting) {
+        polled[numfds] = srv->all[i];
+        fds[numfds].fd = srv->all[i]->fd;
+        fds[numfds++].events = POLLIN;
+      }
+
+    if (poll(fds, numfds, -1) < 0) {
+      if (errno == EINTR) continue;
+      sprintf(errmsg, "Cannot wait for clients on %.*s\n",
+              errmsg_size - 29, srv->path);
+      break;
+    }
+
+#ifdef PAR_THREADS
+    if (fds[1].revents)
+      while (read(srv->wake[0], drain, sizeof drain) > 0);
+#endif
+    for (i = first;  i < numfds;  ++i)
+      if (fds[i].revents) readclient(polled[i]);
+    if (fds[0].revents) {
+      acceptclient(srv,errmsg);
+      if (*errmsg) break;
+    }
+  }
+
+  if (fds) free(fds);
+  if (polled) free(polled);
+}
+
+
+static int listenon(const char *path, errmsg_t errmsg)
+
+/* Returns a socket listening on a Unix domain socket named path, */
+/* removing any socket left there by a server that has gone, or   */
+/* returns -1 on failure.                                         */
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  int fd, probe;
+
+  if (strlen(path) >= sizeof (addr.sun_path)) {
+    sprintf(errmsg, "Socket name too long: %.*s\n", errmsg_size - 24, path);
+    return -1;
+  }
+  memset(&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+
+  if (lstat(path,&st) == 0 && S_ISSOCK(st.st_mode)) {
+    probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe >= 0
+        && connect(probe, (struct sockaddr *) &addr, sizeof (addr)) == 0) {
+      close(probe);
+      sprintf(errmsg, "Socket already in use: %.*s\n",
+              errmsg_size - 25, path);
+      return -1;
+    }
+    if (probe >= 0) close(probe);
+    unlink(path);
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0
+      || bind(fd, (struct sockaddr *) &addr, sizeof (addr)) < 0
+      || listen(fd, SOMAXCONN) < 0) {
+    if (fd >= 0) close(fd);
+    sprintf(errmsg, "Cannot listen on %.*s\n", errmsg_size - 19, path);
+    return -1;
+  }
+
+  *errmsg = '\0';
+  return fd;
+}
+
+#endif
+
+
+void parserve(const char *path, const parctx *base, errmsg_t errmsg)
+{
+#ifdef PAR_POSIX
+  server *srv;
+  pool *p = NULL;
+  worker *w;
+  int i, jobs = parjobs(base), flags;
+
+#ifndef PAR_THREADS
+  jobs = 1;
+#endif
+  srv = calloc(1, sizeof (server));
+  if (srv) srv->workers = calloc(jobs, sizeof (worker));
+  if (!srv || !srv->workers) {
+    strcpy(errmsg,outofmem);
+    if (srv) free(srv);
+    return;
+  }
+  srv->base = base;
+  srv->path = path;
+  for (i = 0;  i < jobs;  ++i) srv->workers[i].srv = srv;
+#ifdef PAR_THREADS
+  srv->queueend = &srv->queue;
+  srv->wake[0] = srv->wake[1] = -1;
+  pthread_mutex_init(&srv->lock, NULL);
+  pthread_cond_init(&srv->queued, NULL);
+#endif
+
+  srv->fd = listenon(path,errmsg);
+  if (*errmsg) goto pscleanup;
+  flags = fcntl(srv->fd, F_GETFL);
+  if (flags >= 0) fcntl(srv->fd, F_SETFL, flags | O_NONBLOCK);
+
+  /* A client that disconnects before its answer is */
+  /* written must not kill the server:              */
+
+  signal(SIGPIPE, SIG_IGN);
+
+#ifdef PAR_THREADS
+  if (pipe(srv->wake) < 0) {
+    srv->wake[0] = srv->wake[1] = -1;
+    strcpy(errmsg, "Cannot make a pipe.\n");
+    goto pscleanup;
+  }
+  for (i = 0;  i < 2;  ++i) {
+    flags = fcntl(srv->wake[i], F_GETFL);
+    if (flags >= 0) fcntl(srv->wake[i], F_SETFL, flags | O_NONBLOCK);
+  }
+
+  p = startpool(jobs, jobs, runworker, srv, errmsg);
+  if (*errmsg) goto pscleanup;
+#endif
+
+  pollclients(srv,errmsg);
+
+#ifdef PAR_THREADS
+  lockserver(srv);
+  srv->stop = 1;
+  pthread_cond_broadcast(&srv->queued);
+  unlockserver(srv);
+  for (i = 0;  i < jobs;  ++i) waittask(p,i);
+#endif
+
+pscleanup:
+
+  if (p) endpool(p);
+  while (srv->numall) closesession(srv->all[0]);
+  if (srv->all) free(srv->all);
+  if (srv->fd >= 0) {
+    close(srv->fd);
+    unlink(path);
+  }
+#ifdef PAR_THREADS
+  if (srv->wake[0] >= 0) {
+    close(srv->wake[0]);
+    close(srv->wake[1]);
+  }
+  pthread_cond_destroy(&srv->queued);
+  pthread_mutex_destroy(&srv->lock);
+#endif
+  for (w = srv->workers;  w < srv->workers + jobs;  ++w)
+    for (i = 0;  i < CACHESIZE;  ++i)
+      if (w->cache[i].opts) {
+        free(w->cache[i].opts);
+        freeparctx(w->cache[i].ctx);
+      }
+  free(srv->workers);
+  free(srv);
+#else
+  (void) base;
+  sprintf(errmsg, "Cannot serve %.*s without PAR_POSIX.\n",
+          errmsg_size - 34, path);
+#endif
+}
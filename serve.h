@@ -0,0 +1,31 @@
+/*
+serve.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+*/
+
+
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "errmsg.h"
+#include "libpar.h"
+
+
+void parserve(const char *path, const parctx *base, errmsg_t errmsg);
+
+  /* parserve(path,base,errmsg) listens on a Unix domain socket named */
+  /* path and answers the requests of clients, as described for the   */
+  /* --serve option in par.doc, until something goes wrong that does  */
+  /* not concern just one client, so normally it never returns.       */
+  /* Each text is reformatted according to the options of *base       */
+  /* followed by those given with it.  parjobs(base) threads answer   */
+  /* requests, each once all of it has arrived.  If par was compiled  */
+  /* without PAR_POSIX defined, *errmsg is set at once.               */
+
+
+#endif
@@ -0,0 +1,197 @@
+/*
+stats.c
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89), except that if PAR_POSIX is defined it also
+uses POSIX clocks and getrusage().
+
+Without PAR_POSIX, the only clock is clock(), so the wall times are
+really processor times, and the processor time of a phase is that of
+the whole process, which is wrong if other threads are busy meanwhile
+(but without PAR_POSIX there are no other threads).
+
+Each thread counts into a parstats of its own, and the caller adds
+them together once the threads are done with them, so nothing here
+needs a lock.
+
+*/
+
+
+#include "stats.h"  /* Makes sure we're consistent with the prototypes. */
+
+#include "errmsg.h"
+#include "output.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef PAR_POSIX
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+#undef NULL
+#define NULL ((void *) 0)
+
+#ifdef DONTFREE
+#define free(ptr)
+#endif
+
+
+static const char * const phasenames[PS_NUMPHASES] =
+  { "input", "delimit", "reformat", "output" };
+
+
+#ifndef PAR_POSIX
+
+static unsigned long ticktous(clock_t t)
+
+/* Returns the number of microseconds in t ticks of clock(). */
+{
+  unsigned long persec = CLOCKS_PER_SEC;
+
+  if (persec >= 1000000) return (unsigned long) t / (persec / 1000000);
+  return (unsigned long) t * (1000000 / persec);
+}
+
+#endif
+
+
+static void getclocks(unsigned long *pwall, unsigned long *pcpu)
+
+/* Sets *pwall and *pcpu to the present wall and processor times, */
+/* in microseconds since some arbitrary time.  They may wrap      */
+/* around, so only their differences mean anything.               */
+{
+#ifdef PAR_POSIX
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  *pwall = (unsigned long) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+#else
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+#endif
+  *pcpu = (unsigned long) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+#else
+  *pwall = *pcpu = ticktous(clock());
+#endif
+}
+
+
+void clearstats(parstats *st)
+{
+  unsigned long cpu;
+
+  memset(st, 0, sizeof (parstats));
+  st->phase = PS_NONE;
+  getclocks(&st->start, &cpu);
+}
+
+
+void statphase(parstats *st, int phase)
+{
+  unsigned long wall, cpu;
+
+  if (phase == st->phase) return;
+
+  getclocks(&wall,&cpu);
+  if (st->phase != PS_NONE) {
+    st->wall[st->phase] += wall - st->wall0;
+    st->cpu[st->phase] += cpu - st->cpu0;
+  }
+  st->phase = phase;
+  st->wall0 = wall, st->cpu0 = cpu;
+}
+
+
+void addstats(parstats *to, const parstats *from)
+{
+  int i;
+
+  to->bytesin += from->bytesin;
+  to->bytesout += from->bytesout;
+  to->segments += from->segments;
+  to->ips += from->ips;
+  to->bodiless += from->bodiless;
+  to->words += from->words;
+  to->splits += from->splits;
+  to->simplerelax += from->simplerelax;
+  to->normalrelax += from->normalrelax;
+  to->justrelax += from->justrelax;
+  to->tryls += from->tryls;
+  to->cachehits += from->cachehits;
+  to->cachemisses += from->cachemisses;
+  to->diskhits += from->diskhits;
+  to->diskmisses += from->diskmisses;
+  for (i = 0;  i < PS_NUMPHASES;  ++i) {
+    to->wall[i] += from->wall[i];
+    to->cpu[i] += from->cpu[i];
+  }
+}
+
+
+static void putstat(
+  output *out, const char *name, unsigned long n, errmsg_t errmsg
+)
+/* Writes a line holding name and n to *out, unless *errmsg */
+/* is already set.                                          */
+{
+  char line[64];
+
+  if (*errmsg) return;
+  sprintf(line, "%.40s %lu\n", name, n);
+  outchars(out, line, strlen(line), errmsg);
+}
+
+
+void putstats(const parstats *st, output *out, errmsg_t errmsg)
+{
+  unsigned long wall, cpu;
+  char name[32];
+  int i;
+#ifdef PAR_POSIX
+  struct rusage ru;
+#endif
+
+  *errmsg = '\0';
+
+  putstat(out, "bytes_in", st->bytesin, errmsg);
+  putstat(out, "bytes_out", st->bytesout, errmsg);
+  putstat(out, "segments", st->segments, errmsg);
+  putstat(out, "ips", st->ips, errmsg);
+  putstat(out, "bodiless_lines", st->bodiless, errmsg);
+  putstat(out, "words", st->words, errmsg);
+  putstat(out, "split_words", st->splits, errmsg);
+  putstat(out, "simple_relaxations", st->simplerelax, errmsg);
+  putstat(out, "normal_relaxations", st->normalrelax, errmsg);
+  putstat(out, "just_relaxations", st->justrelax, errmsg);
+  putstat(out, "fit_widths", st->tryls, errmsg);
+  putstat(out, "cache_hits", st->cachehits, errmsg);
+  putstat(out, "cache_misses", st->cachemisses, errmsg);
+  putstat(out, "disk_hits", st->diskhits, errmsg);
+  putstat(out, "disk_misses", st->diskmisses, errmsg);
+  for (i = 0;  i < PS_NUMPHASES;  ++i) {
+    sprintf(name, "%s_wall_us", phasenames[i]);
+    putstat(out, name, st->wall[i], errmsg);
+    sprintf(name, "%s_cpu_us", phasenames[i]);
+    putstat(out, name, st->cpu[i], errmsg);
+  }
+
+  getclocks(&wall,&cpu);
+  putstat(out, "total_wall_us", wall - st->start, errmsg);
+#ifdef PAR_POSIX
+  if (getrusage(RUSAGE_SELF, &ru) == 0) {
+    cpu = (unsigned long) ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec
+        + (unsigned long) ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+    putstat(out, "total_cpu_us", cpu, errmsg);
+    putstat(out, "peak_rss_kb", ru.ru_maxrss, errmsg);
+  }
+#else
+  putstat(out, "total_cpu_us", ticktous(clock()), errmsg);
+#endif
+}
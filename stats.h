@@ -0,0 +1,86 @@
+/*
+stats.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+*/
+
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "errmsg.h"
+#include "output.h"
+
+
+/* The phases whose times are counted separately: */
+
+#define PS_NONE     (-1)  /* None of the others.                     */
+#define PS_INPUT      0   /* Reading and scanning the input.         */
+#define PS_DELIMIT    1   /* Finding paragraphs, prefixes, suffixes. */
+#define PS_REFORMAT   2   /* Choosing line breaks and making lines.  */
+#define PS_OUTPUT     3   /* Writing the output.                     */
+#define PS_NUMPHASES  4
+
+/* Structure for counting the work done by one thread (times are in */
+/* microseconds):                                                   */
+
+typedef struct parstats {
+  unsigned long bytesin,      /* Characters read.                       */
+                bytesout,     /* Characters written.                    */
+                segments,     /* Segments (see par.doc).                */
+                ips,          /* Input paragraphs.                      */
+                bodiless,     /* Bodiless lines.                        */
+                words,        /* Words, after merging and splitting.    */
+                splits,       /* Pieces split off long words.           */
+                simplerelax,  /* Lines considered by the dynamic        */
+                normalrelax,  /* programming of simplebreaks(),         */
+                justrelax,    /* normalbreaks(), and justbreaks() (see  */
+                              /* reformat.c).                           */
+                tryls,        /* Widths tried for the f option.         */
+                cachehits,    /* Paragraphs found in the cache, and     */
+                cachemisses,  /* not found there.                       */
+                diskhits,     /* Segments found in the diskcache, and   */
+                diskmisses,   /* not found there.                       */
+                wall[PS_NUMPHASES],  /* Time spent in each phase, and   */
+                cpu[PS_NUMPHASES];   /* processor time.                 */
+  int phase;                  /* The phase being timed.                 */
+  unsigned long wall0, cpu0,  /* When it began.                         */
+                start;        /* When the counting began.               */
+} parstats;
+
+
+void clearstats(parstats *st);
+
+  /* clearstats(st) sets every count and time in *st to zero, and */
+  /* marks the present as the start of the counting, in no phase. */
+
+
+void statphase(parstats *st, int phase);
+
+  /* statphase(st,phase) adds the time since the phase of *st began  */
+  /* to its total, and begins phase, which is one of the PS_ values  */
+  /* above.  It does nothing if phase is already the phase of *st.   */
+  /* The processor time is that of the calling thread if PAR_POSIX   */
+  /* is defined, or of the whole process if not, so a phase should   */
+  /* begin and end in the same thread.                               */
+
+
+void addstats(parstats *to, const parstats *from);
+
+  /* addstats(to,from) adds the counts and times of *from to those */
+  /* of *to.  *from should be in no phase.                         */
+
+
+void putstats(const parstats *st, output *out, errmsg_t errmsg);
+
+  /* putstats(st,out,errmsg) writes the counts and times of *st to */
+  /* *out, as described for the --stats option in par.doc, along   */
+  /* with the time since the counting began and the processor time */
+  /* and peak memory use of the whole process.                     */
+
+
+#endif
@@ -0,0 +1,39 @@
+/*
+utf8.h
+last touched in Par 1.54.0
+last meaningful change in Par 1.54.0
+Copyright 2026 Par contributors
+
+This is ANSI C code (C89).
+
+Note: Those functions declared here which do not use errmsg
+always succeed, provided that they are passed valid arguments.
+
+*/
+
+
+#ifndef UTF8_H
+#define UTF8_H
+
+
+int utf8width(const char *s, int n);
+
+  /* utf8width(s,n) returns the number of columns taken up on a  */
+  /* terminal by the n-character array s, taken to be UTF-8.     */
+  /* East Asian wide and fullwidth characters take up two        */
+  /* columns, combining marks and other zero-width characters    */
+  /* none, and any other character one.  Each character that is  */
+  /* not part of a well-formed UTF-8 sequence takes up one.      */
+
+
+int utf8fit(const char *s, int n, int width, int *pwidth);
+
+  /* utf8fit(s,n,width,pwidth) returns the number of characters */
+  /* at the beginning of the n-character array s (n must not be */
+  /* 0) that make up the longest run of whole UTF-8 sequences   */
+  /* whose width, as for utf8width(), is at most width, except  */
+  /* that the first sequence is included no matter how wide it  */
+  /* is.  *pwidth is set to the width of that run.              */
+
+
+#endif